@@ -42,9 +42,13 @@ unittest {
 # Input
 # src
 HEADERS += src/GaussianBeam.h src/Optics.h src/OpticsBench.h src/Statistics.h src/GaussianFit.h \
-           src/Function.h src/OpticsFunction.h src/Cavity.h src/Utils.h src/lmmin.h src/Delegate.h
+           src/Function.h src/OpticsFunction.h src/Cavity.h src/Utils.h src/lmmin.h src/Delegate.h \
+           src/XmlReader.h src/BenchFile.h src/CompiledBench.h src/Jet.h src/Interval.h src/PropagationTree.h src/ObjectPool.h \
+           src/BinaryFile.h src/ParameterSweep.h src/ToleranceAnalysis.h src/LensSelection.h src/StabilityMap.h
 SOURCES += src/GaussianBeam.cpp src/Optics.cpp src/OpticsBench.cpp src/GaussianFit.cpp \
-           src/Function.cpp src/OpticsFunction.cpp src/Cavity.cpp src/Utils.cpp src/lmmin.c
+           src/Function.cpp src/OpticsFunction.cpp src/Cavity.cpp src/Utils.cpp src/lmmin.c \
+           src/XmlReader.cpp src/BenchFile.cpp src/CompiledBench.cpp src/PropagationTree.cpp \
+           src/BinaryFile.cpp src/ParameterSweep.cpp src/ToleranceAnalysis.cpp src/LensSelection.cpp src/StabilityMap.cpp
 # gui
 HEADERS += gui/GaussianBeamWidget.h gui/OpticsView.h gui/OpticsWidgets.h gui/GaussianBeamDelegate.h \
            gui/GaussianBeamModel.h gui/GaussianBeamWindow.h gui/Unit.h gui/Names.h
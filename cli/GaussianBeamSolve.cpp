@@ -0,0 +1,241 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+* gaussianbeam-solve: headless batch solver for GaussianBeam bench files.
+* Each bench file is loaded, optimized with the magic waist or local optimum
+* search, and a table of the solved optics and beams is written out.
+* Files are processed in parallel, and results are written in the order of the command line.
+*/
+
+#include "src/OpticsBench.h"
+#include "src/BenchFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+enum SolveMethod {MagicWaist, LocalOptimum, NoOptimization};
+
+struct SolveJob
+{
+	string fileName;
+	string result;
+	bool success;
+};
+
+static void printUsage(const char* program)
+{
+	cerr << "Usage: " << program << " [options] file.xml [file.xml ...]" << endl
+	     << "Options:" << endl
+	     << "  -m, --method <magic|local|none>  optimization method (default: magic)" << endl
+	     << "  -o, --output <file>              write results to <file> instead of the standard output" << endl
+	     << "  -s, --seed <n>                   seed of the magic waist search, to reproduce a previous result" << endl
+	     << "  -b, --budget <n>                 maximum number of overlap evaluations of the magic waist search" << endl
+	     << "  -j, --jobs <n>                   number of files processed in parallel (default: number of cores)" << endl
+	     << "  -h, --help                       show this help" << endl;
+}
+
+static void writeBeam(ostream& out, const Beam* beam, bool spherical)
+{
+	out << "\t" << beam->waist(Horizontal) << "\t" << beam->waistPosition(Horizontal);
+	if (!spherical)
+		out << "\t" << beam->waist(Vertical) << "\t" << beam->waistPosition(Vertical);
+}
+
+struct SolveOptions
+{
+	SolveMethod method;
+	bool fixedSeed;
+	unsigned int seed;
+	int budget;
+	int threadCount;
+};
+
+static void solve(SolveJob& job, const SolveOptions& options)
+{
+	stringstream out;
+	out << setprecision(10);
+	out << "file\t" << job.fileName << endl;
+
+	OpticsBench bench;
+	BenchFileReader reader(&bench);
+	if (!reader.read(job.fileName))
+	{
+		out << "error\t" << reader.errorString() << endl << endl;
+		job.result = out.str();
+		job.success = false;
+		return;
+	}
+
+	if (bench.nOptics() == 0)
+	{
+		out << "error\tthe bench does not contain any optics" << endl << endl;
+		job.result = out.str();
+		job.success = false;
+		return;
+	}
+
+	const SolveMethod method = options.method;
+	bench.setThreadCount(options.threadCount);
+	if (options.budget > 0)
+		bench.setMagicWaistBudget(options.budget);
+	if (method == MagicWaist)
+		job.success = options.fixedSeed ? bench.magicWaist(options.seed) : bench.magicWaist();
+	else if (method == LocalOptimum)
+		job.success = bench.localOptimum();
+	else
+		job.success = true;
+
+	const bool spherical = bench.isSpherical();
+	out << "method\t" << (method == MagicWaist ? "magic" : method == LocalOptimum ? "local" : "none") << endl;
+	if (method == MagicWaist)
+		out << "seed\t" << bench.magicWaistSeed() << endl;
+	out << "success\t" << (job.success ? "yes" : "no") << endl;
+	out << "overlap\t" << Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam()) << endl;
+	out << "target";
+	writeBeam(out, bench.targetBeam(), spherical);
+	out << endl;
+	out << "#index\tname\ttype\tposition\twaist" << (spherical ? "" : "H") << "\twaistPosition" << (spherical ? "" : "H");
+	if (!spherical)
+		out << "\twaistV\twaistPositionV";
+	out << endl;
+	for (int i = 0; i < bench.nOptics(); i++)
+	{
+		const Optics* optics = bench.optics(i);
+		out << i << "\t" << optics->name() << "\t" << opticsCodedName(optics->type()) << "\t" << optics->position();
+		writeBeam(out, bench.beam(i), spherical);
+		out << endl;
+	}
+	out << endl;
+
+	job.result = out.str();
+}
+
+int main(int argc, char* argv[])
+{
+	SolveOptions options;
+	options.method = MagicWaist;
+	options.fixedSeed = false;
+	options.seed = 0;
+	options.budget = 0;
+	string outputFile;
+	unsigned int nJobs = thread::hardware_concurrency();
+	vector<SolveJob> jobs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if ((arg == "-h") || (arg == "--help"))
+		{
+			printUsage(argv[0]);
+			return 0;
+		}
+		else if (((arg == "-m") || (arg == "--method")) && (i + 1 < argc))
+		{
+			string name = argv[++i];
+			if (name == "magic")
+				options.method = MagicWaist;
+			else if (name == "local")
+				options.method = LocalOptimum;
+			else if (name == "none")
+				options.method = NoOptimization;
+			else
+			{
+				cerr << "Unknown method " << name << endl;
+				return 2;
+			}
+		}
+		else if (((arg == "-o") || (arg == "--output")) && (i + 1 < argc))
+			outputFile = argv[++i];
+		else if (((arg == "-s") || (arg == "--seed")) && (i + 1 < argc))
+		{
+			options.fixedSeed = true;
+			options.seed = strtoul(argv[++i], 0, 10);
+		}
+		else if (((arg == "-b") || (arg == "--budget")) && (i + 1 < argc))
+			options.budget = atoi(argv[++i]);
+		else if (((arg == "-j") || (arg == "--jobs")) && (i + 1 < argc))
+			nJobs = atoi(argv[++i]);
+		else if ((arg.size() > 1) && (arg[0] == '-'))
+		{
+			cerr << "Unknown option " << arg << endl;
+			printUsage(argv[0]);
+			return 2;
+		}
+		else
+		{
+			SolveJob job;
+			job.fileName = arg;
+			job.success = false;
+			jobs.push_back(job);
+		}
+	}
+
+	if (jobs.empty())
+	{
+		printUsage(argv[0]);
+		return 2;
+	}
+
+	// Check the output before spending time on the searches
+	ofstream file;
+	if (!outputFile.empty())
+	{
+		file.open(outputFile.c_str());
+		if (!file)
+		{
+			cerr << "Cannot write file " << outputFile << endl;
+			return 2;
+		}
+	}
+	ostream& out = outputFile.empty() ? cout : file;
+
+	// Each worker takes the next unprocessed file until all are done
+	nJobs = ::max(1u, ::min(nJobs, (unsigned int)jobs.size()));
+	// Share the cores between the files processed in parallel and the threads of each search
+	options.threadCount = ::max(1u, thread::hardware_concurrency()/nJobs);
+	atomic<size_t> nextJob(0);
+	vector<thread> workers;
+	for (unsigned int i = 0; i < nJobs; i++)
+		workers.push_back(thread([&jobs, &nextJob, &options]()
+		{
+			for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+				solve(jobs[j], options);
+		}));
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++)
+		it->join();
+
+	bool success = true;
+	for (vector<SolveJob>::const_iterator it = jobs.begin(); it != jobs.end(); it++)
+	{
+		out << it->result;
+		success = success && it->success;
+	}
+
+	return success ? 0 : 1;
+}
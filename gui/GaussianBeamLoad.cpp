@@ -21,15 +21,20 @@
 #include "gui/Unit.h"
 #include "gui/Names.h"
 #include "src/GaussianFit.h"
+#include "src/BenchFile.h"
+#include "src/XmlReader.h"
 
 #include <QDebug>
 #include <QFile>
 #include <QBuffer>
 #include <QMessageBox>
 #include <QStandardItemModel>
-#include <QtXml/QDomDocument>
 #include <QtXmlPatterns/QXmlQuery>
 
+#include <istream>
+#include <streambuf>
+#include <string>
+
 /**************************************************************
 Change log for GaussianBeam files. All this changes are coded in XSL-T documents
 able to automatically perform file format conversion
@@ -108,302 +113,119 @@ void GaussianBeamWindow::convertFormat(QByteArray* data, const QString& xsltPath
 	*data = convertedData;
 }
 
-bool GaussianBeamWindow::parseFile(const QString& fileName)
+/// Read a QIODevice through a std::streambuf, so that the core reader streams files opened by Qt
+class DeviceStreamBuffer : public std::streambuf
 {
-	// Load data
-	QFile file(fileName);
-	if (!(file.open(QFile::ReadOnly | QFile::Text)))
-	{
-		QMessageBox::warning(this, tr("Opening file"), tr("Cannot read file %1:\n%2.").arg(fileName).arg(file.errorString()));
-		return false;
-	}
-	QByteArray data = file.readAll();
-	file.close();
-
-	// Convert old file versions
-	convertFormat(&data, ":/xslt/1_0_to_1_1.xsl");
-	convertFormat(&data, ":/xslt/1_1_to_1_2.xsl");
+public:
+	DeviceStreamBuffer(QIODevice* device) : m_device(device) {}
 
-	// Parse XML file
-	QString errorStr;
-	int errorLine;
-	int errorColumn;
-	QDomDocument domDocument;
-
-	if (!domDocument.setContent(data, true, &errorStr, &errorLine, &errorColumn))
+protected:
+	virtual int_type underflow()
 	{
-		QMessageBox::information(window(), tr("XML error"), tr("Parse error at line %1, column %2:\n%3").arg(errorLine).arg(errorColumn).arg(errorStr));
-		file.close();
-		return false;
+		qint64 size = m_device->read(m_buffer, sizeof(m_buffer));
+		if (size <= 0)
+			return traits_type::eof();
+		setg(m_buffer, m_buffer, m_buffer + size);
+		return traits_type::to_int_type(m_buffer[0]);
 	}
 
-	// XML version
-	QDomElement root = domDocument.documentElement();
-	if (root.tagName() != "gaussianBeam")
+	virtual pos_type seekpos(pos_type position, std::ios_base::openmode /*mode*/)
 	{
-		QMessageBox::information(window(), tr("XML error"), tr("The file is not an GaussianBeam file."));
-		return false;
+		if (!m_device->seek(position))
+			return pos_type(off_type(-1));
+		setg(m_buffer, m_buffer, m_buffer);
+		return position;
 	}
 
-	if (!root.hasAttribute("version"))
-	{
-		QMessageBox::information(window(), tr("XML error"), tr("This file does not contain any version information."));
-		return false;
-	}
+private:
+	QIODevice* m_device;
+	char m_buffer[4096];
+};
 
-	if (root.attribute("version") != "1.2")
-	{
-		QMessageBox::information(window(), tr("XML error"), tr("Your version of GaussianBeam is too old."));
-		return false;
-	}
-
-	m_bench->clear();
-	parseXml(root);
-
-	return true;
-}
-
-void GaussianBeamWindow::parseXml(const QDomElement& element)
+/// Read the bench with the core reader, converting old files with XSLT, and the view into the window
+class GaussianBeamFileReader : public BenchFileReader
 {
-	QDomElement child = element.firstChildElement();
+public:
+	GaussianBeamFileReader(GaussianBeamWindow* window, OpticsBench* bench)
+		: BenchFileReader(bench), m_window(window) {}
 
-	while (!child.isNull())
+protected:
+	virtual bool convert(std::string& data, const std::string& version)
 	{
-		if (child.tagName() == "bench")
-			parseBench(child);
-		else if (child.tagName() == "view")
-			parseView(child);
-		else
-			qDebug() << " -> Unknown tag: " << element.tagName();
-		child = child.nextSiblingElement();
+		if ((version != "1.0") && (version != "1.1"))
+			return false;
+
+		QByteArray convertedData(data.data(), data.size());
+		if (version == "1.0")
+			m_window->convertFormat(&convertedData, ":/xslt/1_0_to_1_1.xsl");
+		m_window->convertFormat(&convertedData, ":/xslt/1_1_to_1_2.xsl");
+		data.assign(convertedData.constData(), convertedData.size());
+		return true;
 	}
-}
-
-void GaussianBeamWindow::parseBench(const QDomElement& element)
-{
-	QDomElement child = element.firstChildElement();
-	QList<QString> lockTree;
 
-	while (!child.isNull())
+	virtual void parseView(XmlReader& xml)
 	{
-		if (child.tagName() == "wavelength")
-			m_bench->setWavelength(child.text().toDouble());
-		else if (child.tagName() == "leftBoundary")
-			m_bench->setLeftBoundary(child.text().toDouble());
-		else if (child.tagName() == "rightBoundary")
-			m_bench->setRightBoundary(child.text().toDouble());
-		else if (child.tagName() == "targetBeam")
-			parseTargetBeam(child);
-		else if (child.tagName() == "beamFit")
-			parseFit(child);
-		else if (child.tagName() == "opticsList")
-		{
-			QMap<int, Optics*> opticsList; // Key = id
-			QMap<int, int> lockTree;       // Key = child id, value = parent id
-
-			QDomElement opticsElement = child.firstChildElement();
-			while (!opticsElement.isNull())
-			{
-				parseOptics(opticsElement, opticsList, lockTree);
-				opticsElement = opticsElement.nextSiblingElement();
-			}
-
-			for(QMap<int, int>::const_iterator it = lockTree.constBegin(); it != lockTree.constEnd(); ++it)
-			{
-				Optics* opticsChild  = opticsList.value(it.key());
-				Optics* opticsParent = opticsList.value(it.value());
-				if (opticsChild && opticsParent)
-					opticsChild->relativeLockTo(opticsParent);
-			}
-		}
-		else
-			qDebug() << " -> Unknown tag: " << child.tagName();
-
-		child = child.nextSiblingElement();
+		m_window->parseView(xml, m_view);
 	}
-}
 
-void GaussianBeamWindow::parseTargetBeam(const QDomElement& element)
-{
-	Beam targetBeam = *m_bench->targetBeam();
-	parseBeam(element, targetBeam);
-	m_bench->setTargetBeam(targetBeam);
-}
+public:
+	/// View properties of the file, to apply once the bench has been read
+	const QHash<QString, QString>& view() const { return m_view; }
 
-#include <iostream>
-using namespace std;
+private:
+	GaussianBeamWindow* m_window;
+	QHash<QString, QString> m_view;
+};
 
-void GaussianBeamWindow::parseBeam(const QDomElement& element, Beam& beam)
+bool GaussianBeamWindow::parseFile(const QString& fileName)
 {
-	QDomElement child = element.firstChildElement();
-
-	while (!child.isNull())
+	QFile file(fileName);
+	if (!(file.open(QFile::ReadOnly)))
 	{
-		/// @todo showTargetBeam is missing
-		if (child.tagName() == "waist")
-			beam.setWaist(child.text().toDouble(), OrientationName::codedName.key(child.attribute("orientation")));
-		else if (child.tagName() == "waistPosition")
-			beam.setWaistPosition(child.text().toDouble(), OrientationName::codedName.key(child.attribute("orientation")));
-		else if (child.tagName() == "wavelength")
-			beam.setWavelength(child.text().toDouble());
-		else if (child.tagName() == "index")
-			beam.setIndex(child.text().toDouble());
-		else if (child.tagName() == "M2")
-			beam.setM2(child.text().toDouble());
-		// The next tags are specific to target beams
-		else if ((child.tagName() == "targetOverlap") || (child.tagName() == "minOverlap"))
-			m_bench->setTargetOverlap(child.text().toDouble());
-		else if (child.tagName() == "targetOrientation")
-			m_bench->setTargetOrientation(Orientation(child.text().toInt()));
-		else
-			qDebug() << " -> Unknown tag in parseBeam: " << child.tagName();
-		child = child.nextSiblingElement();
+		QMessageBox::warning(this, tr("Opening file"), tr("Cannot read file %1:\n%2.").arg(fileName).arg(file.errorString()));
+		return false;
 	}
-}
 
-void GaussianBeamWindow::parseFit(const QDomElement& element)
-{
-	QDomElement child = element.firstChildElement();
-	Fit* fit = m_bench->addFit(m_bench->nFit());
-
-	while (!child.isNull())
+	// Files of the current version are read in a single pass. Older files are converted first
+	DeviceStreamBuffer buffer(&file);
+	std::istream stream(&buffer);
+	GaussianBeamFileReader reader(this, m_bench);
+	if (!reader.read(stream))
 	{
-		if (child.tagName() == "name")
-			fit->setName(child.text().toUtf8().data());
-		else if (child.tagName() == "dataType")
-			fit->setDataType(FitDataType(child.text().toInt()));
-		else if (child.tagName() == "color")
-			fit->setColor(child.text().toUInt());
-		else if (child.tagName() == "orientation")
-			fit->setOrientation(OrientationName::codedName.key(child.text()));
-		else if (child.tagName() == "data")
-		{
-			QDomElement dataElement = child.firstChildElement();
-			double position = 0.;
-			bool added = false;
-			while (!dataElement.isNull())
-			{
-				if (dataElement.tagName() == "position")
-					position = dataElement.text().toDouble();
-				else if (dataElement.tagName() == "value")
-				{
-					double value = dataElement.text().toDouble();
-					Orientation orientation = OrientationName::codedName.key(dataElement.attribute("orientation"));
-					if (added)
-						fit->setData(fit->size() - 1, position, value, orientation);
-					else
-					{
-						fit->addData(position, value, orientation);
-						added = true;
-					}
-				}
-				else
-					qDebug() << " -> Unknown tag: " << dataElement.tagName();
-				dataElement = dataElement.nextSiblingElement();
-			}
-		}
-		else
-			qDebug() << " -> Unknown tag: " << child.tagName();
-		child = child.nextSiblingElement();
+		QMessageBox::information(window(), tr("XML error"), QString::fromUtf8(reader.errorString().c_str()));
+		return false;
 	}
+
+	// Only now that the bench has been replaced, as the view of an invalid file is ignored
+	applyView(reader.view());
+	return true;
 }
 
-void GaussianBeamWindow::parseOptics(const QDomElement& element, QMap<int, Optics*>& opticsList, QMap<int, int>& lockTree)
+void GaussianBeamWindow::parseView(XmlReader& xml, QHash<QString, QString>& view) const
 {
-	Optics* optics = 0;
-
-	if (element.tagName() == OpticsName::codedName[CreateBeamType])
-		optics = new CreateBeam(1., 1., 1., "");
-	else if (element.tagName() == OpticsName::codedName[LensType])
-		optics = new Lens(1., 1., "");
-	else if (element.tagName() == OpticsName::codedName[FlatMirrorType])
-		optics = new FlatMirror(1., "");
-	else if (element.tagName() == OpticsName::codedName[CurvedMirrorType])
-		optics = new CurvedMirror(1., 1., "");
-	else if (element.tagName() == OpticsName::codedName[FlatInterfaceType])
-		optics = new FlatInterface(1., 1., "");
-	else if (element.tagName() == OpticsName::codedName[CurvedInterfaceType])
-		optics = new CurvedInterface(1., 1., 1., "");
-	else if (element.tagName() == OpticsName::codedName[DielectricSlabType])
-		optics = new DielectricSlab(1., 1., 1., "");
-	else if (element.tagName() == OpticsName::codedName[GenericABCDType])
-		optics = new GenericABCD(1., 1., 1., 1., 1., 1., "");
-	else
-		qDebug() << " -> Unknown tag in parseOptics: " << element.tagName();
-
-	if (!optics)
-		return;
-
-	int id = element.attribute("id").toInt();
-
-	QDomElement child = element.firstChildElement();
-
-	while (!child.isNull())
+	while (xml.readNextStartElement())
 	{
-		if (child.tagName() == "position")
-			optics->setPosition(child.text().toDouble(), false);
-		else if (child.tagName() == "angle")
-			optics->setAngle(child.text().toDouble());
-		else if (child.tagName() == "orientation")
-			optics->setOrientation(OrientationName::codedName.key(child.text()));
-		else if (child.tagName() == "name")
-			optics->setName(child.text().toUtf8().data());
-		else if (child.tagName() == "absoluteLock")
-			optics->setAbsoluteLock(child.text().toInt() == 1 ? true : false);
-		else if (child.tagName() == "relativeLockParent")
-			lockTree[id] = child.text().toInt();
-		else if (child.tagName() == "width")
-			optics->setWidth(child.text().toDouble());
-		else if (child.tagName() == "focal")
-			dynamic_cast<Lens*>(optics)->setFocal(child.text().toDouble());
-		else if (child.tagName() == "curvatureRadius")
-			dynamic_cast<CurvedMirror*>(optics)->setCurvatureRadius(child.text().toDouble());
-		else if (child.tagName() == "indexRatio")
-			dynamic_cast<Dielectric*>(optics)->setIndexRatio(child.text().toDouble());
-		else if (child.tagName() == "surfaceRadius")
-			dynamic_cast<CurvedInterface*>(optics)->setSurfaceRadius(child.text().toDouble());
-		else if (child.tagName() == "A")
-			dynamic_cast<GenericABCD*>(optics)->setA(child.text().toDouble(), OrientationName::codedName.key(child.attribute("orientation")));
-		else if (child.tagName() == "B")
-			dynamic_cast<GenericABCD*>(optics)->setB(child.text().toDouble(), OrientationName::codedName.key(child.attribute("orientation")));
-		else if (child.tagName() == "C")
-			dynamic_cast<GenericABCD*>(optics)->setC(child.text().toDouble(), OrientationName::codedName.key(child.attribute("orientation")));
-		else if (child.tagName() == "D")
-			dynamic_cast<GenericABCD*>(optics)->setD(child.text().toDouble(), OrientationName::codedName.key(child.attribute("orientation")));
-		else if (child.tagName() == "beam")
+		const QString name = QString::fromUtf8(xml.name().c_str());
+
+		if ((name == "horizontalRange") || (name == "origin") || (name == "showTargetBeam"))
+			view.insert(name, QString::fromUtf8(xml.readElementText().c_str()));
+		else
 		{
-			Beam inputBeam;
-			parseBeam(child, inputBeam);
-			dynamic_cast<CreateBeam*>(optics)->setBeam(inputBeam);
+			qDebug() << " -> Unknown tag: " << name;
+			xml.skipCurrentElement();
 		}
-		else
-			qDebug() << " -> Unknown tag in parseOptics: " << child.tagName();
-
-		child = child.nextSiblingElement();
 	}
-
-	opticsList[id] = optics;
-	m_bench->addOptics(optics, m_bench->nOptics());
 }
 
-void GaussianBeamWindow::parseView(const QDomElement& element)
+void GaussianBeamWindow::applyView(const QHash<QString, QString>& view)
 {
-	QDomElement child = element.firstChildElement();
-
-	while (!child.isNull())
-	{
-		if (child.tagName() == "horizontalRange")
-			m_hOpticsView->setHorizontalRange(child.text().toDouble());
-//		else if (child.tagName() == "verticalRange")
-//			m_hOpticsView->setVerticalRange(child.text().toDouble());
-		else if (child.tagName() == "origin")
-			/// @todo vertical origin
-			m_hOpticsView->setOrigin(QPointF(child.text().toDouble(), 0.));
-		else if (child.tagName() == "showTargetBeam")
-			showTargetBeam(child.text().toInt());
-		else
-			qDebug() << " -> Unknown tag: " << element.tagName();
-
-		child = child.nextSiblingElement();
-	}
+	if (view.contains("horizontalRange"))
+		m_hOpticsView->setHorizontalRange(view.value("horizontalRange").toDouble());
+//	if (view.contains("verticalRange"))
+//		m_hOpticsView->setVerticalRange(view.value("verticalRange").toDouble());
+	/// @todo vertical origin
+	if (view.contains("origin"))
+		m_hOpticsView->setOrigin(QPointF(view.value("origin").toDouble(), 0.));
+	if (view.contains("showTargetBeam"))
+		showTargetBeam(view.value("showTargetBeam").toInt());
 }
@@ -35,6 +35,7 @@ class CornerWidget;
 class TablePropertySelector;
 class QDoubleSpinBox;
 class QTableView;
+class XmlReader;
 
 class GaussianBeamWindow : public QMainWindow, private Ui::GaussianBeamWindow, protected OpticsBenchEventListener
 {
@@ -88,18 +89,16 @@ private:
 	void readSettings();
 	void writeSettings();
 
-// Loading stuff that should logically be moved to OpticsBench, but depend on Qt.
-// In addition, a GaussianBeam file contains view properties that do not belong to OpticsBench.
+// Loading stuff. The bench is read by BenchFileReader, with the help of GaussianBeamFileReader
+// for old file versions and for the view properties, that do not belong to OpticsBench.
 private:
+	friend class GaussianBeamFileReader;
 	void convertFormat(QByteArray* data, const QString& xsltPath) const;
 	bool parseFile(const QString& path = QString());
-	void parseXml(const QDomElement& element);
-	void parseBench(const QDomElement& element);
-	void parseTargetBeam(const QDomElement& element);
-	void parseBeam(const QDomElement& element, Beam& beam);
-	void parseFit(const QDomElement& element);
-	void parseOptics(const QDomElement& element, QMap<int, Optics*>& opticsList, QMap<int, int>& lockTree);
-	void parseView(const QDomElement& element);
+	/// Read the properties of a <view> element into @p view, by element name
+	void parseView(XmlReader& xml, QHash<QString, QString>& view) const;
+	/// Apply the view properties read by parseView()
+	void applyView(const QHash<QString, QString>& view);
 	bool writeFile(const QString& path = QString());
 	void writeOrientedElement(QXmlStreamWriter& xmlWriter, QString name, QString data, Orientation orientation) const;
 	void writeBench(QXmlStreamWriter& xmlWriter) const;
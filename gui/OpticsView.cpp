@@ -94,17 +94,35 @@ OpticsScene::OpticsScene(OpticsBench* bench, Orientation orientation, QObject* p
 	m_targetBeamItem->setPos(0., 0.);
 	addItem(m_targetBeamItem);
 
-	m_cavityBeamItem = new BeamItem(m_bench->cavity().eigenBeam(m_bench->wavelength(), 0));
+	m_cavityBeamItem = new BeamItem(&m_cavityBeam);
 	m_cavityBeamItem->setPlainStyle(false);
 	m_cavityBeamItem->setAuxiliary(true);
 	m_cavityBeamItem->setPos(0., 0.);
 	m_cavityBeamItem->setVisible(false);
-//	addItem(m_cavityBeamItem);
+	addItem(m_cavityBeamItem);
 
 	// Sync with bench
 	for (int i = 0; i < m_bench->nOptics(); i++)
 		onOpticsBenchOpticsAdded(i);
 	onOpticsBenchBoundariesChanged();
+	updateCavityBeam();
+}
+
+void OpticsScene::updateCavityBeam()
+{
+	// Eigen mode of the first cavity, cached by the bench, drawn along the beam after the first optics of the cavity
+	const Beam* eigenBeam = (m_bench->nCavities() > 0) ? m_bench->cavity(0).eigenBeam(m_bench->wavelength(), 0) : 0;
+	if (eigenBeam)
+	{
+		const Beam* axis = m_bench->beam(m_bench->opticsIndex(m_bench->cavity(0).optics(0)));
+		m_cavityBeam = *eigenBeam;
+		m_cavityBeam.setOrigin(axis->origin());
+		m_cavityBeam.setAngle(axis->angle());
+		m_cavityBeam.setStart(axis->start());
+		m_cavityBeam.setStop(axis->stop());
+		m_cavityBeamItem->updateTransform();
+	}
+	m_cavityBeamItem->setVisible(eigenBeam != 0);
 }
 
 void OpticsScene::setBeamScale(double beamScale)
@@ -184,26 +202,28 @@ bool OpticsScene::targetBeamVisible() const
 
 void OpticsScene::onOpticsBenchDataChanged(int startOptics, int endOptics)
 {
-	foreach (QGraphicsItem* graphicsItem, items())
+	// Optics may have been reordered within the changed range: reorder their items accordingly
+	QHash<const Optics*, OpticsItem*> changedItems;
+	for (int i = startOptics; i <= endOptics; i++)
+		changedItems.insert(m_opticsItems[i]->optics(), m_opticsItems[i]);
+
+	for (int i = startOptics; i <= endOptics; i++)
 	{
-		if (OpticsItem* opticsItem = dynamic_cast<OpticsItem*>(graphicsItem))
-		{
-			int opticsIndex = m_bench->opticsIndex(opticsItem->optics());
-			if ((opticsIndex >= startOptics) && (opticsIndex <= endOptics))
-			{
-				opticsItem->setUpdate(false);
-				const Beam* axis = m_bench->axis(opticsIndex);
-				Utils::Point coord = axis->absoluteCoordinates(opticsItem->optics()->position());
-				opticsItem->setRotation(-(axis->angle() + opticsItem->optics()->angle())*180./M_PI);
-				opticsItem->setPos(coord.x(), -coord.y());
-				opticsItem->updateNameLabel();
-				opticsItem->setUpdate(true);
-			}
-		}
+		OpticsItem* opticsItem = changedItems.value(m_bench->optics(i));
+		m_opticsItems[i] = opticsItem;
+		opticsItem->setUpdate(false);
+		const Beam* axis = m_bench->axis(i);
+		Utils::Point coord = axis->absoluteCoordinates(opticsItem->optics()->position());
+		opticsItem->setRotation(-(axis->angle() + opticsItem->optics()->angle())*180./M_PI);
+		opticsItem->setPos(coord.x(), -coord.y());
+		opticsItem->updateNameLabel();
+		opticsItem->setUpdate(true);
 	}
 
 	for (int i = qMax(0, startOptics-1); i <= endOptics; i++)
 		m_beamItems[i]->updateTransform();
+
+	updateCavityBeam();
 }
 
 void OpticsScene::onOpticsBenchTargetBeamChanged()
@@ -234,6 +254,7 @@ void OpticsScene::onOpticsBenchBoundariesChanged()
 void OpticsScene::onOpticsBenchOpticsAdded(int index)
 {
 	OpticsItem* opticsItem = new OpticsItem(m_bench->optics(index), m_bench);
+	m_opticsItems.insert(index, opticsItem);
 	addItem(opticsItem);
 
 	const Beam* beam = m_bench->beam(index);
@@ -252,10 +273,19 @@ void OpticsScene::onOpticsBenchOpticsAdded(int index)
 
 void OpticsScene::onOpticsBenchOpticsRemoved(int index, int count)
 {
-	foreach (QGraphicsItem* graphicsItem, items())
-		if (OpticsItem* opticsItem = dynamic_cast<OpticsItem*>(graphicsItem))
-			if (m_bench->opticsIndex(opticsItem->optics()) == -1)
-				removeItem(graphicsItem);
+	// Within an update of the bench, optics may have been reordered since the last
+	// onOpticsBenchDataChanged(): match the items with the remaining optics rather than with their index
+	QHash<const Optics*, OpticsItem*> remainingItems;
+	foreach (OpticsItem* opticsItem, m_opticsItems)
+		remainingItems.insert(opticsItem->optics(), opticsItem);
+	for (int i = 0; i < m_bench->nOptics(); i++)
+		m_opticsItems[i] = remainingItems.take(m_bench->optics(i));
+	m_opticsItems.erase(m_opticsItems.begin() + m_bench->nOptics(), m_opticsItems.end());
+	foreach (OpticsItem* opticsItem, remainingItems)
+	{
+		removeItem(opticsItem);
+		delete opticsItem;
+	}
 
 	for (int i = index + count - 1; i >= index; i--)
 		removeItem(m_beamItems.takeAt(i));
@@ -270,6 +300,8 @@ void OpticsScene::onOpticsBenchOpticsRemoved(int index, int count)
 		m_beamItems[index-1]->setNextBeam(m_bench->beam(index));
 		m_beamItems[index]->setPreviousBeam(m_bench->beam(index-1));
 	}
+
+	updateCavityBeam();
 }
 
 void OpticsScene::addFitPoint(double position, double radius, QRgb color)
@@ -72,6 +72,7 @@ protected:
 
 private:
 	void addFitPoint(double position, double radius, QRgb color);
+	void updateCavityBeam();
 
 private:
 	OpticsScene* m_otherScene;
@@ -80,9 +81,13 @@ private:
 	double m_opticsHeight;
 	bool m_scenesLocked;
 
+	// Items of the optics and beams, in the order of the bench
+	QList<OpticsItem*> m_opticsItems;
 	QList<BeamItem*> m_beamItems;
 	BeamItem* m_targetBeamItem;
 	BeamItem* m_cavityBeamItem;
+	// Copy of the eigen mode of the first cavity, placed on the bench
+	Beam m_cavityBeam;
 	QList<QGraphicsEllipseItem*> m_fitItems;
 };
 
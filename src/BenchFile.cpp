@@ -0,0 +1,497 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "BenchFile.h"
+#include "XmlReader.h"
+#include "OpticsBench.h"
+#include "GaussianFit.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <locale>
+#include <cstdlib>
+
+using namespace std;
+
+/////////////////////////////////////////////////
+// Coded names
+
+string opticsCodedName(OpticsType type)
+{
+	switch (type)
+	{
+		case CreateBeamType:      return "createBeam";
+		case LensType:            return "lens";
+		case ThickLensType:       return "thickLens";
+		case FlatMirrorType:      return "flatMirror";
+		case CurvedMirrorType:    return "curvedMirror";
+		case FlatInterfaceType:   return "flatInterface";
+		case CurvedInterfaceType: return "curvedInterface";
+		case DielectricSlabType:  return "dielectricSlab";
+		case ThermalLensType:     return "thermalLens";
+		case GenericABCDType:     return "genericABCD";
+		default:                  return "";
+	}
+}
+
+string orientationCodedName(Orientation orientation)
+{
+	switch (orientation)
+	{
+		case Horizontal:  return "horizontal";
+		case Vertical:    return "vertical";
+		case Ellipsoidal: return "ellipsoidal";
+		default:          return "spherical";
+	}
+}
+
+// Unknown or missing orientations are spherical, as in the Qt loader
+static Orientation codedOrientation(const string& name)
+{
+	for (int orientation = Spherical; orientation <= Ellipsoidal; orientation++)
+		if (orientationCodedName(Orientation(orientation)) == name)
+			return Orientation(orientation);
+
+	return Spherical;
+}
+
+// Numbers are always written with a dot, whatever the locale of the application
+static double toDouble(const string& text)
+{
+	istringstream stream(text);
+	stream.imbue(locale::classic());
+	double value = 0.;
+	stream >> value;
+	return value;
+}
+
+static int toInt(const string& text)
+{
+	return atoi(text.c_str());
+}
+
+// Set the property @p name of the optics types that have it. @return false if @p optics does not have the property
+static bool setTypedProperty(Optics* optics, const string& name, double value, Orientation orientation)
+{
+	Lens* lens = dynamic_cast<Lens*>(optics);
+	CurvedMirror* curvedMirror = dynamic_cast<CurvedMirror*>(optics);
+	Dielectric* dielectric = dynamic_cast<Dielectric*>(optics);
+	CurvedInterface* curvedInterface = dynamic_cast<CurvedInterface*>(optics);
+	GenericABCD* genericABCD = dynamic_cast<GenericABCD*>(optics);
+
+	if ((name == "focal") && lens)
+		lens->setFocal(value);
+	else if ((name == "curvatureRadius") && curvedMirror)
+		curvedMirror->setCurvatureRadius(value);
+	else if ((name == "indexRatio") && dielectric)
+		dielectric->setIndexRatio(value);
+	else if ((name == "surfaceRadius") && curvedInterface)
+		curvedInterface->setSurfaceRadius(value);
+	else if ((name == "A") && genericABCD)
+		genericABCD->setA(value, orientation);
+	else if ((name == "B") && genericABCD)
+		genericABCD->setB(value, orientation);
+	else if ((name == "C") && genericABCD)
+		genericABCD->setC(value, orientation);
+	else if ((name == "D") && genericABCD)
+		genericABCD->setD(value, orientation);
+	else
+		return false;
+
+	return true;
+}
+
+// Replace the content of @p bench by a copy of @p source
+static void copyBench(const OpticsBench& source, OpticsBench& bench)
+{
+	// Propagate the beams and notify the listeners only once, when the whole bench is copied
+	OpticsBenchUpdate update(bench);
+	bench.clear();
+
+	bench.setWavelength(source.wavelength());
+	bench.setLeftBoundary(source.leftBoundary());
+	bench.setRightBoundary(source.rightBoundary());
+	bench.setTargetBeam(*source.targetBeam());
+	bench.setTargetOverlap(source.targetOverlap());
+	bench.setTargetOrientation(source.targetOrientation());
+
+	for (int i = 0; i < source.nFit(); i++)
+	{
+		const Fit* sourceFit = source.fit(i);
+		Fit* fit = bench.addFit(bench.nFit());
+		fit->setName(sourceFit->name());
+		fit->setDataType(sourceFit->dataType());
+		fit->setColor(sourceFit->color());
+		fit->setOrientation(sourceFit->orientation());
+		for (int d = 0; d < sourceFit->size(); d++)
+		{
+			const double position = sourceFit->position(d);
+			if (fit->orientation() == Spherical)
+				fit->addData(position, sourceFit->value(d, Spherical), Spherical);
+			else if (fit->orientation() == Vertical)
+				fit->addData(position, sourceFit->value(d, Vertical), Vertical);
+			else
+			{
+				fit->addData(position, sourceFit->value(d, Horizontal), Horizontal);
+				if (fit->orientation() == Ellipsoidal)
+					fit->setData(fit->size() - 1, position, sourceFit->value(d, Vertical), Vertical);
+			}
+		}
+	}
+
+	// Clones are detached from the lock tree: rebuild it
+	map<const Optics*, Optics*> clones;
+	for (int i = 0; i < source.nOptics(); i++)
+	{
+		Optics* optics = source.optics(i)->clone();
+		clones[source.optics(i)] = optics;
+		bench.addOptics(optics, bench.nOptics());
+	}
+	for (map<const Optics*, Optics*>::const_iterator it = clones.begin(); it != clones.end(); it++)
+		if (it->first->relativeLockParent())
+			it->second->relativeLockTo(clones[it->first->relativeLockParent()]);
+}
+
+/////////////////////////////////////////////////
+// BenchFileReader
+
+const char* BenchFileReader::currentVersion = "1.2";
+
+BenchFileReader::BenchFileReader(OpticsBench* bench)
+	: m_bench(bench)
+	, m_parsedBench(0)
+{
+}
+
+bool BenchFileReader::read(const string& fileName)
+{
+	ifstream file(fileName.c_str(), ios::in | ios::binary);
+	if (!file)
+	{
+		m_errorString = "Cannot read file " + fileName;
+		return false;
+	}
+
+	return read(file);
+}
+
+bool BenchFileReader::read(istream& stream)
+{
+	return read(stream, true);
+}
+
+bool BenchFileReader::read(istream& stream, bool allowConversion)
+{
+	XmlReader xml(stream);
+
+	if (!xml.readNextStartElement())
+	{
+		m_errorString = xml.hasError() ? xml.errorString() : "Empty document";
+		return false;
+	}
+
+	if (xml.name() != "gaussianBeam")
+	{
+		m_errorString = "The file is not an GaussianBeam file.";
+		return false;
+	}
+
+	if (!xml.hasAttribute("version"))
+	{
+		m_errorString = "This file does not contain any version information.";
+		return false;
+	}
+
+	// Only the root element has been read so far: older files are read again from the start once converted
+	const string version = xml.attribute("version");
+	if (version != currentVersion)
+	{
+		m_errorString = "Unsupported file version " + version;
+		if (!allowConversion)
+			return false;
+
+		stream.clear();
+		if (!stream.seekg(0))
+			return false;
+		stringstream data;
+		data << stream.rdbuf();
+		string convertedData = data.str();
+		if (!convert(convertedData, version))
+			return false;
+
+		stringstream convertedStream(convertedData);
+		return read(convertedStream, false);
+	}
+
+	OpticsBench parsedBench;
+	m_parsedBench = &parsedBench;
+
+	while (xml.readNextStartElement())
+	{
+		if (xml.name() == "bench")
+			parseBench(xml);
+		else if (xml.name() == "view")
+			parseView(xml);
+		else
+		{
+			cerr << " -> Unknown tag: " << xml.name() << endl;
+			xml.skipCurrentElement();
+		}
+	}
+
+	m_parsedBench = 0;
+	if (xml.hasError())
+	{
+		m_errorString = xml.errorString();
+		return false;
+	}
+
+	copyBench(parsedBench, *m_bench);
+
+	return true;
+}
+
+bool BenchFileReader::convert(string& /*data*/, const string& /*version*/)
+{
+	return false;
+}
+
+void BenchFileReader::parseView(XmlReader& xml)
+{
+	xml.skipCurrentElement();
+}
+
+void BenchFileReader::parseBench(XmlReader& xml)
+{
+	while (xml.readNextStartElement())
+	{
+		if (xml.name() == "wavelength")
+			m_parsedBench->setWavelength(toDouble(xml.readElementText()));
+		else if (xml.name() == "leftBoundary")
+			m_parsedBench->setLeftBoundary(toDouble(xml.readElementText()));
+		else if (xml.name() == "rightBoundary")
+			m_parsedBench->setRightBoundary(toDouble(xml.readElementText()));
+		else if (xml.name() == "targetBeam")
+			parseTargetBeam(xml);
+		else if (xml.name() == "beamFit")
+			parseFit(xml);
+		else if (xml.name() == "opticsList")
+		{
+			map<int, Optics*> opticsList; // Key = id
+			map<int, int> lockTree;       // Key = child id, value = parent id
+
+			while (xml.readNextStartElement())
+				parseOptics(xml, opticsList, lockTree);
+
+			for (map<int, int>::const_iterator it = lockTree.begin(); it != lockTree.end(); it++)
+			{
+				map<int, Optics*>::const_iterator child  = opticsList.find(it->first);
+				map<int, Optics*>::const_iterator parent = opticsList.find(it->second);
+				if ((child != opticsList.end()) && (parent != opticsList.end()))
+					child->second->relativeLockTo(parent->second);
+			}
+		}
+		else
+		{
+			cerr << " -> Unknown tag: " << xml.name() << endl;
+			xml.skipCurrentElement();
+		}
+	}
+}
+
+void BenchFileReader::parseTargetBeam(XmlReader& xml)
+{
+	Beam targetBeam = *m_parsedBench->targetBeam();
+	parseBeam(xml, targetBeam);
+	m_parsedBench->setTargetBeam(targetBeam);
+}
+
+void BenchFileReader::parseBeam(XmlReader& xml, Beam& beam)
+{
+	while (xml.readNextStartElement())
+	{
+		if (xml.name() == "waist")
+		{
+			Orientation orientation = codedOrientation(xml.attribute("orientation"));
+			beam.setWaist(toDouble(xml.readElementText()), orientation);
+		}
+		else if (xml.name() == "waistPosition")
+		{
+			Orientation orientation = codedOrientation(xml.attribute("orientation"));
+			beam.setWaistPosition(toDouble(xml.readElementText()), orientation);
+		}
+		else if (xml.name() == "wavelength")
+			beam.setWavelength(toDouble(xml.readElementText()));
+		else if (xml.name() == "index")
+			beam.setIndex(toDouble(xml.readElementText()));
+		else if (xml.name() == "M2")
+			beam.setM2(toDouble(xml.readElementText()));
+		// The next tags are specific to target beams
+		else if ((xml.name() == "targetOverlap") || (xml.name() == "minOverlap"))
+			m_parsedBench->setTargetOverlap(toDouble(xml.readElementText()));
+		else if (xml.name() == "targetOrientation")
+			m_parsedBench->setTargetOrientation(Orientation(toInt(xml.readElementText())));
+		else
+		{
+			cerr << " -> Unknown tag in parseBeam: " << xml.name() << endl;
+			xml.skipCurrentElement();
+		}
+	}
+}
+
+void BenchFileReader::parseFit(XmlReader& xml)
+{
+	Fit* fit = m_parsedBench->addFit(m_parsedBench->nFit());
+
+	while (xml.readNextStartElement())
+	{
+		if (xml.name() == "name")
+			fit->setName(xml.readElementText());
+		else if (xml.name() == "dataType")
+			fit->setDataType(FitDataType(toInt(xml.readElementText())));
+		else if (xml.name() == "color")
+			fit->setColor(strtoul(xml.readElementText().c_str(), 0, 10));
+		else if (xml.name() == "orientation")
+			fit->setOrientation(codedOrientation(xml.readElementText()));
+		else if (xml.name() == "data")
+		{
+			double position = 0.;
+			bool added = false;
+			while (xml.readNextStartElement())
+			{
+				if (xml.name() == "position")
+					position = toDouble(xml.readElementText());
+				else if (xml.name() == "value")
+				{
+					Orientation orientation = codedOrientation(xml.attribute("orientation"));
+					double value = toDouble(xml.readElementText());
+					if (added)
+						fit->setData(fit->size() - 1, position, value, orientation);
+					else
+					{
+						fit->addData(position, value, orientation);
+						added = true;
+					}
+				}
+				else
+				{
+					cerr << " -> Unknown tag: " << xml.name() << endl;
+					xml.skipCurrentElement();
+				}
+			}
+		}
+		else
+		{
+			cerr << " -> Unknown tag: " << xml.name() << endl;
+			xml.skipCurrentElement();
+		}
+	}
+}
+
+void BenchFileReader::parseOptics(XmlReader& xml, map<int, Optics*>& opticsList, map<int, int>& lockTree)
+{
+	Optics* optics = 0;
+
+	if (xml.name() == opticsCodedName(CreateBeamType))
+		optics = new CreateBeam(1., 1., 1., "");
+	else if (xml.name() == opticsCodedName(LensType))
+		optics = new Lens(1., 1., "");
+	else if (xml.name() == opticsCodedName(FlatMirrorType))
+		optics = new FlatMirror(1., "");
+	else if (xml.name() == opticsCodedName(CurvedMirrorType))
+		optics = new CurvedMirror(1., 1., "");
+	else if (xml.name() == opticsCodedName(FlatInterfaceType))
+		optics = new FlatInterface(1., 1., "");
+	else if (xml.name() == opticsCodedName(CurvedInterfaceType))
+		optics = new CurvedInterface(1., 1., 1., "");
+	else if (xml.name() == opticsCodedName(DielectricSlabType))
+		optics = new DielectricSlab(1., 1., 1., "");
+	else if (xml.name() == opticsCodedName(GenericABCDType))
+		optics = new GenericABCD(1., 1., 1., 1., 1., 1., "");
+	else
+		cerr << " -> Unknown tag in parseOptics: " << xml.name() << endl;
+
+	if (!optics)
+	{
+		xml.skipCurrentElement();
+		return;
+	}
+
+	const string opticsName = xml.name();
+	int id = toInt(xml.attribute("id"));
+	string mismatch; // Property that the optics does not have
+
+	while (xml.readNextStartElement())
+	{
+		const string name = xml.name();
+		const Orientation orientation = codedOrientation(xml.attribute("orientation"));
+
+		if (name == "beam")
+		{
+			CreateBeam* createBeam = dynamic_cast<CreateBeam*>(optics);
+			if (!createBeam)
+			{
+				mismatch = name;
+				break;
+			}
+			Beam inputBeam;
+			parseBeam(xml, inputBeam);
+			createBeam->setBeam(inputBeam);
+			continue;
+		}
+
+		const string text = xml.readElementText();
+		if (name == "position")
+			optics->setPosition(toDouble(text), false);
+		else if (name == "angle")
+			optics->setAngle(toDouble(text));
+		else if (name == "orientation")
+			optics->setOrientation(codedOrientation(text));
+		else if (name == "name")
+			optics->setName(text);
+		else if (name == "absoluteLock")
+			optics->setAbsoluteLock(toInt(text) == 1 ? true : false);
+		else if (name == "relativeLockParent")
+			lockTree[id] = toInt(text);
+		else if (name == "width")
+			optics->setWidth(toDouble(text));
+		else if ((name == "focal") || (name == "curvatureRadius") || (name == "indexRatio") || (name == "surfaceRadius") ||
+		         (name == "A") || (name == "B") || (name == "C") || (name == "D"))
+		{
+			if (!setTypedProperty(optics, name, toDouble(text), orientation))
+			{
+				mismatch = name;
+				break;
+			}
+		}
+		else
+			cerr << " -> Unknown tag in parseOptics: " << name << endl;
+	}
+
+	// Properties that the optics does not have stop the reading
+	if (!mismatch.empty())
+	{
+		xml.raiseError("<" + mismatch + "> is not a property of <" + opticsName + ">");
+		delete optics;
+		return;
+	}
+
+	opticsList[id] = optics;
+	m_parsedBench->addOptics(optics, m_parsedBench->nOptics());
+}
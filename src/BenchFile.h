@@ -0,0 +1,89 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BENCHFILE_H
+#define BENCHFILE_H
+
+#include "GaussianBeam.h"
+#include "Optics.h"
+
+#include <istream>
+#include <string>
+#include <map>
+
+class OpticsBench;
+class XmlReader;
+
+/// @return the tag name of optics type @p type in GaussianBeam files
+std::string opticsCodedName(OpticsType type);
+/// @return the tag name of orientation @p orientation in GaussianBeam files
+std::string orientationCodedName(Orientation orientation);
+
+/**
+* Read the bench part of a GaussianBeam XML file (file version 1.2), as written
+* by GaussianBeamWindow::writeFile, without depending on Qt.
+* Files of the current version are read in a single pass, without loading the document.
+* Files from older versions are only read if a subclass reimplements convert().
+* The view part of the file is skipped, unless a subclass reimplements parseView().
+* The file is parsed into a temporary bench, and the bench is only replaced if the whole file is valid.
+*/
+class BenchFileReader
+{
+public:
+	/// Constructor. The file will be loaded into @p bench
+	BenchFileReader(OpticsBench* bench);
+	virtual ~BenchFileReader() {}
+
+public:
+	/// The file version read by this class
+	static const char* currentVersion;
+	/// Read the file @p fileName. @return true on success
+	bool read(const std::string& fileName);
+	/// Read a file from @p stream. @return true on success
+	bool read(std::istream& stream);
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+protected:
+	/**
+	* Convert the whole document @p data from file version @p version to currentVersion.
+	* This is only called for files that are not of the current version.
+	* By default, no conversion is available. @return true on success
+	*/
+	virtual bool convert(std::string& data, const std::string& version);
+	/// Parse a <view> element. By default, skip it
+	virtual void parseView(XmlReader& xml);
+
+private:
+	bool read(std::istream& stream, bool allowConversion);
+	void parseBench(XmlReader& xml);
+	void parseTargetBeam(XmlReader& xml);
+	void parseBeam(XmlReader& xml, Beam& beam);
+	void parseFit(XmlReader& xml);
+	void parseOptics(XmlReader& xml, std::map<int, Optics*>& opticsList, std::map<int, int>& lockTree);
+
+protected:
+	OpticsBench* m_bench;
+
+private:
+	// Bench receiving the parsed file, copied into m_bench once the file is read without error
+	OpticsBench* m_parsedBench;
+	std::string m_errorString;
+};
+
+#endif
@@ -0,0 +1,518 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "BinaryFile.h"
+#include "OpticsBench.h"
+#include "GaussianFit.h"
+
+#include <iostream>
+#include <cstring>
+#include <vector>
+#include <map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// The record layouts are part of the file format
+static_assert(sizeof(BeamRecord) == 12*8, "BeamRecord layout");
+static_assert(sizeof(BenchRecord) == 4*8 + sizeof(BeamRecord) + 8, "BenchRecord layout");
+static_assert(sizeof(OpticsRecord) == 3*8 + 11*8 + sizeof(BeamRecord), "OpticsRecord layout");
+static_assert(sizeof(FitRecord) == 4*8, "FitRecord layout");
+static_assert(sizeof(FitDataRecord) == 3*8, "FitDataRecord layout");
+static_assert(sizeof(BinaryFileHeader) == 3*8 + BinaryFileHeader::SectionCount*sizeof(SectionRecord), "BinaryFileHeader layout");
+
+static const char binaryMagic[8] = {'G', 'B', 'B', 'I', 'N', 'A', 'R', 'Y'};
+
+/////////////////////////////////////////////////
+// BeamRecord
+
+BeamRecord BeamRecord::fromBeam(const Beam& beam)
+{
+	BeamRecord record;
+	for (int o = 0; o < 2; o++)
+	{
+		const Orientation orientation = (o == 0) ? Horizontal : Vertical;
+		record.waist[o] = beam.waist(orientation);
+		record.waistPosition[o] = beam.waistPosition(orientation);
+	}
+	record.wavelength = beam.wavelength();
+	record.index = beam.index();
+	record.M2 = beam.M2();
+	record.origin[0] = beam.origin().x();
+	record.origin[1] = beam.origin().y();
+	record.angle = beam.angle();
+	record.start = beam.start();
+	record.stop = beam.stop();
+
+	return record;
+}
+
+Beam BeamRecord::toBeam() const
+{
+	Beam beam(waist[0], waistPosition[0], wavelength, index, M2);
+	beam.setWaist(waist[1], Vertical);
+	beam.setWaistPosition(waistPosition[1], Vertical);
+	beam.setOrigin(Utils::Point(origin[0], origin[1]));
+	beam.setAngle(angle);
+	beam.setStart(start);
+	beam.setStop(stop);
+
+	return beam;
+}
+
+/////////////////////////////////////////////////
+// BinaryFileWriter
+
+BinaryFileWriter::BinaryFileWriter()
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+BinaryFileWriter::~BinaryFileWriter()
+{
+	close();
+}
+
+bool BinaryFileWriter::fail(const string& error)
+{
+	m_errorString = error;
+	m_file.close();
+	return false;
+}
+
+bool BinaryFileWriter::writeSection(BinaryFileHeader::Section section, const void* data, uint64_t count, uint64_t recordSize)
+{
+	// Sections are aligned on 8 bytes
+	static const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	const uint64_t offset = m_file.tellp();
+	m_file.write(padding, (8 - offset%8)%8);
+
+	m_header.sections[section].offset = m_file.tellp();
+	m_header.sections[section].count = count;
+	m_header.sections[section].recordSize = recordSize;
+	if (count > 0)
+		m_file.write(static_cast<const char*>(data), count*recordSize);
+
+	return bool(m_file);
+}
+
+bool BinaryFileWriter::open(const string& fileName, const OpticsBench& bench)
+{
+	close();
+
+	m_file.open(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!m_file)
+		return fail("Cannot write file " + fileName);
+
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, binaryMagic, sizeof(binaryMagic));
+	m_header.version = BinaryFileHeader::currentVersion;
+	m_header.byteOrder = BinaryFileHeader::byteOrderMark;
+	m_header.layoutOptics = bench.nOptics();
+	// The header is written again by close(), with the number of layouts
+	m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+
+	string strings;
+
+	BenchRecord benchRecord;
+	memset(&benchRecord, 0, sizeof(benchRecord));
+	benchRecord.wavelength = bench.wavelength();
+	benchRecord.leftBoundary = bench.leftBoundary();
+	benchRecord.rightBoundary = bench.rightBoundary();
+	benchRecord.targetOverlap = bench.targetOverlap();
+	benchRecord.targetBeam = BeamRecord::fromBeam(*bench.targetBeam());
+	benchRecord.targetOrientation = bench.targetOrientation();
+
+	map<const Optics*, int> opticsIndex;
+	for (int i = 0; i < bench.nOptics(); i++)
+		opticsIndex[bench.optics(i)] = i;
+
+	vector<OpticsRecord> opticsRecords(bench.nOptics());
+	for (int i = 0; i < bench.nOptics(); i++)
+	{
+		const Optics* optics = bench.optics(i);
+		OpticsRecord& record = opticsRecords[i];
+		memset(&record, 0, sizeof(record));
+		record.type = optics->type();
+		record.orientation = optics->orientation();
+		record.absoluteLock = optics->absoluteLock() ? 1 : 0;
+		record.relativeLockParent = optics->relativeLockParent() ? opticsIndex[optics->relativeLockParent()] : -1;
+		record.nameOffset = strings.size();
+		record.nameSize = optics->name().size();
+		strings += optics->name();
+		record.position = optics->position();
+		record.width = optics->width();
+		record.angle = optics->angle();
+
+		if (optics->type() == CreateBeamType)
+			record.beam = BeamRecord::fromBeam(*dynamic_cast<const CreateBeam*>(optics)->beam());
+		else if (optics->type() == LensType)
+			record.parameters[0] = dynamic_cast<const Lens*>(optics)->focal();
+		else if (optics->type() == CurvedMirrorType)
+			record.parameters[0] = dynamic_cast<const CurvedMirror*>(optics)->curvatureRadius();
+		else if ((optics->type() == FlatInterfaceType) || (optics->type() == DielectricSlabType))
+			record.parameters[0] = dynamic_cast<const Dielectric*>(optics)->indexRatio();
+		else if (optics->type() == CurvedInterfaceType)
+		{
+			record.parameters[0] = dynamic_cast<const CurvedInterface*>(optics)->indexRatio();
+			record.parameters[1] = dynamic_cast<const CurvedInterface*>(optics)->surfaceRadius();
+		}
+		else if (optics->type() == GenericABCDType)
+		{
+			const GenericABCD* ABCDOptics = dynamic_cast<const GenericABCD*>(optics);
+			for (int o = 0; o < 2; o++)
+			{
+				const Orientation orientation = (o == 0) ? Horizontal : Vertical;
+				record.parameters[4*o    ] = ABCDOptics->A(orientation);
+				record.parameters[4*o + 1] = ABCDOptics->B(orientation);
+				record.parameters[4*o + 2] = ABCDOptics->C(orientation);
+				record.parameters[4*o + 3] = ABCDOptics->D(orientation);
+			}
+		}
+	}
+
+	vector<FitRecord> fitRecords(bench.nFit());
+	vector<FitDataRecord> fitDataRecords;
+	for (int i = 0; i < bench.nFit(); i++)
+	{
+		const Fit* fit = bench.fit(i);
+		FitRecord& record = fitRecords[i];
+		memset(&record, 0, sizeof(record));
+		record.nameOffset = strings.size();
+		record.nameSize = fit->name().size();
+		strings += fit->name();
+		record.dataType = fit->dataType();
+		record.color = fit->color();
+		record.orientation = fit->orientation();
+		record.dataCount = fit->size();
+		record.firstData = fitDataRecords.size();
+		for (int j = 0; j < fit->size(); j++)
+		{
+			FitDataRecord data;
+			data.position = fit->position(j);
+			data.value[0] = (fit->orientation() != Vertical) ? fit->value(j, fit->orientation() == Spherical ? Spherical : Horizontal) : 0.;
+			data.value[1] = (fit->orientation() == Spherical) ? data.value[0] :
+			                (fit->orientation() != Horizontal) ? fit->value(j, Vertical) : 0.;
+			fitDataRecords.push_back(data);
+		}
+	}
+
+	if (!writeSection(BinaryFileHeader::BenchSection, &benchRecord, 1, sizeof(BenchRecord)) ||
+	    !writeSection(BinaryFileHeader::OpticsSection, opticsRecords.data(), opticsRecords.size(), sizeof(OpticsRecord)) ||
+	    !writeSection(BinaryFileHeader::FitSection, fitRecords.data(), fitRecords.size(), sizeof(FitRecord)) ||
+	    !writeSection(BinaryFileHeader::FitDataSection, fitDataRecords.data(), fitDataRecords.size(), sizeof(FitDataRecord)) ||
+	    !writeSection(BinaryFileHeader::StringSection, strings.data(), strings.size(), 1) ||
+	    !writeSection(BinaryFileHeader::LayoutSection, 0, 0, (1 + bench.nOptics())*sizeof(double) + bench.nOptics()*sizeof(BeamRecord)))
+		return fail("Cannot write file " + fileName);
+
+	return true;
+}
+
+bool BinaryFileWriter::addLayout(const OpticsBench& bench, double value)
+{
+	if (uint32_t(bench.nOptics()) != m_header.layoutOptics)
+		return fail("The layout does not match the bench of the file");
+
+	vector<double> positions(bench.nOptics());
+	vector<BeamRecord> beams(bench.nOptics());
+	for (int i = 0; i < bench.nOptics(); i++)
+	{
+		positions[i] = bench.optics(i)->position();
+		beams[i] = BeamRecord::fromBeam(*bench.beam(i));
+	}
+
+	return addLayout(positions.data(), beams.data(), value);
+}
+
+bool BinaryFileWriter::addLayout(const double* positions, const BeamRecord* beams, double value)
+{
+	if (!m_file.is_open())
+		return false;
+
+	// Layouts are the last section: they are appended at the end of the file
+	m_file.write(reinterpret_cast<const char*>(&value), sizeof(double));
+	m_file.write(reinterpret_cast<const char*>(positions), m_header.layoutOptics*sizeof(double));
+	m_file.write(reinterpret_cast<const char*>(beams), m_header.layoutOptics*sizeof(BeamRecord));
+	if (!m_file)
+		return fail("Cannot write layout");
+
+	m_header.sections[BinaryFileHeader::LayoutSection].count++;
+	return true;
+}
+
+bool BinaryFileWriter::close()
+{
+	if (!m_file.is_open())
+		return false;
+
+	m_file.seekp(0);
+	m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+	m_file.close();
+	if (!m_file)
+		return fail("Cannot write file header");
+
+	return true;
+}
+
+/////////////////////////////////////////////////
+// BinaryFileReader
+
+BinaryFileReader::BinaryFileReader()
+	: m_data(0)
+	, m_size(0)
+	, m_mapping(0)
+{
+}
+
+BinaryFileReader::~BinaryFileReader()
+{
+	close();
+}
+
+bool BinaryFileReader::fail(const string& error)
+{
+	close();
+	m_errorString = error;
+	return false;
+}
+
+bool BinaryFileReader::open(const string& fileName)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return fail("Cannot read file " + fileName);
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && (size.QuadPart > 0))
+	{
+		m_mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if (m_mapping)
+			m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		m_size = size.QuadPart;
+	}
+	CloseHandle(file);
+#else
+	int file = ::open(fileName.c_str(), O_RDONLY);
+	if (file < 0)
+		return fail("Cannot read file " + fileName);
+	struct stat status;
+	if ((fstat(file, &status) == 0) && (status.st_size > 0))
+	{
+		void* data = mmap(0, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+		if (data != MAP_FAILED)
+			m_data = static_cast<const char*>(data);
+		m_size = status.st_size;
+	}
+	::close(file);
+#endif
+
+	if (!m_data)
+		return fail("Cannot map file " + fileName);
+
+	// Check the header and the bounds of the sections, so that the records can then be accessed without checks
+	if (m_size < sizeof(BinaryFileHeader))
+		return fail("The file is not a binary GaussianBeam file.");
+	const BinaryFileHeader* header = reinterpret_cast<const BinaryFileHeader*>(m_data);
+	if (memcmp(header->magic, binaryMagic, sizeof(binaryMagic)) != 0)
+		return fail("The file is not a binary GaussianBeam file.");
+	if (header->byteOrder != BinaryFileHeader::byteOrderMark)
+		return fail("The file was written on a computer with a different byte order.");
+	if (header->version != BinaryFileHeader::currentVersion)
+		return fail("Unsupported binary file version");
+
+	const uint64_t recordSize[BinaryFileHeader::SectionCount] = {sizeof(BenchRecord), sizeof(OpticsRecord), sizeof(FitRecord),
+		sizeof(FitDataRecord), 1, (1 + header->layoutOptics)*sizeof(double) + header->layoutOptics*sizeof(BeamRecord)};
+	for (int i = 0; i < BinaryFileHeader::SectionCount; i++)
+	{
+		const SectionRecord& section = header->sections[i];
+		if ((section.recordSize != recordSize[i]) || (section.offset%8 != 0) || (section.offset > m_size) ||
+		    (section.count > (m_size - section.offset)/section.recordSize))
+			return fail("The binary file is corrupted.");
+	}
+	if ((header->sections[BinaryFileHeader::BenchSection].count != 1) ||
+	    (header->sections[BinaryFileHeader::OpticsSection].count != header->layoutOptics))
+		return fail("The binary file is corrupted.");
+
+	return true;
+}
+
+void BinaryFileReader::close()
+{
+	if (m_data)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	}
+#ifdef _WIN32
+	if (m_mapping)
+		CloseHandle(m_mapping);
+#endif
+
+	m_data = 0;
+	m_size = 0;
+	m_mapping = 0;
+}
+
+RecordSpan<FitDataRecord> BinaryFileReader::fitData(const FitRecord& fit) const
+{
+	RecordSpan<FitDataRecord> data = section<FitDataRecord>(BinaryFileHeader::FitDataSection);
+	if ((fit.firstData > data.size()) || (fit.dataCount > data.size() - fit.firstData))
+		return RecordSpan<FitDataRecord>();
+
+	return RecordSpan<FitDataRecord>(data.data() + fit.firstData, fit.dataCount);
+}
+
+string BinaryFileReader::text(uint32_t offset, uint32_t size) const
+{
+	RecordSpan<char> strings = section<char>(BinaryFileHeader::StringSection);
+	if ((offset > strings.size()) || (size > strings.size() - offset))
+		return std::string();
+
+	return std::string(strings.data() + offset, size);
+}
+
+size_t BinaryFileReader::nLayouts() const
+{
+	return reinterpret_cast<const BinaryFileHeader*>(m_data)->sections[BinaryFileHeader::LayoutSection].count;
+}
+
+const double* BinaryFileReader::layoutData(size_t layout) const
+{
+	const SectionRecord& section = reinterpret_cast<const BinaryFileHeader*>(m_data)->sections[BinaryFileHeader::LayoutSection];
+	return reinterpret_cast<const double*>(m_data + section.offset + layout*section.recordSize);
+}
+
+RecordSpan<double> BinaryFileReader::layoutPositions(size_t layout) const
+{
+	return RecordSpan<double>(layoutData(layout) + 1, optics().size());
+}
+
+RecordSpan<BeamRecord> BinaryFileReader::layoutBeams(size_t layout) const
+{
+	return RecordSpan<BeamRecord>(reinterpret_cast<const BeamRecord*>(layoutData(layout) + 1 + optics().size()), optics().size());
+}
+
+void BinaryFileReader::readBench(OpticsBench& bench) const
+{
+	OpticsBenchUpdate update(bench);
+	bench.clear();
+
+	const BenchRecord& benchRecord = this->bench();
+	bench.setWavelength(benchRecord.wavelength);
+	bench.setLeftBoundary(benchRecord.leftBoundary);
+	bench.setRightBoundary(benchRecord.rightBoundary);
+	bench.setTargetBeam(benchRecord.targetBeam.toBeam());
+	bench.setTargetOverlap(benchRecord.targetOverlap);
+	bench.setTargetOrientation(Orientation(benchRecord.targetOrientation));
+
+	for (const FitRecord* it = fits().begin(); it != fits().end(); it++)
+	{
+		Fit* fit = bench.addFit(bench.nFit());
+		fit->setName(text(it->nameOffset, it->nameSize));
+		fit->setDataType(FitDataType(it->dataType));
+		fit->setColor(it->color);
+		fit->setOrientation(Orientation(it->orientation));
+		RecordSpan<FitDataRecord> data = fitData(*it);
+		for (const FitDataRecord* dit = data.begin(); dit != data.end(); dit++)
+		{
+			if (fit->orientation() == Spherical)
+				fit->addData(dit->position, dit->value[0], Spherical);
+			else if (fit->orientation() == Vertical)
+				fit->addData(dit->position, dit->value[1], Vertical);
+			else
+			{
+				fit->addData(dit->position, dit->value[0], Horizontal);
+				if (fit->orientation() == Ellipsoidal)
+					fit->setData(fit->size() - 1, dit->position, dit->value[1], Vertical);
+			}
+		}
+	}
+
+	// Optics of unknown types are skipped, as in BenchFileReader
+	vector<Optics*> opticsList(optics().size(), 0);
+	for (size_t i = 0; i < optics().size(); i++)
+	{
+		const OpticsRecord& record = optics()[i];
+		Optics* optics = 0;
+
+		if (record.type == CreateBeamType)
+			optics = new CreateBeam(1., 1., 1., "");
+		else if (record.type == LensType)
+			optics = new Lens(record.parameters[0], 1., "");
+		else if (record.type == FlatMirrorType)
+			optics = new FlatMirror(1., "");
+		else if (record.type == CurvedMirrorType)
+			optics = new CurvedMirror(record.parameters[0], 1., "");
+		else if (record.type == FlatInterfaceType)
+			optics = new FlatInterface(record.parameters[0], 1., "");
+		else if (record.type == CurvedInterfaceType)
+			optics = new CurvedInterface(record.parameters[1], record.parameters[0], 1., "");
+		else if (record.type == DielectricSlabType)
+			optics = new DielectricSlab(record.parameters[0], record.width, 1., "");
+		else if (record.type == GenericABCDType)
+			optics = new GenericABCD(1., 1., 1., 1., record.width, 1., "");
+		else
+		{
+			cerr << " -> Unknown optics type in binary file: " << record.type << endl;
+			continue;
+		}
+
+		optics->setPosition(record.position, false);
+		optics->setAngle(record.angle);
+		optics->setOrientation(Orientation(record.orientation));
+		optics->setName(text(record.nameOffset, record.nameSize));
+		optics->setAbsoluteLock(record.absoluteLock != 0);
+		optics->setWidth(record.width);
+		if (record.type == CreateBeamType)
+			dynamic_cast<CreateBeam*>(optics)->setBeam(record.beam.toBeam());
+		else if (record.type == GenericABCDType)
+		{
+			GenericABCD* ABCDOptics = dynamic_cast<GenericABCD*>(optics);
+			if (optics->orientation() == Spherical)
+				ABCDOptics->setABCD(record.parameters[0], record.parameters[1], record.parameters[2], record.parameters[3], Spherical);
+			else
+			{
+				ABCDOptics->setABCD(record.parameters[0], record.parameters[1], record.parameters[2], record.parameters[3], Horizontal);
+				ABCDOptics->setABCD(record.parameters[4], record.parameters[5], record.parameters[6], record.parameters[7], Vertical);
+			}
+		}
+
+		opticsList[i] = optics;
+		bench.addOptics(optics, bench.nOptics());
+	}
+
+	for (size_t i = 0; i < opticsList.size(); i++)
+	{
+		const int parent = optics()[i].relativeLockParent;
+		if (opticsList[i] && (parent >= 0) && (size_t(parent) < opticsList.size()) && opticsList[parent])
+			opticsList[i]->relativeLockTo(opticsList[parent]);
+	}
+}
@@ -0,0 +1,249 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef BINARYFILE_H
+#define BINARYFILE_H
+
+#include "GaussianBeam.h"
+
+#include <fstream>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+class OpticsBench;
+
+/**
+* Binary GaussianBeam files store a bench and a list of layouts of this bench, such as the
+* results of an optimization or of a parameter sweep. A layout is the position of each optics,
+* the beam after each optics, and a value, for instance the overlap with the target beam.
+*
+* The file is a header followed by sections of fixed size records, aligned on 8 bytes.
+* Records are stored in the byte order of the writer: the reader rejects files with another byte order.
+* Files are memory mapped by BinaryFileReader, which gives a direct access to the records.
+* The layout of the structures of this file is part of the file format: when changing them,
+* increase BinaryFileHeader::currentVersion.
+*/
+
+/// Gaussian beam record. Index 0 of the arrays is the horizontal orientation, index 1 the vertical one
+struct BeamRecord
+{
+	double waist[2];
+	double waistPosition[2];
+	double wavelength;
+	double index;
+	double M2;
+	double origin[2];
+	double angle;
+	double start;
+	double stop;
+
+	/// Build the record of @p beam
+	static BeamRecord fromBeam(const Beam& beam);
+	/// @return the beam of this record
+	Beam toBeam() const;
+};
+
+/// Bench properties record
+struct BenchRecord
+{
+	double wavelength;
+	double leftBoundary;
+	double rightBoundary;
+	double targetOverlap;
+	BeamRecord targetBeam;
+	int32_t targetOrientation;
+	int32_t reserved;
+};
+
+/**
+* Optics record. The meaning of @p parameters depends on the optics type:
+* - lens: focal
+* - curved mirror: curvature radius
+* - flat interface and dielectric slab: index ratio
+* - curved interface: index ratio, surface radius
+* - generic ABCD: A, B, C, D for the horizontal orientation, then for the vertical orientation
+*/
+struct OpticsRecord
+{
+	int32_t type;
+	int32_t orientation;
+	int32_t absoluteLock;
+	int32_t relativeLockParent; ///< Index of the parent optics, or -1
+	uint32_t nameOffset;        ///< Offset of the name in the string section
+	uint32_t nameSize;
+	double position;
+	double width;
+	double angle;
+	double parameters[8];
+	BeamRecord beam;            ///< Beam created by CreateBeam optics
+};
+
+/// Fit record
+struct FitRecord
+{
+	uint32_t nameOffset;
+	uint32_t nameSize;
+	int32_t dataType;
+	uint32_t color;
+	int32_t orientation;
+	uint32_t dataCount;
+	uint64_t firstData;         ///< Index of the first data of the fit in the fit data section
+};
+
+/// Fit data record. Only the values of the fit orientations are relevant
+struct FitDataRecord
+{
+	double position;
+	double value[2];
+};
+
+/// Section of a binary file
+struct SectionRecord
+{
+	uint64_t offset;            ///< Offset of the first record from the start of the file
+	uint64_t count;             ///< Number of records
+	uint64_t recordSize;
+};
+
+/// Header of a binary file
+struct BinaryFileHeader
+{
+	enum Section {BenchSection, OpticsSection, FitSection, FitDataSection, StringSection, LayoutSection, SectionCount};
+	static const uint32_t currentVersion = 1;
+	static const uint32_t byteOrderMark = 0x01020304;
+
+	char magic[8];              ///< "GBBINARY"
+	uint32_t version;
+	uint32_t byteOrder;         ///< byteOrderMark, in the byte order of the writer
+	uint32_t layoutOptics;      ///< Number of optics of each layout
+	uint32_t reserved;
+	SectionRecord sections[SectionCount];
+};
+
+/// Read only view on @p size() contiguous records
+template<typename T> class RecordSpan
+{
+public:
+	RecordSpan(const T* data = 0, size_t size = 0) : m_data(data), m_size(size) {}
+
+public:
+	const T* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	const T& operator[](size_t index) const { return m_data[index]; }
+	const T* begin() const { return m_data; }
+	const T* end() const { return m_data + m_size; }
+
+private:
+	const T* m_data;
+	size_t m_size;
+};
+
+/**
+* Write a binary file: the bench is written when opening the file, and layouts are then
+* appended one by one, so that the number of layouts is not limited by memory.
+* The file is complete after close(), which is called by the destructor.
+*/
+class BinaryFileWriter
+{
+public:
+	BinaryFileWriter();
+	~BinaryFileWriter();
+
+public:
+	/// Create the file @p fileName and write @p bench into it. @return true on success
+	bool open(const std::string& fileName, const OpticsBench& bench);
+	/// Append the current optics positions and beams of the bench given to open(), with value @p value
+	bool addLayout(const OpticsBench& bench, double value);
+	/// Append a layout made of the positions and beams of each optics of the bench, with value @p value
+	bool addLayout(const double* positions, const BeamRecord* beams, double value);
+	/// Write the number of layouts and close the file. @return true on success
+	bool close();
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+private:
+	bool writeSection(BinaryFileHeader::Section section, const void* data, uint64_t count, uint64_t recordSize);
+	bool fail(const std::string& error);
+
+private:
+	std::ofstream m_file;
+	BinaryFileHeader m_header;
+	std::string m_errorString;
+};
+
+/**
+* Memory map a binary file and give direct access to its records, without copying nor parsing them.
+* The spans returned by this class are valid until the file is closed.
+*/
+class BinaryFileReader
+{
+public:
+	BinaryFileReader();
+	~BinaryFileReader();
+
+public:
+	/// Map the file @p fileName. @return true on success
+	bool open(const std::string& fileName);
+	/// Unmap the file
+	void close();
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+	/// @return the bench properties
+	const BenchRecord& bench() const { return *section<BenchRecord>(BinaryFileHeader::BenchSection).data(); }
+	/// @return the optics of the bench
+	RecordSpan<OpticsRecord> optics() const { return section<OpticsRecord>(BinaryFileHeader::OpticsSection); }
+	/// @return the fits of the bench
+	RecordSpan<FitRecord> fits() const { return section<FitRecord>(BinaryFileHeader::FitSection); }
+	/// @return the data of fit @p fit
+	RecordSpan<FitDataRecord> fitData(const FitRecord& fit) const;
+	/// @return the string at @p offset of size @p size in the string section, e.g. an optics name
+	std::string text(uint32_t offset, uint32_t size) const;
+	/// Populate @p bench with the bench of the file
+	void readBench(OpticsBench& bench) const;
+
+	/// @return the number of layouts
+	size_t nLayouts() const;
+	/// @return the value of layout @p layout
+	double layoutValue(size_t layout) const { return *layoutData(layout); }
+	/// @return the positions of the optics in layout @p layout
+	RecordSpan<double> layoutPositions(size_t layout) const;
+	/// @return the beams after each optics in layout @p layout
+	RecordSpan<BeamRecord> layoutBeams(size_t layout) const;
+
+private:
+	template<typename T> RecordSpan<T> section(BinaryFileHeader::Section index) const;
+	const double* layoutData(size_t layout) const;
+	bool fail(const std::string& error);
+
+private:
+	const char* m_data;
+	size_t m_size;
+	void* m_mapping;
+	std::string m_errorString;
+};
+
+template<typename T> RecordSpan<T> BinaryFileReader::section(BinaryFileHeader::Section index) const
+{
+	const SectionRecord& section = reinterpret_cast<const BinaryFileHeader*>(m_data)->sections[index];
+	return RecordSpan<T>(reinterpret_cast<const T*>(m_data + section.offset), section.count);
+}
+
+#endif
@@ -17,10 +17,9 @@
 */
 
 #include "Cavity.h"
-#include "OpticsBench.h"
 
-#include <iostream>
 #include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -28,103 +27,113 @@ Cavity::Cavity()
 {
 	m_closingFreeSpace = 0.;
 	m_dirty = true;
+	m_beamsWavelength = 0.;
 }
 
 void Cavity::addOptics(const ABCD* optics)
 {
 	if (!isOpticsInCavity(optics))
 	{
-		m_opticsList.push_back(optics);
+		m_optics.push_back(optics);
 		m_dirty = true;
 	}
 }
 
 void Cavity::removeOptics(const ABCD* optics)
 {
-	m_opticsList.remove(optics);
+	m_optics.erase(remove(m_optics.begin(), m_optics.end(), optics), m_optics.end());
 	m_dirty = true;
 }
 
 bool Cavity::isOpticsInCavity(const ABCD* optics) const
 {
-	if (find(m_opticsList.begin(), m_opticsList.end(), optics) != m_opticsList.end())
+	if (find(m_optics.begin(), m_optics.end(), optics) != m_optics.end())
 		return true;
 
 	return false;
 }
 
+void Cavity::setClosingFreeSpace(double closingFreeSpace)
+{
+	m_closingFreeSpace = closingFreeSpace;
+	m_dirty = true;
+}
+
 void Cavity::computeMatrix() const
 {
 	if (!m_dirty)
 		return;
 
-	/// @todo sort optics
-
-	// Compute cavity
+	m_dirty = false;
+	m_beams.clear();
 	m_matrix = FreeSpace(0., 0.);
-	list<const ABCD*>::const_iterator lastIt = m_opticsList.end();
-	for (list<const ABCD*>::const_iterator it = m_opticsList.begin(); it != m_opticsList.end(); lastIt = it++)
+	if (m_optics.empty())
+		return;
+
+	// Starting after the first optics, the beam goes through the free space between the optics
+	// and the following optics, the closing free space and the first optics. The matrix of the
+	// first element crossed is on the right.
+	m_matrix = *m_optics.front();
+	m_matrix *= FreeSpace(m_closingFreeSpace, m_optics.back()->endPosition());
+	for (int i = nOptics() - 1; i > 0; i--)
 	{
-		if (lastIt != m_opticsList.end())
-			m_matrix *= FreeSpace((*it)->position() - (*(lastIt))->endPosition(), (*lastIt)->endPosition());
-		cerr << " Cavity ABCD added free space = " << m_matrix << endl;
-		m_matrix *= *(*it);
-		cerr << " Cavity ABCD added optics = " << m_matrix << endl;
+		m_matrix *= *m_optics[i];
+		m_matrix *= FreeSpace(m_optics[i]->position() - m_optics[i-1]->endPosition(), m_optics[i-1]->endPosition());
 	}
-	// Free space that closes the cavity
-	if (lastIt != m_opticsList.end())
-		m_matrix *= FreeSpace(m_closingFreeSpace, (*lastIt)->endPosition());
-		cerr << " Cavity ABCD added last free space = " << m_matrix << endl;
+}
 
-	m_dirty = false;
+const GenericABCD& Cavity::roundTripMatrix() const
+{
+	computeMatrix();
+	return m_matrix;
 }
 
-double Cavity::delta() const
+double Cavity::delta(Orientation orientation) const
 {
 	computeMatrix();
-	return sqr(m_matrix.D(Spherical) - m_matrix.A(Spherical)) + 4.*m_matrix.B(Spherical)*m_matrix.C(Spherical);
+	return sqr(m_matrix.D(orientation) - m_matrix.A(orientation)) + 4.*m_matrix.B(orientation)*m_matrix.C(orientation);
 }
 
 bool Cavity::isStable() const
 {
-	if (m_opticsList.empty())
+	if (m_optics.empty())
 		return false;
 
 	computeMatrix();
 
-	/// @todo deal with orientation
-
-	// Stability criterion from I don't know where...
-	//return fabs((m_matrix.A(Spherical) + m_matrix.B(Spherical))/2.) < 1.;
-
 	// Stability criterion: stable if the eigen beam q parameter of
 	// the ABCD matrix has a non-zero imaginary part
-	cerr << "Delta = " << delta() << endl;
-	return delta() < 0.;
+	if (m_matrix.orientation() == Spherical)
+		return delta(Spherical) < 0.;
+
+	return (delta(Horizontal) < 0.) && (delta(Vertical) < 0.);
 }
 
 const Beam* Cavity::eigenBeam(double wavelength, int index) const
 {
-	computeMatrix();
-
-	/// @todo deal with orientation
-	/// @todo what is the index ?
+	if (!isStable() || (index < 0) || (index >= nOptics()))
+		return 0;
 
-	if (isStable() && (m_matrix.C(Spherical) != 0.))
-		m_beam = Beam(complex<double>(0.5*(m_matrix.A(Spherical) - m_matrix.D(Spherical))/m_matrix.C(Spherical),
-		              0.5*sqrt(-delta())/m_matrix.C(Spherical)),
-		              m_opticsList.front()->position(), wavelength, 1.0, 1.0);
-
-	/// @todo reimplement checks
-/*	if (!isStable() ||
-	   (index < m_firstCavityIndex) ||
-	   (m_ringCavity && (index >= m_lastCavityIndex)) ||
-	   (!m_ringCavity && (index > m_lastCavityIndex)))
-		return Beam();
-*/
-
-//	for (int i = m_firstCavityIndex; i <= index; i++)
-//		beam = m_bench.optics(i)->image(beam);
+	if (m_beams.empty() || (m_beamsWavelength != wavelength))
+	{
+		// q parameter after the first optics, fixed point of the round trip matrix
+		Beam beam(wavelength);
+		const double position = m_optics.front()->endPosition();
+		const Orientation orientations[2] = {Horizontal, Vertical};
+		const bool spherical = (m_matrix.orientation() == Spherical);
+		for (int o = 0; o < (spherical ? 1 : 2); o++)
+		{
+			const Orientation orientation = spherical ? Spherical : orientations[o];
+			const double C = m_matrix.C(orientation);
+			beam.setQ(complex<double>(0.5*(m_matrix.A(orientation) - m_matrix.D(orientation))/C,
+			                          0.5*sqrt(-delta(orientation))/fabs(C)), position, orientation);
+		}
+
+		m_beams.assign(1, beam);
+		for (int i = 1; i < nOptics(); i++)
+			m_beams.push_back(m_optics[i]->image(m_beams.back(), m_beams.back()));
+		m_beamsWavelength = wavelength;
+	}
 
-	return &m_beam;
+	return &m_beams[index];
 }
@@ -22,9 +22,12 @@
 #include "GaussianBeam.h"
 #include "Optics.h"
 
+#include <vector>
+
 /**
 * This class defines a cavity by a set of optics. It can
-* tell whether the cavity is stable or not and give the eigen modes
+* tell whether the cavity is stable or not and give the eigen modes.
+* The round trip matrix and the eigen modes are cached until the optics of the cavity change.
 */
 class Cavity
 {
@@ -33,20 +36,28 @@ public:
 	Cavity();
 
 public:
-	/// Add the optics @p optics to the cavity
+	/// Add the optics @p optics to the cavity, after the optics already in the cavity
 	void addOptics(const ABCD* optics);
 	/// Remove the optics @p optics from the cavity
 	void removeOptics(const ABCD* optics);
 	/// Check if a given optics is in the cavity
 	bool isOpticsInCavity(const ABCD* optics) const;
+	/// @return the number of optics in the cavity
+	int nOptics() const { return m_optics.size(); }
+	/// @return the optics of index @p index in the cavity
+	const ABCD* optics(int index) const { return m_optics[index]; }
 	/// @return the freespace interval that closes the cavity
 	double closingFreeSpace() const { return m_closingFreeSpace; }
 	/// Set the freespace interval that closes the cavity
-	void setClosingFreeSpace(double closingFreeSpace) { m_closingFreeSpace = closingFreeSpace; }
+	void setClosingFreeSpace(double closingFreeSpace);
+	/// Call this function after changing the properties of an optics of the cavity
+	void opticsChanged() { m_dirty = true; }
+	/// @return the round trip ABCD matrix, starting after the first optics of the cavity
+	const GenericABCD& roundTripMatrix() const;
 	/// @return true if there exist a Gaussian cavity eigen-mode
 	bool isStable() const;
 	/**
-	* @return the cavity eigen-mode
+	* @return the cavity eigen-mode, or 0 if the cavity is not stable
 	* @p wavelength wavelength of the eigen-mode
 	* @p index return the beam as it is after the @p index cavity optics
 	*/
@@ -54,15 +65,16 @@ public:
 
 private:
 	void computeMatrix() const;
-	double delta() const;
+	double delta(Orientation orientation) const;
 
 private:
-	std::list<const ABCD*> m_opticsList;
+	std::vector<const ABCD*> m_optics;
 	double m_closingFreeSpace;
 
 	mutable GenericABCD m_matrix;
-	mutable Beam m_beam;
 	mutable bool m_dirty;
+	mutable std::vector<Beam> m_beams;
+	mutable double m_beamsWavelength;
 };
 
 #endif
@@ -0,0 +1,633 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "CompiledBench.h"
+#include "Optics.h"
+#include "Interval.h"
+
+#include <algorithm>
+#include <map>
+#include <cmath>
+
+using namespace std;
+
+/////////////////////////////////////////////////
+// BeamState
+
+// Value of a scalar, for comparisons that do not need bounds nor derivatives
+static inline double scalarValue(double x) { return x; }
+static inline double scalarValue(const Jet& x) { return x.v; }
+static inline double scalarValue(const Interval& x) { return x.midpoint(); }
+
+// @return true if @p a and @p b are the same scalar, including derivatives and bounds
+static inline bool sameScalar(double a, double b) { return a == b; }
+static inline bool sameScalar(const Jet& a, const Jet& b) { return (a.v == b.v) && (a.d == b.d) && (a.dd == b.dd); }
+static inline bool sameScalar(const Interval& a, const Interval& b) { return (a.lower == b.lower) && (a.upper == b.upper); }
+
+template<typename T> BasicBeamState<T> BasicBeamState<T>::fromBeam(const Beam& beam)
+{
+	BasicBeamState state;
+	state.waistPosition[0] = T(beam.waistPosition(Horizontal));
+	state.waistPosition[1] = T(beam.waistPosition(Vertical));
+	state.rayleigh[0] = T(beam.rayleigh(Horizontal));
+	state.rayleigh[1] = T(beam.rayleigh(Vertical));
+	state.wavelength = beam.wavelength();
+	state.index = beam.index();
+	state.M2 = beam.M2();
+	state.spherical = beam.isSpherical();
+	return state;
+}
+
+template<typename T> Beam BasicBeamState<T>::toBeam() const
+{
+	Beam beam(wavelength);
+	beam.setIndex(index);
+	beam.setM2(M2);
+	if (spherical)
+	{
+		beam.setRayleigh(scalarValue(rayleigh[0]), Spherical);
+		beam.setWaistPosition(scalarValue(waistPosition[0]), Spherical);
+	}
+	else
+	{
+		beam.setRayleigh(scalarValue(rayleigh[0]), Horizontal);
+		beam.setRayleigh(scalarValue(rayleigh[1]), Vertical);
+		beam.setWaistPosition(scalarValue(waistPosition[0]), Horizontal);
+		beam.setWaistPosition(scalarValue(waistPosition[1]), Vertical);
+	}
+	return beam;
+}
+
+// @return @p state on the scalar type T
+template<typename T> static inline BasicBeamState<T> convertState(const BeamState& state)
+{
+	BasicBeamState<T> result;
+	for (int o = 0; o < 2; o++)
+	{
+		result.waistPosition[o] = T(state.waistPosition[o]);
+		result.rayleigh[o] = T(state.rayleigh[o]);
+	}
+	result.wavelength = state.wavelength;
+	result.index = state.index;
+	result.M2 = state.M2;
+	result.spherical = state.spherical;
+	return result;
+}
+
+// Overlap on a single orientation, at z = 0. @p scale is wavelength*M2/index:
+// the squared waist is rayleigh*scale/pi
+template<typename T> static inline T orientedOverlap(double waistPosition1, double rayleigh1, double scale1,
+                                                     const T& waistPosition2, const T& rayleigh2, double scale2)
+{
+	const double zred1 = -waistPosition1/rayleigh1;
+	const T zred2 = -waistPosition2/rayleigh2;
+	// Squared radii
+	const double radius1 = rayleigh1*scale1*(1. + zred1*zred1);
+	const T radius2 = rayleigh2*T(scale2)*(T(1.) + zred2*zred2);
+	const T rho = T(radius1)/radius2;
+	const T shift = T(zred1) - zred2*rho;
+
+	return T(4.)*rho/((T(1.) + rho)*(T(1.) + rho) + shift*shift);
+}
+
+template<typename T> static inline double overlapScale(const BasicBeamState<T>& beam)
+{
+	return beam.wavelength*beam.M2/beam.index;
+}
+
+template<typename T> T BasicBeamState<T>::overlap(const BasicBeamState<double>& beam1, const BasicBeamState& beam2)
+{
+	const double scale1 = overlapScale(beam1), scale2 = overlapScale(beam2);
+	const T overlap0 = orientedOverlap(beam1.waistPosition[0], beam1.rayleigh[0], scale1, beam2.waistPosition[0], beam2.rayleigh[0], scale2);
+	if (beam1.spherical && beam2.spherical)
+		return overlap0;
+
+	return sqrt(overlap0*orientedOverlap(beam1.waistPosition[1], beam1.rayleigh[1], scale1, beam2.waistPosition[1], beam2.rayleigh[1], scale2));
+}
+
+template struct BasicBeamState<double>;
+template struct BasicBeamState<float>;
+template struct BasicBeamState<Jet>;
+template struct BasicBeamState<Interval>;
+
+/////////////////////////////////////////////////
+// CompiledBench
+
+const int CompiledBench::batchSize;
+
+// Batched propagations select an AVX2 version of their lane loop at run time, where the platform supports it
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define BATCH_LANES __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_LANES
+#endif
+
+// Image (A*q + B)/(C*q + D) of the q parameter q = qr + i*qi.
+// Written on real numbers so that the scalar and batched propagations give the same results
+template<typename T> static inline void mobius(const T& A, const T& B, const T& C, const T& D, const T& qr, const T& qi, T& imageR, T& imageI)
+{
+	const T numR = A*qr + B, numI = A*qi;
+	const T denR = C*qr + D, denI = C*qi;
+	// A single division: it dominates the cost of the batched propagation
+	const T inverseNorm = T(1.)/(denR*denR + denI*denI);
+	imageR = (numR*denR + numI*denI)*inverseNorm;
+	imageI = (numI*denR - numR*denI)*inverseNorm;
+}
+
+CompiledBench::CompiledBench()
+	: m_valid(false)
+	, m_sphericalBench(true)
+{
+	m_initialState = BeamState::fromBeam(Beam());
+}
+
+void CompiledBench::compile(const vector<Optics*>& optics, double wavelength)
+{
+	const int n = optics.size();
+	m_valid = true;
+	m_initialState = BeamState::fromBeam(Beam(wavelength));
+
+	m_optics.resize(n);
+	m_position.resize(n);
+	m_lockGroup.resize(n);
+	m_groupAbsoluteLock.clear();
+
+	map<const Optics*, int> opticsIndex;
+	for (int i = 0; i < n; i++)
+		opticsIndex[optics[i]] = i;
+
+	map<const Optics*, int> groups; // Key = lock tree root
+	for (int i = 0; i < n; i++)
+	{
+		const Optics* current = optics[i];
+		m_position[i] = current->position();
+
+		// The lock group is the root of the relative lock tree
+		const Optics* root = current;
+		while (root->relativeLockParent() && opticsIndex.count(root->relativeLockParent()))
+			root = root->relativeLockParent();
+		map<const Optics*, int>::const_iterator group = groups.find(root);
+		if (group == groups.end())
+		{
+			group = groups.insert(make_pair(root, int(m_groupAbsoluteLock.size()))).first;
+			m_groupAbsoluteLock.push_back(root->absoluteLock());
+		}
+		m_lockGroup[i] = group->second;
+
+		compileOptics(i, current);
+	}
+	updateSpherical();
+}
+
+void CompiledBench::update(int index, const Optics* optics)
+{
+	compileOptics(index, optics);
+	updateSpherical();
+}
+
+void CompiledBench::compileOptics(int index, const Optics* optics)
+{
+	CompiledOptics& compiled = m_optics[index];
+	compiled.width = optics->width();
+	compiled.indexJump = optics->indexJump();
+	compiled.spherical = (optics->orientation() == Spherical);
+	compiled.kind = IdentityKind;
+	compiled.createdBeam = m_initialState;
+	for (int o = 0; o < 2; o++)
+	{
+		compiled.A[o] = 1.;
+		compiled.B[o] = 0.;
+		compiled.C[o] = 0.;
+		compiled.D[o] = 1.;
+	}
+
+	if (optics->type() == CreateBeamType)
+	{
+		compiled.kind = CreateBeamKind;
+		compiled.createdBeam = BeamState::fromBeam(optics->image(Beam(m_initialState.wavelength)));
+	}
+	else if (optics->isABCD())
+	{
+		// Mirrors let the beam through when they face away from it
+		const double angle = optics->angle();
+		if (((optics->type() == FlatMirrorType) || (optics->type() == CurvedMirrorType)) &&
+		    (angle > M_PI/2.) && (angle < 3.*M_PI/2.))
+			return;
+
+		const ABCD* abcd = dynamic_cast<const ABCD*>(optics);
+		compiled.kind = ABCDKind;
+		for (int o = 0; o < 2; o++)
+		{
+			const ABCD::Matrix& matrix = abcd->matrix(o == 0 ? Horizontal : Vertical);
+			compiled.A[o] = matrix.A;
+			compiled.B[o] = matrix.B;
+			compiled.C[o] = matrix.C;
+			compiled.D[o] = matrix.D;
+		}
+	}
+	else
+		m_valid = false;
+}
+
+void CompiledBench::updateSpherical()
+{
+	m_sphericalBench = m_initialState.spherical;
+	for (vector<CompiledOptics>::const_iterator it = m_optics.begin(); it != m_optics.end(); it++)
+		if (((it->kind == CreateBeamKind) && !it->createdBeam.spherical) || ((it->kind == ABCDKind) && !it->spherical))
+			m_sphericalBench = false;
+}
+
+void CompiledBench::initWorkspace(Workspace& workspace) const
+{
+	workspace.position.resize(size());
+	workspace.order.resize(size());
+	workspace.groupShift.resize(m_groupAbsoluteLock.size());
+	for (int i = 0; i < size(); i++)
+		workspace.order[i] = i;
+	workspace.direction.resize(size());
+	workspace.groupDriver.resize(m_groupAbsoluteLock.size());
+	workspace.linePosition.resize(size());
+}
+
+namespace
+{
+	struct PositionLess
+	{
+		PositionLess(const double* position) : m_position(position) {}
+		bool operator()(int i, int j) const
+		{
+			return (m_position[i] < m_position[j]) || ((m_position[i] == m_position[j]) && (i < j));
+		}
+		const double* m_position;
+	};
+}
+
+void CompiledBench::place(const double* x, int nx, bool checkLock, Workspace& workspace) const
+{
+	const int n = size();
+	nx = ::min(nx, n);
+	double* position = &workspace.position[0];
+
+	if (checkLock)
+	{
+		// Setting the position of an optics translates its whole lock tree: the tree
+		// ends up positioned by its last optics in @p x, unless the tree is absolutely locked
+		double* shift = &workspace.groupShift[0];
+		for (unsigned int g = 0; g < workspace.groupShift.size(); g++)
+			shift[g] = 0.;
+		for (int i = 0; i < nx; i++)
+			shift[m_lockGroup[i]] = x[i] - m_position[i];
+		for (int i = 0; i < n; i++)
+			position[i] = m_groupAbsoluteLock[m_lockGroup[i]] ? m_position[i] : m_position[i] + shift[m_lockGroup[i]];
+	}
+	else
+	{
+		for (int i = 0; i < nx; i++)
+			position[i] = x[i];
+		for (int i = nx; i < n; i++)
+			position[i] = m_position[i];
+	}
+
+	// The first optics stays first, as in OpticsBench. The previous order is a good guess for the new one
+	int* order = &workspace.order[0];
+	if (n > 1)
+	{
+		PositionLess less(position);
+		for (int i = 2; i < n; i++)
+		{
+			int value = order[i];
+			int j = i;
+			for (; (j > 1) && less(value, order[j-1]); j--)
+				order[j] = order[j-1];
+			order[j] = value;
+		}
+	}
+}
+
+template<typename T> BasicBeamState<T> CompiledBench::propagate(const Workspace& workspace, const T* positions,
+                                                                 const Perturbation& perturbation) const
+{
+	if (m_sphericalBench)
+		return propagateKernel<T, true>(workspace, positions, perturbation);
+	return propagateKernel<T, false>(workspace, positions, perturbation);
+}
+
+template<typename T, bool sphericalBench> BasicBeamState<T> CompiledBench::propagateKernel(const Workspace& workspace, const T* positions,
+                                                                                           const Perturbation& perturbation) const
+{
+	BasicBeamState<T> beam = convertState<T>(m_initialState);
+	beam.wavelength *= perturbation.wavelengthScale;
+	// The Rayleigh range of a beam of given waist is inversely proportional to the wavelength
+	const T rayleighScale = T(perturbation.waistScale*perturbation.waistScale/perturbation.wavelengthScale);
+
+	for (int k = 0; k < size(); k++)
+	{
+		const int i = workspace.order[k];
+		const CompiledOptics& optics = m_optics[i];
+
+		if (optics.kind == CreateBeamKind)
+		{
+			const double wavelength = beam.wavelength;
+			beam = convertState<T>(optics.createdBeam);
+			beam.wavelength = wavelength;
+			beam.rayleigh[0] = beam.rayleigh[0]*rayleighScale;
+			beam.rayleigh[1] = beam.rayleigh[1]*rayleighScale;
+			continue;
+		}
+		else if (optics.kind == IdentityKind)
+			continue;
+
+		// ABCD transformation of the q parameter, as in ABCD::image
+		const double powerScale = perturbation.powerScale ? perturbation.powerScale[i] : 1.;
+		const T position = positions[i];
+		const T stop = position + T(optics.width);
+		// Spherical benches only transform the horizontal orientation, copied to the vertical one at the end
+		const int nOrientation = (sphericalBench || (optics.spherical && beam.spherical)) ? 1 : 2;
+		beam.index *= optics.indexJump;
+		for (int o = 0; o < nOrientation; o++)
+		{
+			T imageR, imageI;
+			mobius(T(optics.A[o]), T(optics.B[o]), T(optics.C[o]*powerScale), T(optics.D[o]), position - beam.waistPosition[o], beam.rayleigh[o], imageR, imageI);
+			beam.waistPosition[o] = stop - imageR;
+			// As in Beam::setRayleigh, an invalid Rayleigh range keeps the waist, hence scales with the index
+			beam.rayleigh[o] = imageI > 0. ? imageI : beam.rayleigh[o]*T(optics.indexJump);
+		}
+		if (sphericalBench)
+			continue;
+		if (nOrientation == 1)
+		{
+			beam.waistPosition[1] = beam.waistPosition[0];
+			beam.rayleigh[1] = beam.rayleigh[0];
+		}
+		else
+			beam.spherical = sameScalar(beam.waistPosition[0], beam.waistPosition[1]) && sameScalar(beam.rayleigh[0], beam.rayleigh[1]);
+	}
+
+	if (sphericalBench)
+	{
+		beam.waistPosition[1] = beam.waistPosition[0];
+		beam.rayleigh[1] = beam.rayleigh[0];
+	}
+
+	return beam;
+}
+
+template BasicBeamState<double> CompiledBench::propagate(const Workspace&, const double*, const Perturbation&) const;
+template BasicBeamState<float> CompiledBench::propagate(const Workspace&, const float*, const Perturbation&) const;
+template BasicBeamState<Jet> CompiledBench::propagate(const Workspace&, const Jet*, const Perturbation&) const;
+template BasicBeamState<Interval> CompiledBench::propagate(const Workspace&, const Interval*, const Perturbation&) const;
+
+void CompiledBench::propagateBatch(const Workspace* workspaces, int n, BeamState* beams) const
+{
+	if (m_sphericalBench)
+		propagateBatchKernel<true>(workspaces, n, beams);
+	else
+		propagateBatchKernel<false>(workspaces, n, beams);
+}
+
+namespace
+{
+	/**
+	* Optics met by the lanes of a batched propagation at one step, gathered before the arithmetic.
+	* When all the lanes meet the same optics, its coefficients are only stored at index 0
+	*/
+	struct LaneStep
+	{
+		bool shared;
+		// Lanes that meet a created beam start again from it
+		int reset[CompiledBench::batchSize];
+		double resetWaistPosition[2][CompiledBench::batchSize], resetRayleigh[2][CompiledBench::batchSize];
+		// Lanes that do not meet an ABCD optics keep their beam. The other optics carry the identity matrix
+		int keep[CompiledBench::batchSize];
+		double A[2][CompiledBench::batchSize], B[2][CompiledBench::batchSize];
+		double C[2][CompiledBench::batchSize], D[2][CompiledBench::batchSize];
+		double width[CompiledBench::batchSize], jump[CompiledBench::batchSize];
+		// Position of the optics met by each lane
+		double position[CompiledBench::batchSize];
+	};
+
+	/// Number of steps gathered at once by propagateBatchKernel()
+	const int laneSteps = 16;
+}
+
+// Transform the q parameter of one lane of a batched propagation, as propagate() does
+static inline void transformLane(int reset, double resetWaistPosition, double resetRayleigh, int keep,
+                                 double A, double B, double C, double D, double position, double width, double jump,
+                                 double& waistPosition, double& rayleigh)
+{
+	// All the operands are loaded unconditionally, so that the selects become vector blends
+	const double oldWaistPosition = reset ? resetWaistPosition : waistPosition;
+	const double oldRayleigh = reset ? resetRayleigh : rayleigh;
+	double imageR, imageI;
+	mobius(A, B, C, D, position - oldWaistPosition, oldRayleigh, imageR, imageI);
+	const double stop = position + width;
+	const double newWaistPosition = stop - imageR;
+	// An invalid Rayleigh range keeps the waist
+	const double keptRayleigh = oldRayleigh*jump;
+	const double newRayleigh = imageI > 0. ? imageI : keptRayleigh;
+	waistPosition = keep ? oldWaistPosition : newWaistPosition;
+	rayleigh = keep ? oldRayleigh : newRayleigh;
+}
+
+// Transform the q parameters of the batchSize lanes by the @p nSteps steps of @p steps, for @p nOrientation orientations.
+// The lane loops have a fixed trip count and no branch, so that they are vectorized. They are also compiled for AVX2,
+// selected at run time where the platform supports it
+BATCH_LANES static void transformLanes(const LaneStep* steps, int nSteps, int nOrientation,
+                                       double waistPosition[2][CompiledBench::batchSize], double rayleigh[2][CompiledBench::batchSize])
+{
+	for (int k = 0; k < nSteps; k++)
+	{
+		const LaneStep& step = steps[k];
+		for (int o = 0; o < nOrientation; o++)
+		{
+			double* laneWaistPosition = waistPosition[o];
+			double* laneRayleigh = rayleigh[o];
+			if (step.shared)
+			{
+				#pragma omp simd
+				for (int j = 0; j < CompiledBench::batchSize; j++)
+					transformLane(step.reset[0], step.resetWaistPosition[o][0], step.resetRayleigh[o][0], step.keep[0],
+					              step.A[o][0], step.B[o][0], step.C[o][0], step.D[o][0], step.position[j], step.width[0], step.jump[0],
+					              laneWaistPosition[j], laneRayleigh[j]);
+			}
+			else
+			{
+				#pragma omp simd
+				for (int j = 0; j < CompiledBench::batchSize; j++)
+					transformLane(step.reset[j], step.resetWaistPosition[o][j], step.resetRayleigh[o][j], step.keep[j],
+					              step.A[o][j], step.B[o][j], step.C[o][j], step.D[o][j], step.position[j], step.width[j], step.jump[j],
+					              laneWaistPosition[j], laneRayleigh[j]);
+			}
+		}
+	}
+}
+
+template<bool sphericalBench> void CompiledBench::propagateBatchKernel(const Workspace* workspaces, int n, BeamState* beams) const
+{
+	// Spherical benches only transform the horizontal orientation
+	const int nOrientation = sphericalBench ? 1 : 2;
+	// Beam states, one lane per optics placement. Lanes beyond n repeat the first placement
+	double waistPosition[2][batchSize], rayleigh[2][batchSize], index[batchSize], M2[batchSize];
+	// The spherical flag is that of the last created beam, or is computed after the last ABCD optics
+	bool spherical[batchSize], sphericalFromState[batchSize];
+	const int* laneOrder[batchSize];
+	const double* lanePosition[batchSize];
+	int laneOptics[batchSize];
+	LaneStep steps[laneSteps];
+
+	n = ::min(n, int(batchSize));
+	for (int j = 0; j < batchSize; j++)
+	{
+		const Workspace& workspace = workspaces[j < n ? j : 0];
+		laneOrder[j] = &workspace.order[0];
+		lanePosition[j] = &workspace.position[0];
+		for (int o = 0; o < 2; o++)
+		{
+			waistPosition[o][j] = m_initialState.waistPosition[o];
+			rayleigh[o][j] = m_initialState.rayleigh[o];
+		}
+		index[j] = m_initialState.index;
+		M2[j] = m_initialState.M2;
+		spherical[j] = m_initialState.spherical;
+		sphericalFromState[j] = false;
+	}
+
+	for (int start = 0; start < size(); start += laneSteps)
+	{
+		// Gather the optics of each lane for the next steps
+		const int nSteps = ::min(size() - start, laneSteps);
+		for (int k = 0; k < nSteps; k++)
+		{
+			LaneStep& step = steps[k];
+			bool shared = true;
+			for (int j = 0; j < batchSize; j++)
+			{
+				const int i = laneOrder[j][start + k];
+				laneOptics[j] = i;
+				shared = shared && (i == laneOptics[0]);
+				step.position[j] = lanePosition[j][i];
+			}
+			step.shared = shared;
+
+			const int nCoefficients = shared ? 1 : batchSize;
+			for (int j = 0; j < nCoefficients; j++)
+			{
+				const CompiledOptics& optics = m_optics[laneOptics[j]];
+				step.reset[j] = optics.kind == CreateBeamKind;
+				step.keep[j] = optics.kind != ABCDKind;
+				for (int o = 0; o < nOrientation; o++)
+				{
+					step.resetWaistPosition[o][j] = optics.createdBeam.waistPosition[o];
+					step.resetRayleigh[o][j] = optics.createdBeam.rayleigh[o];
+					step.A[o][j] = optics.A[o];
+					step.B[o][j] = optics.B[o];
+					step.C[o][j] = optics.C[o];
+					step.D[o][j] = optics.D[o];
+				}
+				step.width[j] = optics.width;
+				step.jump[j] = step.keep[j] ? 1. : optics.indexJump;
+			}
+
+			// Properties that do not depend on the q parameter
+			if (shared && !step.reset[0])
+				for (int j = 0; j < batchSize; j++)
+				{
+					index[j] *= step.jump[0];
+					sphericalFromState[j] = sphericalFromState[j] || !step.keep[0];
+				}
+			else
+				for (int j = 0; j < batchSize; j++)
+				{
+					const int c = shared ? 0 : j;
+					if (step.reset[c])
+					{
+						const BeamState& created = m_optics[laneOptics[j]].createdBeam;
+						index[j] = created.index;
+						M2[j] = created.M2;
+						spherical[j] = created.spherical;
+					}
+					index[j] *= step.jump[c];
+					sphericalFromState[j] = step.reset[c] ? false : (sphericalFromState[j] || !step.keep[c]);
+				}
+		}
+
+		// On astigmatic benches, both orientations are always computed:
+		// for spherical optics and beams they are equal, as in the spherical shortcut of propagate()
+		transformLanes(steps, nSteps, nOrientation, waistPosition, rayleigh);
+	}
+
+	for (int j = 0; j < n; j++)
+	{
+		BeamState& beam = beams[j];
+		for (int o = 0; o < 2; o++)
+		{
+			beam.waistPosition[o] = waistPosition[sphericalBench ? 0 : o][j];
+			beam.rayleigh[o] = rayleigh[sphericalBench ? 0 : o][j];
+		}
+		beam.wavelength = m_initialState.wavelength;
+		beam.index = index[j];
+		beam.M2 = M2[j];
+		beam.spherical = (!sphericalBench && sphericalFromState[j]) ?
+			(waistPosition[0][j] == waistPosition[1][j]) && (rayleigh[0][j] == rayleigh[1][j]) : spherical[j];
+	}
+}
+
+Jet CompiledBench::overlapAlong(const BeamState& target, Workspace& workspace) const
+{
+	// Optics positions moving along workspace.direction
+	Jet* position = &workspace.linePosition[0];
+	for (int i = 0; i < size(); i++)
+		position[i] = Jet(workspace.position[i], workspace.direction[i]);
+
+	return BasicBeamState<Jet>::overlap(target, propagate(workspace, position));
+}
+
+void CompiledBench::overlapDerivatives(const BeamState& target, int nx, bool checkLock, Workspace& workspace,
+                                       double* gradient, double* curvature) const
+{
+	const int n = size();
+	nx = ::min(nx, n);
+	double* direction = &workspace.direction[0];
+
+	// With locks, the position of each group follows its last optics in x, as in place()
+	if (checkLock)
+	{
+		for (unsigned int g = 0; g < workspace.groupDriver.size(); g++)
+			workspace.groupDriver[g] = -1;
+		for (int i = 0; i < nx; i++)
+			workspace.groupDriver[m_lockGroup[i]] = i;
+	}
+
+	for (int variable = 0; variable < nx; variable++)
+	{
+		for (int i = 0; i < n; i++)
+			direction[i] = 0.;
+		if (!checkLock)
+			direction[variable] = 1.;
+		else if ((workspace.groupDriver[m_lockGroup[variable]] == variable) && !m_groupAbsoluteLock[m_lockGroup[variable]])
+			for (int i = 0; i < n; i++)
+				if (m_lockGroup[i] == m_lockGroup[variable])
+					direction[i] = 1.;
+
+		const Jet overlap = overlapAlong(target, workspace);
+		if (gradient)
+			gradient[variable] = overlap.d;
+		if (curvature)
+			curvature[variable] = overlap.dd;
+	}
+}
@@ -0,0 +1,201 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef COMPILEDBENCH_H
+#define COMPILEDBENCH_H
+
+#include "GaussianBeam.h"
+#include "Jet.h"
+
+#include <vector>
+
+class Optics;
+struct Interval;
+
+/**
+* Gaussian properties of a beam, as propagated by CompiledBench, on the scalar type T:
+* double, float for fast screening, Jet for exact derivatives or Interval for guaranteed bounds.
+* Index 0 of the arrays is the horizontal orientation, index 1 the vertical one.
+* Geometrical properties (origin, angle) are not tracked.
+*/
+template<typename T> struct BasicBeamState
+{
+	T waistPosition[2];
+	T rayleigh[2];
+	double wavelength;
+	double index;
+	double M2;
+	bool spherical;
+
+	/// Build the state of @p beam
+	static BasicBeamState fromBeam(const Beam& beam);
+	/// @return a beam with the Gaussian properties of this state, taking the midpoint of intervals
+	Beam toBeam() const;
+	/// Same as Beam::overlap(beam1, beam2) at z = 0, for two beam states
+	static T overlap(const BasicBeamState<double>& beam1, const BasicBeamState& beam2);
+};
+
+typedef BasicBeamState<double> BeamState;
+
+/**
+* Flat, contiguous representation of a set of optics, built once and then used to
+* propagate a beam through the optics for many different optics positions
+* without cloning optics nor allocating memory.
+* Propagation follows exactly Optics::image for all the optics of the core.
+* If the optics set contains an optics that can not be compiled (isValid() is false),
+* the caller has to fall back to propagating with Optics::image.
+*/
+class CompiledBench
+{
+public:
+	/// Type of transformation applied by a compiled optics
+	enum Kind {CreateBeamKind, ABCDKind, IdentityKind};
+
+	/// Number of optics placements propagated together by propagateBatch()
+	static const int batchSize = 8;
+
+	/// Scratch memory for placing and sorting optics. Use one workspace per thread
+	struct Workspace
+	{
+		std::vector<double> position;
+		std::vector<int> order;
+		std::vector<double> groupShift;
+		std::vector<double> direction;
+		std::vector<int> groupDriver;
+		std::vector<Jet> linePosition;
+	};
+
+	/// Perturbation of the compiled optics applied by propagate(). The default perturbation changes nothing
+	struct Perturbation
+	{
+		Perturbation() : powerScale(0), waistScale(1.), wavelengthScale(1.) {}
+
+		/// Scale of the C coefficient of each optics, i.e. inverse scale of the focal length of thin optics, or null
+		const double* powerScale;
+		/// Scale of the waist of the beams created by CreateBeam optics
+		double waistScale;
+		/// Scale of the wavelength. Created beams keep their waist
+		double wavelengthScale;
+	};
+
+public:
+	/// Constructor
+	CompiledBench();
+
+public:
+	/// Compile the optics set @p optics, propagating a beam of wavelength @p wavelength
+	void compile(const std::vector<Optics*>& optics, double wavelength);
+	/**
+	* Compile again optics @p index from @p optics, e.g. after changing its properties.
+	* The position and locks of the optics are not updated
+	*/
+	void update(int index, const Optics* optics);
+	/// @return true if all optics could be compiled
+	bool isValid() const { return m_valid; }
+	/**
+	* @return true if all the compiled optics and created beams are spherical. Propagations then only
+	* transform one orientation, with kernels instantiated for this case.
+	*/
+	bool isSpherical() const { return m_sphericalBench; }
+	/// @return the number of compiled optics
+	int size() const { return m_optics.size(); }
+	/// @return the position of optics @p index at compilation time
+	double position(int index) const { return m_position[index]; }
+	/// @return the width of optics @p index
+	double width(int index) const { return m_optics[index].width; }
+	/// @return the number of lock groups, i.e. of sets of optics that move together when place() respects locks
+	int nLockGroups() const { return m_groupAbsoluteLock.size(); }
+	/// @return the lock group of optics @p index
+	int lockGroup(int index) const { return m_lockGroup[index]; }
+	/// @return true if the optics of lock group @p group do not move when place() respects locks
+	bool isGroupAbsolutelyLocked(int group) const { return m_groupAbsoluteLock[group]; }
+	/// Allocate the memory of @p workspace. Later calls to place() and propagate() do not allocate
+	void initWorkspace(Workspace& workspace) const;
+	/**
+	* Move the optics to the @p nx positions of @p x, as Optics::setPosition would do,
+	* respecting absolute and relative locks if @p checkLock is true.
+	* The resulting positions and the sorted optics order are stored in @p workspace.
+	*/
+	void place(const double* x, int nx, bool checkLock, Workspace& workspace) const;
+	/// @return the beam after the last optics, for optics placed in @p workspace
+	BeamState propagate(const Workspace& workspace) const { return propagate(workspace, Perturbation()); }
+	/// @return the beam after the last optics, for optics placed in @p workspace and perturbed by @p perturbation
+	BeamState propagate(const Workspace& workspace, const Perturbation& perturbation) const
+		{ return propagate(workspace, &workspace.position[0], perturbation); }
+	/**
+	* @return the beam after the last optics, computed on the scalar type T, for optics sorted in @p workspace
+	* and placed at @p positions, one per optics. This single kernel serves all the propagations:
+	* double, float for fast screening, Jet for derivatives along a line, and Interval to bound the beam
+	* for positions known within tolerances. The optics order is that of @p workspace.
+	* It is instantiated for double, float, Jet and Interval.
+	*/
+	template<typename T> BasicBeamState<T> propagate(const Workspace& workspace, const T* positions,
+	                                                 const Perturbation& perturbation = Perturbation()) const;
+	/**
+	* Propagate @p n beams at once, for the optics placements stored in @p workspaces[0..n-1],
+	* with n <= batchSize, and store the resulting beams in @p beams[0..n-1].
+	* The optics met by each placement are gathered first, then the q parameters of all the placements
+	* are updated by vectorized loops over batchSize lanes. Placements that meet the optics in the same
+	* order share the coefficients of the optics, which makes the gather much cheaper: batches of
+	* nearby layouts propagate about twice as fast as single layouts, see test/benchCore.cpp.
+	* Results are identical to those of propagate().
+	*/
+	void propagateBatch(const Workspace* workspaces, int n, BeamState* beams) const;
+	/**
+	* Compute the first and second derivatives of the overlap between @p target and the beam after
+	* the last optics, with respect to each of the @p nx positions given to the last call to
+	* place(x, nx, checkLock, workspace). The derivatives are exact for the current optics order:
+	* they are obtained by propagating the derivatives of the q parameter through the ABCD matrices.
+	* @p gradient and @p curvature are arrays of @p nx elements, or null if not needed.
+	*/
+	void overlapDerivatives(const BeamState& target, int nx, bool checkLock, Workspace& workspace,
+	                        double* gradient, double* curvature) const;
+
+private:
+	void compileOptics(int index, const Optics* optics);
+	void updateSpherical();
+	template<typename T, bool sphericalBench> BasicBeamState<T> propagateKernel(const Workspace& workspace, const T* positions,
+	                                                                            const Perturbation& perturbation) const;
+	template<bool sphericalBench> void propagateBatchKernel(const Workspace* workspaces, int n, BeamState* beams) const;
+	Jet overlapAlong(const BeamState& target, Workspace& workspace) const;
+
+private:
+	// Transformation of one compiled optics. The coefficients used by a propagation step share a cache line
+	struct CompiledOptics
+	{
+		int kind;
+		bool spherical;
+		double width;
+		double indexJump;
+		double A[2], B[2], C[2], D[2];
+		BeamState createdBeam;
+	};
+
+private:
+	bool m_valid;
+	bool m_sphericalBench;
+	BeamState m_initialState;
+	// One entry per optics
+	std::vector<CompiledOptics> m_optics;
+	std::vector<double> m_position;
+	std::vector<int> m_lockGroup;
+	// One entry per lock group
+	std::vector<char> m_groupAbsoluteLock;
+};
+
+#endif
@@ -20,7 +20,6 @@
 #include "Utils.h"
 
 #include <cmath>
-#include <iostream>
 
 using namespace std;
 
@@ -28,21 +27,33 @@ using namespace std;
 // Function class
 
 Function::Function()
+	: m_success(false)
 {
 }
 
+vector<double> Function::values(const vector<vector<double> >& x) const
+{
+	vector<double> result;
+	result.reserve(x.size());
+
+	for (vector<vector<double> >::const_iterator it = x.begin(); it != x.end(); it++)
+		result.push_back(value(*it));
+
+	return result;
+}
+
 vector<double> Function::gradient(const vector<double>& x) const
 {
 	double epsilon = 1e-6;
-	vector<double> xlocal = x;
-	vector<double> grad(x.size());
+	// Evaluate x and all its displacements in a single batch
+	vector<vector<double> > points(x.size() + 1, x);
+	for (unsigned int i = 0; i < x.size(); i++)
+		points[i+1][i] += epsilon;
 
+	vector<double> f = values(points);
+	vector<double> grad(x.size());
 	for (unsigned int i = 0; i < x.size(); i++)
-	{
-		xlocal[i] += epsilon;
-		grad[i] = (value(xlocal) - value(x))/epsilon;
-		xlocal[i] -= epsilon;
-	}
+		grad[i] = (f[i+1] - f[0])/epsilon;
 
 	return grad;
 }
@@ -50,266 +61,193 @@ vector<double> Function::gradient(const vector<double>& x) const
 vector<double> Function::curvature(const vector<double>& x) const
 {
 	double epsilon = 1e-6;
-	vector<double> xlocal = x;
-	vector<double> curv(x.size());
-
+	// Evaluate x and all its displacements in a single batch
+	vector<vector<double> > points(2*x.size() + 1, x);
 	for (unsigned int i = 0; i < x.size(); i++)
 	{
-		curv[i] = -2.*value(x);
-		xlocal[i] += epsilon;
-		curv[i] += value(xlocal);
-		xlocal[i] -= 2.*epsilon;
-		curv[i] += value(xlocal);
-		xlocal[i] += epsilon;
-		curv[i] /= sqr(epsilon);
+		points[2*i+1][i] += epsilon;
+		points[2*i+2][i] -= epsilon;
 	}
 
+	vector<double> f = values(points);
+	vector<double> curv(x.size());
+	for (unsigned int i = 0; i < x.size(); i++)
+		curv[i] = (f[2*i+1] + f[2*i+2] - 2.*f[0])/sqr(epsilon);
+
 	return curv;
 }
 
-void Function::setLine(const vector<double>& point, const vector<double>& direction) const
+void Function::bounds(const vector<double>& x, vector<double>& lower, vector<double>& upper) const
 {
-	m_linePoint = point;
-	m_lineDirection = direction;
+	lower.assign(x.size(), -HUGE_VAL);
+	upper.assign(x.size(), HUGE_VAL);
 }
 
-vector<double> Function::lineParametric(double x) const
+// @return the projection of @p x on the box [@p lower, @p upper]
+static vector<double> project(const vector<double>& x, const vector<double>& lower, const vector<double>& upper)
 {
-	return m_linePoint + m_lineDirection*x;
-}
+	vector<double> result(x.size());
+	for (unsigned int i = 0; i < x.size(); i++)
+		result[i] = ::min(::max(x[i], lower[i]), upper[i]);
 
-double Function::lineValue(double x) const
-{
-	return (m_min ? 1.: -1.)*value(lineParametric(x));
+	return result;
 }
 
-vector<double> Function::lineExtremum(const vector<double>& x, const vector<double>& u, bool min) const
+// @return the scalar product of @p v1 and @p v2, restricted to the variables flagged in @p free
+static double freeScalar(const vector<double>& v1, const vector<double>& v2, const vector<char>& free)
 {
-	m_success = true;
-	setExtremumType(min);
-	setLine(x, u);
-
-	double start = 0.;
-	double stop = 1.;
-	cerr << "  Initial guess " << start << " to  " << stop << endl;
-	vector<double> bracket = bracketMinimum(start, stop);
-	cerr << "  Improved guess " << bracket[0] << " to " << bracket[2] << " by " << bracket[1] << endl;
-
-	double xmin = brent(bracket);
-	cerr << "  Minimum at " << xmin << endl;
-	cerr << "  Min val = " << lineValue(xmin) << " " << lineValue(xmin + 0.01) << " " << lineValue(xmin - 0.01) << endl;
-	return lineParametric(xmin);
-}
+	double result = 0.;
+	for (unsigned int i = 0; i < v1.size(); i++)
+		if (free[i])
+			result += v1[i]*v2[i];
 
-vector<double> Function::localExtremum(const vector<double>& x, bool min) const
-{
-	// Conjugate gradient algorithm
-
-	static const int maxIter = 250;
-	m_success = true;
-	setExtremumType(min);
-	vector<double> position = x;
-	vector<double> direction(x.size(), 0.);
-	vector<double> oldGrad;
-	int i;
-
-	for (i = 0; (value(position) < 0.99999) && (i < maxIter); i++)
-	{
-		cerr << "Iteration " << i << endl;
-		// Compute the optimization direction
-		vector<double> grad = gradient(position);
-		double beta = 0.;
-		if (!oldGrad.empty())
-		{
-			//beta = Utils::scalar(grad, grad)/Utils::scalar(oldGrad, oldGrad); // Fletcher-Reeves
-			beta = Utils::scalar(grad, grad - oldGrad)/Utils::scalar(oldGrad, oldGrad); // Polak-Ribière
-			//beta = Utils::scalar(grad, grad - oldGrad)/Utils::scalar(direction, grad - oldGrad); // Hestenes-Stiefel
-			beta = ::max(0., beta);
-		}
-		direction =  beta*direction - grad;
-		oldGrad = grad;
-
-		cerr << " Direction : " << direction[0] << " " << direction[1] << " " << direction[2] << endl;
-
-		position = lineMaximum(position, direction);
-		for (vector<double>::iterator it = position.begin(); it != position.end(); it++)
-			cerr << " Pos " << (*it) << endl;
-		cerr << " Value : " << value(position) << endl;
-	}
-
-	if (i == maxIter)
-		m_success = false;
-
-	return position;
-}
-
-vector<double> Function::absoluteExtremum(bool min) const
-{
-	m_success = true;
-	setExtremumType(min);
-	/// @todo
-	return vector<double>(2);
+	return result;
 }
 
-/// @todo replace this by a random search
-vector<double> Function::bracketMinimum(double start, double stop) const
+vector<double> Function::localExtremum(const vector<double>& x, bool min) const
 {
-	static const double golden = 1.618033988749894848;
-	static const double epsilon = 1e-20;
-	static const double gLimit = 100.;
+	// Projected limited memory BFGS algorithm, in the spirit of L-BFGS-B: the variables are projected on
+	// the box given by bounds(), and the quasi-Newton step only moves the variables that are not blocked
+	// by a bound. The search minimizes sign*value()
+
+	static const int maxIter = 200;
+	static const unsigned int memory = 8;
+	static const int maxBacktrack = 30;
+	static const double armijo = 1e-4;
+	static const double gradientTolerance = 1e-10;
+	static const double valueTolerance = 1e-12;
+
+	m_success = false;
+	const double sign = min ? 1. : -1.;
+	const int n = x.size();
+	vector<double> lower, upper;
+	bounds(x, lower, upper);
+	vector<double> position = project(x, lower, upper);
+	double f = sign*value(position);
+	vector<double> grad = sign*gradient(position);
+	// Last steps and gradient changes
+	vector<vector<double> > s, y;
+	vector<double> rho;
+	vector<char> free(n);
 
-	double ulim, fu;
-
-	double a = start;
-	double b = stop;
-
-	double fa = lineValue(a);
-	double fb = lineValue(b);
-	if (fb > fa)
+	for (int iter = 0; iter < maxIter; iter++)
 	{
-		::swap(a, b);
-		::swap(fb, fa);
-	}
-
-	double c = b + golden*(b - a);
-	double fc = lineValue(c);
+		if (iter > 0)
+			bounds(position, lower, upper);
 
-	while (fb > fc)
-	{
-		double r = (b - a)*(fb - fc);
-		double q = (b - c)*(fb - fa);
-		double u = b - ((b - c)*q - (b - a)*r)/(2.0*::max(double(fabs(q-r)), epsilon)*sign(q-r));
-		ulim = b + gLimit*(c - b);
-		if ((b - u)*(u - c) > 0.)
+		// Variables blocked by a bound are excluded from the step
+		double projectedGradient = 0.;
+		for (int i = 0; i < n; i++)
 		{
-			fu = lineValue(u);
-			if (fu < fc)
-			{
-				a = b;
-				b = u;
-				break;
-			}
-			else if (fu > fb)
-			{
-				c = u;
-				break;
-			}
-			u = c + golden*(c - b);
-			fu = lineValue(u);
-		}
-		else if ((c - u)*(u - ulim) > 0.)
-		{
-			fu = lineValue(u);
-			if (fu < fc)
-			{
-				b = c; c = u; u = c + golden*(c - b);
-				fb = fc; fc = fu; fu = lineValue(u);
-			}
+			free[i] = (lower[i] < upper[i]) && !((position[i] <= lower[i]) && (grad[i] > 0.)) &&
+			                                   !((position[i] >= upper[i]) && (grad[i] < 0.));
+			if (free[i])
+				projectedGradient = ::max(projectedGradient, fabs(grad[i]));
 		}
-		else if ((u - ulim)*(ulim - c) >= 0.)
+		if (projectedGradient <= gradientTolerance*(1. + fabs(f)))
 		{
-			u = ulim;
-			fu = lineValue(u);
+			m_success = true;
+			break;
 		}
-		else
-		{
-			u = c + golden*(c - b);
-			fu = lineValue(u);
-		}
-		a = b; b = c; c = u;
-		fa = fb; fb = fc; fc = fu;
-	}
-
-	vector<double> result;
-	result.push_back(a);
-	result.push_back(b);
-	result.push_back(c);
-
-	return result;
-}
-
-double Function::brent(const vector<double>& bracket) const
-{
-	static const double maxIter = 100;
-	static const double cGolden = 0.3819660112501051518; // (3 - sqrt(5))/2
-	static const double maxTolerance = 2e-4;
-	static const double epsilon = 1e-10;
-
-	double e = 0.;
-
-	double a = ::min(bracket[0], bracket[2]);
-	double b = ::max(bracket[0], bracket[2]);
 
-	double d, fu, fv, fw, fx, u, v, w, x;
-	x = w = v = bracket[1];
-	fw = fv = fx = lineValue(x);
-
-	for (int iter = 0; iter < maxIter; iter++)
-	{
-		double tolerance = maxTolerance*fabs(x) + epsilon;
-		// Required acuracy reached
-		if ((b - a)/2. < tolerance)
-			return x;
-
-		double xm = 0.5*(a + b);
-		double p = 0., q = 0., r = 0.;
-
-		if (fabs(e) > tolerance)
+		// Quasi-Newton direction, by the two loop recursion
+		vector<double> direction(n, 0.);
+		for (int i = 0; i < n; i++)
+			if (free[i])
+				direction[i] = grad[i];
+		vector<double> alpha(s.size());
+		for (int k = s.size() - 1; k >= 0; k--)
 		{
-			// Parabolic interpolation
-			r = (x - w)*(fx - fv);
-			q = (x - v)*(fx - fw);
-			p = (x - v)*q - (x - w)*r;
-			q = 2.*(q - r);
-			if (q > 0.)
-				p = -p;
-			else
-				q = -q;
+			alpha[k] = rho[k]*freeScalar(s[k], direction, free);
+			for (int i = 0; i < n; i++)
+				if (free[i])
+					direction[i] -= alpha[k]*y[k][i];
 		}
-
-		if ((fabs(p) < fabs(.5*q*e)) && (p > q*(q-x)) && (p < q*(b-x)))
+		// Without history, the first trial step moves the variables by at most one unit
+		const double gamma = s.empty() ? 1./projectedGradient : 1./(rho.back()*Utils::scalar(y.back(), y.back()));
+		for (int i = 0; i < n; i++)
+			direction[i] *= -gamma;
+		for (unsigned int k = 0; k < s.size(); k++)
 		{
-			e = d;
-			d = p / q;
-			u = x + d;
-			if ((0.5*(u - a) < tolerance) || (0.5*(b - u) < tolerance))
-				d = sign(xm - x)*tolerance;
+			const double beta = rho[k]*freeScalar(y[k], direction, free);
+			for (int i = 0; i < n; i++)
+				if (free[i])
+					direction[i] -= (alpha[k] + beta)*s[k][i];
 		}
-		else
+		if (!(Utils::scalar(grad, direction) < 0.))
 		{
-			e = x < xm ? b-x : a-x;
-			d = cGolden*e;
+			// Not a descent direction: restart along the steepest descent
+			s.clear();
+			y.clear();
+			rho.clear();
+			for (int i = 0; i < n; i++)
+				direction[i] = free[i] ? -grad[i]/projectedGradient : 0.;
 		}
 
-		u = x + sign(d)*::max(fabs(d), tolerance);
-		fu = lineValue(u);
-
-		if (fu <= fx)
+		// Backtracking along the projected path, until the Armijo condition holds
+		double length = 1.;
+		vector<double> trial;
+		double fTrial = f;
+		bool accepted = false;
+		for (int b = 0; (b < maxBacktrack) && !accepted; b++)
 		{
-			if (u < x)
-				b = x;
-			else
-				a = x;
-			v = w; w = x; x = u;
-			fv = fw; fw = fx; fx = fu;
+			trial = project(position + length*direction, lower, upper);
+			const double decrease = Utils::scalar(grad, trial - position);
+			if (!(decrease < 0.))
+				break;
+			fTrial = sign*value(trial);
+			accepted = fTrial <= f + armijo*decrease;
+			// Safeguarded minimum of the quadratic interpolation along the step
+			length *= ::max(0.1, ::min(0.5, -decrease/(2.*(fTrial - f - decrease))));
 		}
-		else
+		if (!accepted)
 		{
-			if (u < x)
-				a = u;
-			else
-				b = u;
-			if (fu <= fw || w == x)
+			// No decrease can be found along the steepest descent either: this is a local extremum
+			if (s.empty())
 			{
-				v = w; w = u;
-				fv = fw; fw = fv;
+				m_success = true;
+				break;
 			}
-			else if (fu <= fv || v == x || v == w)
+			s.clear();
+			y.clear();
+			rho.clear();
+			continue;
+		}
+
+		// Update the history, keeping the curvature condition
+		vector<double> gradTrial = sign*gradient(trial);
+		vector<double> displacement = trial - position, change = gradTrial - grad;
+		const double curvature = Utils::scalar(displacement, change);
+		if (curvature > 1e-10*Utils::scalar(change, change))
+		{
+			if (s.size() == memory)
 			{
-				v = u;
-				fv = fu;
+				s.erase(s.begin());
+				y.erase(y.begin());
+				rho.erase(rho.begin());
 			}
+			s.push_back(displacement);
+			y.push_back(change);
+			rho.push_back(1./curvature);
+		}
+
+		const double fChange = f - fTrial;
+		position = trial;
+		f = fTrial;
+		grad = gradTrial;
+		if (fChange <= valueTolerance*::max(fabs(f), 1.))
+		{
+			m_success = true;
+			break;
 		}
 	}
-	return x;
+
+	return position;
+}
+
+vector<double> Function::absoluteExtremum(bool min) const
+{
+	m_success = true;
+	/// @todo
+	return vector<double>(2);
 }
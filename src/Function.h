@@ -34,15 +34,26 @@ public:
 public:
 	/// Evaluate the function point @p x
 	virtual double value(const std::vector<double>& x) const = 0;
-	/// Compute the function gradient at point @p x
-	std::vector<double> gradient(const std::vector<double>& x) const;
-	/// Compute the vector of second derivatives at point @p x
-	std::vector<double> curvature(const std::vector<double>& x) const;
-	/// Search the extremum of the function along a line that crosses point @p x and directed along @p u
-	std::vector<double> lineExtremum(const std::vector<double>& x, const std::vector<double>& u, bool min) const;
-	std::vector<double> lineMinimum(const std::vector<double>& x, const std::vector<double>& u) const { return lineExtremum(x, u, true); }
-	std::vector<double> lineMaximum(const std::vector<double>& x, const std::vector<double>& u) const { return lineExtremum(x, u, false); }
-	/// Search the local extremum around point @p x
+	/**
+	* Evaluate the function at all points of @p x.
+	* The default implementation calls value() for each point. Subclasses that can evaluate
+	* many points at once more efficiently should reimplement this function
+	*/
+	virtual std::vector<double> values(const std::vector<std::vector<double> >& x) const;
+	/// Compute the function gradient at point @p x. By default, use finite differences
+	virtual std::vector<double> gradient(const std::vector<double>& x) const;
+	/// Compute the vector of second derivatives at point @p x. By default, use finite differences
+	virtual std::vector<double> curvature(const std::vector<double>& x) const;
+	/**
+	* Compute the box [@p lower, @p upper] in which the variables may move from point @p x during
+	* the next step of localExtremum(). Equal bounds fix a variable. The box is computed again after each step,
+	* so that it may express constraints that depend on @p x. By default, the variables are unbounded
+	*/
+	virtual void bounds(const std::vector<double>& x, std::vector<double>& lower, std::vector<double>& upper) const;
+	/**
+	* Search the local extremum around point @p x, within the box given by bounds(), with a projected
+	* limited memory BFGS algorithm using gradient()
+	*/
 	std::vector<double> localExtremum(const std::vector<double>& x, bool min) const;
 	std::vector<double> localMinimum(const std::vector<double>& x) const { return localExtremum(x, true); }
 	std::vector<double> localMaximum(const std::vector<double>& x) const { return localExtremum(x, false); }
@@ -54,23 +65,7 @@ public:
 	bool optimizationSuccess() { return m_success; }
 
 private:
-	// Set search extremum type
-	void setExtremumType(bool min) const { m_min = min; }
-	// Set line search parameters: start point and direction
-	void setLine(const std::vector<double>& point, const std::vector<double>& direction) const;
-	// Parametric representation of a line, given line parameters defined by setLine
-	std::vector<double> lineParametric(double x) const;
-	// Value of the function along along a line this value is signed according to the type of extremum searched
-	double lineValue(double x) const;
-	// Line search algorithms
-	std::vector<double> bracketMinimum(double start, double stop) const;
-	double brent(const std::vector<double>& bracket) const;
-
-
-private:
-	mutable bool m_min, m_success;
-	mutable std::vector<double> m_linePoint;
-	mutable std::vector<double> m_lineDirection;
+	mutable bool m_success;
 };
 
 #endif
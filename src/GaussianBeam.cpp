@@ -269,11 +269,21 @@ Point Beam::origin() const
 	return m_origin;
 }
 
+void Beam::setOrigin(const Point& origin)
+{
+	m_origin = origin;
+}
+
 double Beam::angle() const
 {
 	return m_angle;
 }
 
+void Beam::setAngle(double angle)
+{
+	m_angle = fmodPos(angle, 2.*M_PI);
+}
+
 void Beam::rotate(double pivot, double angle)
 {
 	double l = 2.*pivot*sin(angle/2.);
@@ -128,8 +128,12 @@ public:
 	void rotate(double pivot, double angle);
 	/// @return the position for the origin of this beam in the plane
 	Utils::Point origin() const;
+	/// Set the position for the origin of this beam in the plane to @p origin
+	void setOrigin(const Utils::Point& origin);
 	/// @return the angle between the wave vector and the plane abscissa
 	double angle() const;
+	/// Set the angle between the wave vector and the plane abscissa to @p angle
+	void setAngle(double angle);
 	/**
 	* @return the beam coordinates of absolute point @p point
 	* The first beam coordinate is the position of the orthogonal projection of @p point on the beam axis
@@ -0,0 +1,83 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <algorithm>
+#include <cmath>
+
+/**
+* Closed interval of real numbers. Computing with intervals instead of doubles gives guaranteed bounds
+* on a result whose inputs are only known within bounds: each operation returns an interval containing
+* the results for all the operands in the operand intervals. Bounds are rounded outwards, so that
+* rounding errors do not break the guarantee. Correlations between operands are ignored (x - x is not
+* zero), hence bounds widen along long computations.
+*/
+struct Interval
+{
+	Interval(double value = 0.) : lower(value), upper(value) {}
+	Interval(double lowerBound, double upperBound) : lower(lowerBound), upper(upperBound) {}
+
+	double midpoint() const { return 0.5*(lower + upper); }
+	double width() const { return upper - lower; }
+	bool contains(double value) const { return (value >= lower) && (value <= upper); }
+
+	/// Lower bound
+	double lower;
+	/// Upper bound
+	double upper;
+};
+
+/// @return the interval [@p lower, @p upper] widened by one unit in the last place on each side
+inline Interval outwardInterval(double lower, double upper)
+{
+	return Interval(std::nextafter(lower, -HUGE_VAL), std::nextafter(upper, HUGE_VAL));
+}
+
+inline Interval operator+(const Interval& a, const Interval& b) { return outwardInterval(a.lower + b.lower, a.upper + b.upper); }
+inline Interval operator-(const Interval& a, const Interval& b) { return outwardInterval(a.lower - b.upper, a.upper - b.lower); }
+inline Interval operator-(const Interval& a) { return Interval(-a.upper, -a.lower); }
+
+inline Interval operator*(const Interval& a, const Interval& b)
+{
+	const double ll = a.lower*b.lower, lu = a.lower*b.upper, ul = a.upper*b.lower, uu = a.upper*b.upper;
+	return outwardInterval(std::min(std::min(ll, lu), std::min(ul, uu)), std::max(std::max(ll, lu), std::max(ul, uu)));
+}
+
+/// Division by an interval containing zero gives the whole real line
+inline Interval operator/(const Interval& a, const Interval& b)
+{
+	if ((b.lower <= 0.) && (b.upper >= 0.))
+		return Interval(-HUGE_VAL, HUGE_VAL);
+
+	const double ll = a.lower/b.lower, lu = a.lower/b.upper, ul = a.upper/b.lower, uu = a.upper/b.upper;
+	return outwardInterval(std::min(std::min(ll, lu), std::min(ul, uu)), std::max(std::max(ll, lu), std::max(ul, uu)));
+}
+
+/// Negative values of @p a are ignored
+inline Interval sqrt(const Interval& a)
+{
+	return outwardInterval(std::sqrt(std::max(a.lower, 0.)), std::sqrt(a.upper));
+}
+
+/// @return true if all the values of @p a are greater than @p b
+inline bool operator>(const Interval& a, double b) { return a.lower > b; }
+
+#endif
@@ -0,0 +1,61 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef JET_H
+#define JET_H
+
+#include <cmath>
+
+/**
+* Value of a function along a line, together with its first and second derivatives along this line.
+* Computing with jets instead of doubles gives exact derivatives (forward automatic differentiation).
+*/
+struct Jet
+{
+	Jet(double value = 0., double d1 = 0., double d2 = 0.) : v(value), d(d1), dd(d2) {}
+
+	/// Value
+	double v;
+	/// First derivative
+	double d;
+	/// Second derivative
+	double dd;
+};
+
+inline Jet operator+(const Jet& a, const Jet& b) { return Jet(a.v + b.v, a.d + b.d, a.dd + b.dd); }
+inline Jet operator-(const Jet& a, const Jet& b) { return Jet(a.v - b.v, a.d - b.d, a.dd - b.dd); }
+inline Jet operator-(const Jet& a) { return Jet(-a.v, -a.d, -a.dd); }
+inline Jet operator*(const Jet& a, const Jet& b) { return Jet(a.v*b.v, a.d*b.v + a.v*b.d, a.dd*b.v + 2.*a.d*b.d + a.v*b.dd); }
+
+inline Jet operator/(const Jet& a, const Jet& b)
+{
+	const double v = a.v/b.v;
+	const double d = (a.d - v*b.d)/b.v;
+	return Jet(v, d, (a.dd - 2.*d*b.d - v*b.dd)/b.v);
+}
+
+inline Jet sqrt(const Jet& a)
+{
+	const double v = std::sqrt(a.v);
+	const double d = a.d/(2.*v);
+	return Jet(v, d, (a.dd - 2.*d*d)/(2.*v));
+}
+
+inline bool operator>(const Jet& a, double b) { return a.v > b; }
+
+#endif
@@ -0,0 +1,263 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "LensSelection.h"
+#include "OpticsBench.h"
+#include "OpticsFunction.h"
+#include "Optics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+/// Number of random placements screened for each lens combination
+static const int nScreening = 1024;
+/// Number of the best screened placements refined by a local optimization
+static const int nRefined = 4;
+
+// Append to @p combinations all the combinations of at most @p remaining lenses of the catalog
+// entries @p entry and beyond, completing @p current
+static void enumerateCombinations(const vector<CatalogLens>& catalog, unsigned int entry, int remaining,
+                                  vector<double>& current, vector<vector<vector<double> > >& combinations)
+{
+	if (entry == catalog.size())
+	{
+		combinations[current.size()].push_back(current);
+		return;
+	}
+
+	const int maxCount = ::min(catalog[entry].count, remaining);
+	for (int count = 0; count <= maxCount; count++)
+	{
+		enumerateCombinations(catalog, entry + 1, remaining - count, current, combinations);
+		current.push_back(catalog[entry].focal);
+	}
+	current.resize(current.size() - maxCount - 1);
+}
+
+LensSelection::LensSelection(const OpticsBench& bench)
+	: m_bench(bench)
+	, m_maxLenses(2)
+	, m_left(bench.leftBoundary())
+	, m_right(bench.rightBoundary())
+	, m_minimumSpacing(1e-3)
+	, m_threadCount(0)
+	, m_overlap(0.)
+	, m_nCombinations(0)
+{
+}
+
+bool LensSelection::check()
+{
+	if (m_bench.nOptics() == 0)
+	{
+		m_errorString = "the bench does not contain any optics";
+		return false;
+	}
+
+	if (m_catalog.empty() || (m_maxLenses < 1))
+	{
+		m_errorString = "the catalog is empty";
+		return false;
+	}
+
+	for (vector<CatalogLens>::const_iterator it = m_catalog.begin(); it != m_catalog.end(); it++)
+		if (it->focal == 0.)
+		{
+			m_errorString = "catalog lenses must have a non zero focal length";
+			return false;
+		}
+
+	if (m_left >= m_right)
+	{
+		m_errorString = "the placement range is empty";
+		return false;
+	}
+
+	return true;
+}
+
+bool LensSelection::run(unsigned int seed)
+{
+	m_errorString.clear();
+	m_overlap = 0.;
+	m_focals.clear();
+	m_positions.clear();
+	m_nCombinations = 0;
+	if (!check())
+		return false;
+
+	// Branches of the search tree: the number of lenses of each catalog entry
+	vector<vector<vector<double> > > combinations(m_maxLenses + 1);
+	vector<double> current;
+	enumerateCombinations(m_catalog, 0, m_maxLenses, current, combinations);
+
+	// Optics already on the bench. The placed lenses are inserted after the first optics
+	vector<double> fixedStart, fixedStop;
+	for (int i = 1; i < m_bench.nOptics(); i++)
+	{
+		fixedStart.push_back(m_bench.optics(i)->position() - m_minimumSpacing);
+		fixedStop.push_back(m_bench.optics(i)->endPosition() + m_minimumSpacing);
+	}
+	const double left = m_left, right = m_right, spacing = m_minimumSpacing;
+	const double inputPosition = m_bench.optics(0)->position();
+
+	// @return true if the lens positions x[1..] are in the range and far enough from each other and from the other optics
+	auto isValid = [&](const vector<double>& x)
+	{
+		for (unsigned int i = 1; i < x.size(); i++)
+		{
+			if ((x[i] < left) || (x[i] > right))
+				return false;
+			for (unsigned int j = 1; j < i; j++)
+				if (fabs(x[i] - x[j]) < spacing)
+					return false;
+			for (unsigned int j = 0; j < fixedStart.size(); j++)
+				if ((x[i] > fixedStart[j]) && (x[i] < fixedStop[j]))
+					return false;
+		}
+		return true;
+	};
+
+	// Optimize the positions of the lenses of focal lengths @p focals
+	auto optimize = [&](const vector<double>& focals, seed_seq& seedSequence, vector<double>& bestPosition)
+	{
+		vector<Optics*> optics;
+		optics.push_back(m_bench.optics(0)->clone());
+		for (vector<double>::const_iterator it = focals.begin(); it != focals.end(); it++)
+			optics.push_back(new Lens(*it, left));
+		for (int i = 1; i < m_bench.nOptics(); i++)
+			optics.push_back(m_bench.optics(i)->clone());
+		OpticsFunction function(optics, m_bench.wavelength());
+		function.setOverlapBeam(*m_bench.targetBeam());
+		function.setCheckLock(false);
+		function.setBoundary(left, right);
+
+		// Screen random placements, keeping the best ones sorted by decreasing overlap
+		mt19937 generator(seedSequence);
+		vector<pair<double, vector<double> > > best;
+		vector<vector<double> > candidates;
+		for (int i = 0; i < nScreening; i++)
+		{
+			vector<double> x(focals.size() + 1, inputPosition);
+			for (unsigned int j = 1; j < x.size(); j++)
+				x[j] = double(generator())/4294967296.*(right - left) + left;
+			if (isValid(x))
+				candidates.push_back(x);
+			if ((int(candidates.size()) < CompiledBench::batchSize) && (i < nScreening - 1))
+				continue;
+
+			vector<double> overlaps = function.values(candidates);
+			for (unsigned int j = 0; j < candidates.size(); j++)
+				if ((int(best.size()) < nRefined) || (overlaps[j] > best.back().first))
+				{
+					if (int(best.size()) == nRefined)
+						best.pop_back();
+					vector<pair<double, vector<double> > >::iterator it = best.begin();
+					while ((it != best.end()) && (it->first >= overlaps[j]))
+						it++;
+					best.insert(it, make_pair(overlaps[j], candidates[j]));
+				}
+			candidates.clear();
+		}
+
+		// Refine the best placements
+		double bestOverlap = 0.;
+		if (!best.empty())
+		{
+			bestOverlap = best.front().first;
+			bestPosition = best.front().second;
+		}
+		for (unsigned int i = 0; i < best.size(); i++)
+		{
+			vector<double> x = function.localMaximum(best[i].second);
+			x[0] = inputPosition;
+			const double overlap = function.value(x);
+			if (isValid(x) && (overlap > bestOverlap))
+			{
+				bestOverlap = overlap;
+				bestPosition = x;
+			}
+		}
+
+		for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+			delete *it;
+
+		return bestOverlap;
+	};
+
+	// Explore the combinations by increasing number of lenses, and stop at the first number
+	// of lenses reaching the target overlap: more lenses can not give a better selection
+	for (int nLenses = 1; nLenses <= m_maxLenses; nLenses++)
+	{
+		const vector<vector<double> >& branch = combinations[nLenses];
+		const int nBranch = branch.size();
+		vector<double> branchOverlap(nBranch);
+		vector<vector<double> > branchPosition(nBranch);
+		atomic<int> nextBranch(0);
+
+		auto search = [&]()
+		{
+			for (int b = nextBranch++; b < nBranch; b = nextBranch++)
+			{
+				seed_seq seedSequence{seed, (unsigned int)nLenses, (unsigned int)b};
+				branchOverlap[b] = optimize(branch[b], seedSequence, branchPosition[b]);
+			}
+		};
+
+		const int nThreads = ::max(1, ::min(m_threadCount > 0 ? m_threadCount : int(thread::hardware_concurrency()), nBranch));
+		vector<thread> workers;
+		for (int i = 1; i < nThreads; i++)
+			workers.push_back(thread(search));
+		search();
+		for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++)
+			it->join();
+
+		m_nCombinations += nBranch;
+		for (int b = 0; b < nBranch; b++)
+			if (branchOverlap[b] > m_overlap)
+			{
+				m_overlap = branchOverlap[b];
+				m_focals = branch[b];
+				m_positions.assign(branchPosition[b].begin() + 1, branchPosition[b].end());
+			}
+
+		if (m_overlap >= m_bench.targetOverlap())
+			return true;
+	}
+
+	return false;
+}
+
+void LensSelection::apply(OpticsBench& bench) const
+{
+	OpticsBenchUpdate update(bench);
+
+	for (unsigned int i = 0; i < m_focals.size(); i++)
+	{
+		bench.addOptics(LensType, bench.nOptics());
+		const int index = bench.nOptics() - 1;
+		dynamic_cast<Lens*>(bench.opticsForPropertyChange(index))->setFocal(m_focals[i]);
+		bench.opticsPropertyChanged(index);
+		bench.setOpticsPosition(index, m_positions[i]);
+	}
+}
@@ -0,0 +1,98 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef LENSSELECTION_H
+#define LENSSELECTION_H
+
+#include <string>
+#include <vector>
+
+class OpticsBench;
+
+/// Lens of a catalog
+struct CatalogLens
+{
+	CatalogLens(double focal = 0.1, int count = 1) : focal(focal), count(count) {}
+
+	double focal;
+	int count;      ///< Number of lenses in stock
+};
+
+/**
+* Choose lenses from a catalog, and their positions, so that the output beam of the bench
+* matches the target beam. The optics already on the bench stay at their positions.
+*
+* The search is a branch and bound over the combinations of catalog lenses: combinations are
+* explored by increasing number of lenses, and as soon as a combination reaches the target
+* overlap, combinations with more lenses are not explored. The lens positions of each combination
+* are first screened by many cheap ABCD propagations of random placements, and the best
+* placements are then refined by a local optimization. Combinations are processed in parallel.
+* The random sequence is derived from a seed: running again with the same seed
+* gives the same result, whatever the number of threads.
+*/
+class LensSelection
+{
+public:
+	/// Constructor. The optics and the target beam of @p bench are copied when calling run()
+	LensSelection(const OpticsBench& bench);
+
+public:
+	/// Add a lens to the catalog
+	void addCatalogLens(const CatalogLens& lens) { m_catalog.push_back(lens); }
+	/// Maximum number of lenses placed on the bench. Defaults to 2
+	void setMaxLenses(int maxLenses) { m_maxLenses = maxLenses; }
+	/// Lenses are placed between @p left and @p right. Defaults to the bench boundaries
+	void setRange(double left, double right) { m_left = left; m_right = right; }
+	/// Minimum distance between a placed lens and any other optics. Defaults to 1 mm
+	void setMinimumSpacing(double spacing) { m_minimumSpacing = spacing; }
+	/// Number of threads. 0, the default, uses all the cores
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+	/// Search the lenses, with random sequence @p seed. @return true if the target overlap of the bench is reached
+	bool run(unsigned int seed);
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+	/// @return the best overlap found
+	double overlap() const { return m_overlap; }
+	/// @return the focal lengths of the selected lenses
+	const std::vector<double>& focals() const { return m_focals; }
+	/// @return the positions of the selected lenses
+	const std::vector<double>& positions() const { return m_positions; }
+	/// @return the number of lens combinations that were optimized
+	int nCombinations() const { return m_nCombinations; }
+	/// Add the selected lenses to @p bench
+	void apply(OpticsBench& bench) const;
+
+private:
+	bool check();
+
+private:
+	const OpticsBench& m_bench;
+	std::vector<CatalogLens> m_catalog;
+	int m_maxLenses;
+	double m_left, m_right;
+	double m_minimumSpacing;
+	int m_threadCount;
+	std::string m_errorString;
+	double m_overlap;
+	std::vector<double> m_focals;
+	std::vector<double> m_positions;
+	int m_nCombinations;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <new>
+#include <vector>
+
+/**
+* Pool of objects of type T, stored by value in contiguous blocks of @p blockSize objects.
+* Objects keep their address until they are released, so that they can be used as stable handles,
+* and the slots of released objects are reused by the next allocations. Objects allocated in
+* sequence are contiguous in memory.
+*/
+template<typename T, int blockSize = 64>
+class ObjectPool
+{
+public:
+	ObjectPool() : m_used(blockSize) {}
+	~ObjectPool() { clear(); }
+
+public:
+	/// @return a new object of the pool, copy of @p value
+	T* create(const T& value)
+	{
+		void* slot;
+		if (!m_free.empty())
+		{
+			slot = m_free.back();
+			m_free.pop_back();
+		}
+		else
+		{
+			if (m_used == blockSize)
+			{
+				m_blocks.push_back(static_cast<T*>(::operator new(blockSize*sizeof(T))));
+				m_used = 0;
+			}
+			slot = m_blocks.back() + m_used++;
+		}
+
+		return new (slot) T(value);
+	}
+
+	/// Destroy @p object, that was created by this pool
+	void release(T* object)
+	{
+		object->~T();
+		m_free.push_back(object);
+	}
+
+	/// @return the number of objects of the pool
+	int size() const { return int(m_blocks.size())*blockSize - (blockSize - m_used) - int(m_free.size()); }
+
+	/// Destroy all the objects of the pool
+	void clear()
+	{
+		std::vector<bool> released(m_blocks.size()*blockSize, false);
+		for (typename std::vector<T*>::const_iterator it = m_free.begin(); it != m_free.end(); it++)
+			for (unsigned int b = 0; b < m_blocks.size(); b++)
+				if ((*it >= m_blocks[b]) && (*it < m_blocks[b] + blockSize))
+					released[b*blockSize + (*it - m_blocks[b])] = true;
+
+		for (unsigned int b = 0; b < m_blocks.size(); b++)
+		{
+			const int used = (b + 1 == m_blocks.size()) ? m_used : blockSize;
+			for (int i = 0; i < used; i++)
+				if (!released[b*blockSize + i])
+					m_blocks[b][i].~T();
+			::operator delete(m_blocks[b]);
+		}
+
+		m_blocks.clear();
+		m_free.clear();
+		m_used = blockSize;
+	}
+
+private:
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator=(const ObjectPool&);
+
+private:
+	std::vector<T*> m_blocks;
+	/// Number of slots used in the last block
+	int m_used;
+	std::vector<T*> m_free;
+};
+
+#endif
@@ -67,7 +67,10 @@ bool Optics::isOrientable() const
 void Optics::setOrientation(Orientation orientation)
 {
 	if (isOrientable(orientation))
+	{
 		m_orientation = orientation;
+		propertiesChanged();
+	}
 	else
 		cerr << "Error in Optics::setOrientation : the optics is not orientable along this orientation" << endl;
 }
@@ -241,6 +244,7 @@ void Lens::setFocal(double focal)
 {
 	if (focal != 0.)
 		m_focal = focal;
+	updateMatrix();
 }
 
 /////////////////////////////////////////////////
@@ -276,6 +280,7 @@ void CurvedMirror::setCurvatureRadius(double curvatureRadius)
 {
 	if (curvatureRadius != 0.)
 		m_curvatureRadius = curvatureRadius;
+	updateMatrix();
 }
 
 /////////////////////////////////////////////////
@@ -285,6 +290,7 @@ void Dielectric::setIndexRatio(double indexRatio)
 {
 	if (indexRatio > 0.)
 		m_indexRatio = indexRatio;
+	indexRatioChanged();
 }
 
 /////////////////////////////////////////////////
@@ -294,15 +300,23 @@ void CurvedInterface::setSurfaceRadius(double surfaceRadius)
 {
 	if (surfaceRadius != 0.)
 		m_surfaceRadius = surfaceRadius;
+	updateMatrix();
 }
 
 /////////////////////////////////////////////////
 // ABCD class
 
+void ABCD::updateMatrix()
+{
+	m_matrix[0] = Matrix(A(Horizontal), B(Horizontal), C(Horizontal), D(Horizontal));
+	m_matrix[1] = Matrix(A(Vertical), B(Vertical), C(Vertical), D(Vertical));
+}
+
 void ABCD::forward(const Beam& inputBeam, Beam& outputBeam, Orientation orientation) const
 {
+	const Matrix& m = matrix(orientation);
 	complex<double> q = inputBeam.q(position(), orientation);
-	q = (A(orientation)*q + B(orientation)) / (C(orientation)*q + D(orientation));
+	q = (m.A*q + m.B) / (m.C*q + m.D);
 	outputBeam.setQ(q, position() + width(), orientation);
 }
 
@@ -324,8 +338,9 @@ Beam ABCD::image(const Beam& inputBeam, const Beam& /*opticalAxis*/) const
 
 void ABCD::backward(const Beam& outputBeam, Beam& inputBeam, Orientation orientation) const
 {
+	const Matrix& m = matrix(orientation);
 	complex<double> q = outputBeam.q(position() + width(), orientation);
-	q = (B(orientation) - D(orientation)*q) / (C(orientation)*q - A(orientation));
+	q = (m.B - m.D*q) / (m.C*q - m.A);
 	inputBeam.setQ(q, position(), orientation);
 }
 
@@ -418,6 +433,7 @@ void GenericABCD::setCoefficient(double coefficient[], double value, Orientation
 
 	if (orientation != Spherical)
 		setOrientation(Ellipsoidal);
+	updateMatrix();
 }
 
 void GenericABCD::mult(const ABCD& abcd, Orientation orientation)
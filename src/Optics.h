@@ -102,7 +102,7 @@ public:
 	/// @return the width of the optics
 	double width() const { return m_width; }
 	/// Set the width of the optics
-	void setWidth(double width) { m_width = width; }
+	void setWidth(double width) { m_width = width; propertiesChanged(); }
 	/// @return the angle between the optics and the optical axis
 	double angle() const { return m_angle; }
 	/// Set the angle between the optics and the optical axis
@@ -156,6 +156,8 @@ public:
 	bool relativeUnlock();
 
 protected:
+	/// Called when the width or the orientation of the optics change
+	virtual void propertiesChanged() {}
 	void setType(OpticsType type) { m_type = type; }
 	void setRotable(bool rotable = true) { m_rotable = rotable; }
 	bool isAligned(Orientation orientation) const { return (m_orientation == Spherical) || (m_orientation == orientation); }
@@ -197,6 +199,14 @@ private:
 */
 class ABCD : public Optics
 {
+public:
+	/// Coefficients of an ABCD matrix
+	struct Matrix
+	{
+		Matrix(double A = 1., double B = 0., double C = 0., double D = 1.) : A(A), B(B), C(C), D(D) {}
+		double A, B, C, D;
+	};
+
 public:
 	/// Constructor
 	ABCD(OpticsType type, double position, std::string name = "") : Optics(type, position, name) {}
@@ -220,10 +230,23 @@ public:
 	virtual double C(Orientation /*orientation*/) const { return 0.; }
 	/// @return coefficient D of the ABCD matrix
 	virtual double D(Orientation /*orientation*/) const { return 1.; }
+	/**
+	* @return the ABCD matrix for orientation @p orientation, Spherical being the Horizontal matrix.
+	* The matrix is cached: reading it does not call the virtual coefficient functions
+	*/
+	const Matrix& matrix(Orientation orientation) const { return m_matrix[orientation == Vertical ? 1 : 0]; }
+
+protected:
+	/// Update the cached matrix. Subclasses call this function when a property of their matrix changes
+	void updateMatrix();
+	virtual void propertiesChanged() { updateMatrix(); }
 
 private:
 	inline void forward(const Beam& inputBeam, Beam& outputBeam, Orientation orientation) const;
 	inline void backward(const Beam& outputBeam, Beam& inputBeam, Orientation orientation) const;
+
+private:
+	Matrix m_matrix[2];
 };
 
 /**
@@ -234,6 +257,8 @@ class Dielectric
 public:
 	/// Constructor
 	Dielectric(double indexRatio) : m_indexRatio(indexRatio) {}
+	/// Destructor
+	virtual ~Dielectric() {}
 
 public:
 	/**
@@ -246,6 +271,10 @@ public:
 	/// Set the index jump to @p indexRatio
 	void setIndexRatio(double indexRatio);
 
+protected:
+	/// Called when the index jump changes
+	virtual void indexRatioChanged() {}
+
 private:
 	double m_indexRatio;
 };
@@ -258,13 +287,16 @@ class Interface : public ABCD, public Dielectric
 public:
 	/// Constructor
 	Interface(OpticsType type, double indexRatio, double position, std::string name = "")
-		: ABCD(type, position, name), Dielectric(indexRatio) { setRotable(); }
+		: ABCD(type, position, name), Dielectric(indexRatio) { setRotable(); updateMatrix(); }
 	/// Destructor
 	virtual ~Interface() {}
 
 public:
 	virtual double indexJump() const { return indexRatio(); }
 	virtual double D(Orientation /*orientation*/) const { return 1./indexRatio(); }
+
+protected:
+	virtual void indexRatioChanged() { updateMatrix(); }
 };
 
 /////////////////////////////////////////////////
@@ -312,7 +344,7 @@ class FreeSpace : public ABCD
 public:
 	/// Constructor
 	FreeSpace(double width, double position, std::string name = "")
-		: ABCD(FreeSpaceType, position, name) { setWidth(width); }
+		: ABCD(FreeSpaceType, position, name) { setWidth(width); updateMatrix(); }
 	virtual FreeSpace* clone() const { return new FreeSpace(*this); }
 
 public:
@@ -326,7 +358,7 @@ class Lens : public ABCD
 {
 public:
 	/// Constructor
-	Lens(double focal, double position, std::string name = "") : ABCD(LensType, position, name) , m_focal(focal) {}
+	Lens(double focal, double position, std::string name = "") : ABCD(LensType, position, name) , m_focal(focal) { updateMatrix(); }
 	virtual Lens* clone() const { return new Lens(*this); }
 
 // Inherited
@@ -392,7 +424,7 @@ class CurvedMirror : public FlatMirror
 public:
 	/// Constructor
 	CurvedMirror(double curvatureRadius, double position, std::string name = "")
-		: FlatMirror(position, name), m_curvatureRadius(curvatureRadius) { setType(CurvedMirrorType); }
+		: FlatMirror(position, name), m_curvatureRadius(curvatureRadius) { setType(CurvedMirrorType); updateMatrix(); }
 	virtual CurvedMirror* clone() const { return new CurvedMirror(*this); }
 
 public:
@@ -429,7 +461,7 @@ class CurvedInterface : public Interface
 public:
 	/// Constructor
 	CurvedInterface(double surfaceRadius, double indexRatio, double position, std::string name = "")
-		: Interface(CurvedInterfaceType, indexRatio, position, name), m_surfaceRadius(surfaceRadius) {}
+		: Interface(CurvedInterfaceType, indexRatio, position, name), m_surfaceRadius(surfaceRadius) { updateMatrix(); }
 	virtual CurvedInterface* clone() const { return new CurvedInterface(*this); }
 
 public:
@@ -455,11 +487,14 @@ class DielectricSlab : public ABCD, public Dielectric
 public:
 	/// Constructor
 	DielectricSlab(double indexRatio, double width, double position, std::string name = "")
-		: ABCD(DielectricSlabType, position, name), Dielectric(indexRatio) { setWidth(width); }
+		: ABCD(DielectricSlabType, position, name), Dielectric(indexRatio) { setWidth(width); updateMatrix(); }
 	virtual DielectricSlab* clone() const { return new DielectricSlab(*this); }
 
 public:
 	virtual double B(Orientation /*orientation*/) const { return width()/indexRatio(); }
+
+protected:
+	virtual void indexRatioChanged() { updateMatrix(); }
 };
 
 /**
@@ -27,6 +27,9 @@
 #include <algorithm>
 #include <functional>
 #include <sstream>
+#include <random>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 using namespace Utils;
@@ -111,6 +114,21 @@ OpticsBench::OpticsBench()
 	m_beamSpherical = true;
 	m_fitSpherical = true;
 	m_1D = true;
+	m_sensitivityValid = false;
+	m_beamsRevision = 1;
+	m_magicWaistSeed = 0;
+	m_threadCount = 0;
+	m_magicWaistBudget = 40000;
+	m_modified = false;
+	m_updateDepth = 0;
+	m_pendingChangedIndex = -1;
+	m_pendingSynchronize = false;
+	m_pendingEvents = 0;
+	m_pendingDataStart = -1;
+	m_pendingDataEnd = -1;
+	m_cavityChangedIndex = -1;
+	m_maxWidth = 0.;
+	m_opticsSorted = true;
 
 	resetDefaultValues();
 }
@@ -121,9 +139,7 @@ OpticsBench::~OpticsBench()
 	for (vector<Optics*>::iterator it = m_optics.begin(); it != m_optics.end(); it++)
 		delete (*it);
 
-	// Delelte beams
-	for (vector<Beam*>::iterator it = m_beams.begin(); it != m_beams.end(); it++)
-		delete (*it);
+	// Beams are destroyed with their pool
 }
 
 void OpticsBench::resetDefaultValues()
@@ -140,6 +156,8 @@ void OpticsBench::resetDefaultValues()
 
 void OpticsBench::clear()
 {
+	OpticsBenchUpdate update(*this);
+
 	// Clear objects
 	removeOptics(0, nOptics());
 	removeFits(0, nFit());
@@ -163,7 +181,84 @@ void OpticsBench::setModified(bool modified)
 		return;
 
 	m_modified = modified;
-	emit(onOpticsBenchModified());
+	notify(ModifiedEvent);
+}
+
+void OpticsBench::beginUpdate()
+{
+	m_updateDepth++;
+}
+
+void OpticsBench::endUpdate()
+{
+	if (m_updateDepth > 1)
+	{
+		m_updateDepth--;
+		return;
+	}
+
+	// Propagate once for all the modifications. Its events are merged with the pending ones
+	const int pendingChangedIndex = m_pendingChangedIndex;
+	const bool pendingSynchronize = m_pendingSynchronize;
+	m_pendingChangedIndex = -1;
+	m_pendingSynchronize = false;
+	if ((nOptics() > 0) && ((pendingChangedIndex >= 0) || pendingSynchronize))
+	{
+		int changedIndex = nOptics() - 1;
+		if (pendingChangedIndex >= 0)
+		{
+			changedIndex = pendingChangedIndex;
+			updatePropagationTree(changedIndex);
+		}
+		if (pendingSynchronize)
+			changedIndex = ::min(changedIndex, m_propagationTree.synchronize(m_optics));
+		beamsChanged(changedIndex);
+	}
+	m_updateDepth = 0;
+
+	if (m_pendingDataStart >= 0)
+	{
+		int start = m_pendingDataStart, end = m_pendingDataEnd;
+		m_pendingDataStart = m_pendingDataEnd = -1;
+		notifyDataChanged(start, end);
+	}
+	int events = m_pendingEvents;
+	m_pendingEvents = 0;
+	notify(events);
+}
+
+void OpticsBench::notify(int events)
+{
+	if (m_updateDepth > 0)
+	{
+		m_pendingEvents |= events;
+		return;
+	}
+
+	if (events & WavelengthChangedEvent)
+		emit(onOpticsBenchWavelengthChanged());
+	if (events & BoundariesChangedEvent)
+		emit(onOpticsBenchBoundariesChanged());
+	if (events & TargetBeamChangedEvent)
+		emit(onOpticsBenchTargetBeamChanged());
+	if (events & SphericityChangedEvent)
+		emit(onOpticsBenchSphericityChanged());
+	if (events & DimensionalityChangedEvent)
+		emit(onOpticsBenchDimensionalityChanged());
+	if (events & ModifiedEvent)
+		emit(onOpticsBenchModified());
+}
+
+void OpticsBench::notifyDataChanged(int startOptics, int endOptics)
+{
+	if (m_updateDepth > 0)
+	{
+		m_pendingDataStart = (m_pendingDataStart < 0) ? startOptics : ::min(m_pendingDataStart, startOptics);
+		m_pendingDataEnd = ::max(m_pendingDataEnd, endOptics);
+		return;
+	}
+
+	emit(onOpticsBenchDataChanged(startOptics, endOptics));
 }
 
 bool OpticsBench::isSpherical() const
@@ -184,55 +279,136 @@ void OpticsBench::registerEventListener(OpticsBenchEventListener* listener)
 /////////////////////////////////////////////////
 // Cavity
 
-void OpticsBench::detectCavities()
+// Cells of the uniform grid that indexes the beam segments
+static inline long long cellKey(int x, int y)
+{
+	return (long long)(x)*4294967296LL + (long long)(y);
+}
+
+static inline int cellCoordinate(double x, double cellSize)
+{
+	return int(floor(x/cellSize));
+}
+
+// Add the segment [@p start, @p stop] of beam @p index to all the cells of @p grid that it crosses
+static void addSegment(unordered_map<long long, vector<int> >& grid, double cellSize, int index, const Point& start, const Point& stop)
+{
+	// Cover the segment with steps shorter than a cell, widened by the detection tolerance
+	const double dx = stop.x() - start.x(), dy = stop.y() - start.y();
+	const int nSteps = ::max(1, int(ceil(sqrt(dx*dx + dy*dy)/cellSize)));
+	for (int s = 0; s < nSteps; s++)
+	{
+		const double x1 = start.x() + dx*s/nSteps, x2 = start.x() + dx*(s + 1)/nSteps;
+		const double y1 = start.y() + dy*s/nSteps, y2 = start.y() + dy*(s + 1)/nSteps;
+		for (int x = cellCoordinate(::min(x1, x2) - epsilon, cellSize); x <= cellCoordinate(::max(x1, x2) + epsilon, cellSize); x++)
+			for (int y = cellCoordinate(::min(y1, y2) - epsilon, cellSize); y <= cellCoordinate(::max(y1, y2) + epsilon, cellSize); y++)
+			{
+				vector<int>& cell = grid[cellKey(x, y)];
+				if (cell.empty() || (cell.back() != index))
+					cell.push_back(index);
+			}
+	}
+}
+
+int OpticsBench::nCavities() const
 {
+	detectCavities();
+	return m_cavities.size();
+}
+
+const Cavity& OpticsBench::cavity(int index) const
+{
+	detectCavities();
+	return m_cavities[index];
+}
+
+void OpticsBench::detectCavities() const
+{
+	// Cavities are detected on demand, so that editing the bench does not compute all the beams
+	if (m_cavityChangedIndex < 0)
+		return;
+	const int changedIndex = m_cavityChangedIndex;
+	m_cavityChangedIndex = -1;
+
+	// The cavities closed by an optics before changedIndex are not affected by the change:
+	// they keep their cached eigen modes
+	unsigned int kept = 0;
+	while ((kept < m_cavities.size()) && (m_cavityClosingIndex[kept] < changedIndex))
+		kept++;
+	m_cavities.resize(kept);
+	m_cavityClosingIndex.resize(kept);
+
 	// Cavity detection criterions for a given optics i to close a cavity with a previous beam j
 	// - The optics is on the beam optical axis
 	// - The optics is in the beam range
 	// - The beam is copropagating with the optics image
 	// - The beam is NOT copropagating with the optics antecedent.
-/*
-	cerr << "Detecting cavity" << endl;
-	bool cavityDetected = false;
+	// Only the optics that change the beam direction can close a cavity: mirrors that face the beam.
+	// The beams are only computed for mirrors
+	vector<int> closingOptics;
+	for (int i = ::max(changedIndex, 2); i < nOptics(); i++)
+		if (((m_optics[i]->type() == FlatMirrorType) || (m_optics[i]->type() == CurvedMirrorType)) &&
+		    (fabs(beam(i)->angle() - beam(i-1)->angle()) > epsilon))
+			closingOptics.push_back(i);
+	if (closingOptics.empty())
+		return;
+
+	// Index the segments of the beams that may be closed, in a uniform grid whose cells
+	// have the mean segment length
+	const int nSegments = closingOptics.back() - 1;
+	vector<Point> segmentStart, segmentStop;
+	double totalLength = 0.;
+	for (int j = 0; j < nSegments; j++)
+	{
+		segmentStart.push_back(beam(j)->absoluteCoordinates(beam(j)->start()));
+		segmentStop.push_back(beam(j)->absoluteCoordinates(beam(j)->stop()));
+		totalLength += fabs(beam(j)->stop() - beam(j)->start());
+	}
+	const double cellSize = ::max(totalLength/nSegments, 1e3*epsilon);
+	unordered_map<long long, vector<int> > grid;
+	for (int j = 0; j < nSegments; j++)
+		if (isfinite(segmentStart[j].x()) && isfinite(segmentStart[j].y()) && isfinite(segmentStop[j].x()) && isfinite(segmentStop[j].y()))
+			addSegment(grid, cellSize, j, segmentStart[j], segmentStop[j]);
 
-	for (int i = 2; i < nOptics(); i++)
-		for (int j = 0; j < i-1; j++)
+	for (vector<int>::const_iterator it = closingOptics.begin(); it != closingOptics.end(); it++)
+	{
+		const int i = *it;
+		const Point opticsPoint = beam(i-1)->absoluteCoordinates(m_optics[i]->position());
+		unordered_map<long long, vector<int> >::const_iterator cell =
+			grid.find(cellKey(cellCoordinate(opticsPoint.x(), cellSize), cellCoordinate(opticsPoint.y(), cellSize)));
+		if (cell == grid.end())
+			continue;
+
+		for (vector<int>::const_iterator jt = cell->second.begin(); jt != cell->second.end(); jt++)
 		{
-			Optics* optics = m_optics[i];
-			Beam* beam = m_beams[j];
-			Point opticsCoordinates = beam->beamCoordinates(m_beams[i-1]->absoluteCoordinates(optics->position()));
-			cerr << "Checking cavity " << i << " and " << j << endl;
-			cerr << (fabs(opticsCoordinates.y()) < Utils::epsilon) << endl;
-			cerr << (opticsCoordinates.x() >= beam->start()) << endl;
-			cerr << (opticsCoordinates.x() <= beam->stop()) << endl;
-			cerr << Beam::copropagating(*beam, *m_beams[i]) << endl;
-			cerr << !Beam::copropagating(*beam, *m_beams[i-1]) << endl;
-			if (   (fabs(opticsCoordinates.y()) < Utils::epsilon)
-			    && (opticsCoordinates.x() >= beam->start())
-			    && (opticsCoordinates.x() <= beam->stop())
-			    &&  Beam::copropagating(*beam, *m_beams[i])
-			    && !Beam::copropagating(*beam, *m_beams[i-1]))
+			const int j = *jt;
+			if (j >= i - 1)
+				continue;
+
+			const Beam* closedBeam = beam(j);
+			Point opticsCoordinates = closedBeam->beamCoordinates(opticsPoint);
+			if (   (fabs(opticsCoordinates.y()) < epsilon)
+			    && (opticsCoordinates.x() >= closedBeam->start())
+			    && (opticsCoordinates.x() <= closedBeam->stop())
+			    &&  Beam::copropagating(*closedBeam, *beam(i))
+			    && !Beam::copropagating(*closedBeam, *beam(i-1)))
 			{
-				cavityDetected = true;
 				Cavity cavity;
 				for (int o = j + 1; o <= i; o++)
-				{
 					if (m_optics[o]->isABCD())
-					{
-						cavity.addOptics(dynamic_cast<ABCD*>(m_optics[o]));
-						cerr << "   adding optics " << o << endl;
-					}
-				}
-				cerr << m_optics[j]->position() << " - " << opticsCoordinates.x() << endl;
-				double closingFreeSpace = m_optics[j+1]->position() - opticsCoordinates.x();
-				cerr << closingFreeSpace << endl;
-				cavity.setClosingFreeSpace(closingFreeSpace);
-				cerr << " Detected cavity around beams " << i << " and " << j << endl;
-				cerr << "Stability : " << cavity.isStable() << endl;
-				cerr << "EigenBeam : " << *cavity.eigenBeam(wavelength(), 0) << endl;
+						cavity.addOptics(dynamic_cast<const ABCD*>(m_optics[o]));
+				cavity.setClosingFreeSpace(m_optics[j+1]->position() - opticsCoordinates.x() - m_optics[i]->width());
+				m_cavities.push_back(cavity);
+				m_cavityClosingIndex.push_back(i);
 			}
 		}
-*/
+	}
+}
+
+void OpticsBench::cavitiesChanged(int changedIndex)
+{
+	// Also called during updates: the cavities closed after changedIndex may point to removed optics
+	m_cavityChangedIndex = (m_cavityChangedIndex < 0) ? changedIndex : ::min(m_cavityChangedIndex, changedIndex);
 }
 
 /////////////////////////////////////////////////
@@ -251,7 +427,7 @@ void OpticsBench::checkFitSpherical()
 	bool wasSpherical = isSpherical();
 	m_fitSpherical = spherical;
 	if (wasSpherical ^ isSpherical())
-		emit(onOpticsBenchSphericityChanged());
+		notify(SphericityChangedEvent);
 }
 
 int OpticsBench::nFit() const
@@ -271,7 +447,7 @@ Fit* OpticsBench::addFit(unsigned int index, int nData)
 				minFit = n;
 		}
 	stringstream stream;
-	stream << "Fit" << minFit + 1 << ends;
+	stream << "Fit" << minFit + 1;
 	string name;
 	stream >> name;
 
@@ -280,6 +456,7 @@ Fit* OpticsBench::addFit(unsigned int index, int nData)
 	fit->setName(name);
 	fit->changed.connect(this, &OpticsBench::notifyFitChanged);
 	m_fits.insert(m_fits.begin() + index, fit);
+	updateFitIndex(index);
 	checkFitSpherical();
 
 	emit(onOpticsBenchFitAdded(index));
@@ -296,6 +473,14 @@ Fit* OpticsBench::fit(unsigned int index)
 	return 0;
 }
 
+const Fit* OpticsBench::fit(unsigned int index) const
+{
+	if (index < m_fits.size())
+		return m_fits[index];
+
+	return 0;
+}
+
 void OpticsBench::removeFit(unsigned int index)
 {
 	removeFits(index, 1);
@@ -303,23 +488,26 @@ void OpticsBench::removeFit(unsigned int index)
 
 void OpticsBench::removeFits(unsigned int startIndex, int n)
 {
+	for (unsigned int i = startIndex; i < startIndex + n; i++)
+		m_fitIndex.erase(m_fits[i]);
 	m_fits.erase(m_fits.begin() + startIndex, m_fits.begin() + startIndex + n);
+	updateFitIndex(startIndex);
 	checkFitSpherical();
 
 	emit(onOpticsBenchFitsRemoved(startIndex, n));
 	setModified(true);
 }
 
-void OpticsBench::notifyFitChanged(Fit* fit)
+void OpticsBench::updateFitIndex(int start)
 {
-	int index = 0;
+	for (int i = start; i < nFit(); i++)
+		m_fitIndex[m_fits[i]] = i;
+}
 
-	for (vector<Fit*>::iterator it = m_fits.begin(); it != m_fits.end(); it++)
-		if ((*it) == fit)
-		{
-			index = it - m_fits.begin();
-			break;
-		}
+void OpticsBench::notifyFitChanged(Fit* fit)
+{
+	unordered_map<const Fit*, int>::const_iterator it = m_fitIndex.find(fit);
+	const int index = (it != m_fitIndex.end()) ? it->second : 0;
 
 	checkFitSpherical();
 
@@ -337,7 +525,7 @@ void OpticsBench::setWavelength(double wavelength)
 	setTargetBeam(m_targetBeam);
 	computeBeams();
 
-	emit(onOpticsBenchWavelengthChanged());
+	notify(WavelengthChangedEvent);
 	setModified(true);
 }
 
@@ -348,7 +536,7 @@ void OpticsBench::setLeftBoundary(double leftBoundary)
 
 	updateExtremeBeams();
 
-	emit(onOpticsBenchBoundariesChanged());
+	notify(BoundariesChangedEvent);
 	setModified(true);
 }
 
@@ -359,7 +547,7 @@ void OpticsBench::setRightBoundary(double rightBoundary)
 
 	updateExtremeBeams();
 
-	emit(onOpticsBenchBoundariesChanged());
+	notify(BoundariesChangedEvent);
 	setModified(true);
 }
 
@@ -368,10 +556,9 @@ void OpticsBench::setRightBoundary(double rightBoundary)
 
 int OpticsBench::opticsIndex(const Optics* optics) const
 {
-	/// @todo implement a lookup table
-	for (vector<Optics*>::const_iterator it = m_optics.begin(); it != m_optics.end(); it++)
-		if (*it == optics)
-			return it - m_optics.begin();
+	unordered_map<const Optics*, int>::const_iterator it = m_opticsIndex.find(optics);
+	if (it != m_opticsIndex.end())
+		return it->second;
 
 	cerr << "Error : looking for an optics that is no more in the optics list" << endl;
 	return -1;
@@ -383,7 +570,13 @@ void OpticsBench::addOptics(Optics* optics, int index)
 	m_opticsTree.insert(m_opticsTree.begin() + index, OpticsTreeItem(optics, parent));
 */
 	m_optics.insert(m_optics.begin() + index,  optics);
-	m_beams.insert(m_beams.begin() + index, new Beam(wavelength()));
+	updateOpticsIndex(index, nOptics());
+	opticsWidthChanged(index);
+	if (((index > 1) && less<Optics*>()(optics, m_optics[index - 1])) ||
+	    ((index > 0) && (index + 1 < nOptics()) && less<Optics*>()(m_optics[index + 1], optics)))
+		m_opticsSorted = false;
+	m_beams.insert(m_beams.begin() + index, m_beamPool.create(Beam(wavelength())));
+	m_beamRevision.insert(m_beamRevision.begin() + index, 0);
 
 	emit(onOpticsBenchOpticsAdded(index));
 	computeBeams(index);
@@ -401,7 +594,7 @@ void OpticsBench::addOptics(OpticsType opticsType, int index)
 				minOptics = n;
 		}
 	stringstream stream;
-	stream << m_opticsPrefix[opticsType] << minOptics + 1 << ends;
+	stream << m_opticsPrefix[opticsType] << minOptics + 1;
 	string name;
 	stream >> name;
 
@@ -440,16 +633,47 @@ void OpticsBench::removeOptics(int index, int count)
 {
 	for (int i = index; i < index + count; i++)
 	{
+		for (int v = nDesignVariables() - 1; v >= 0; v--)
+			if (m_designVariableOptics[v] == m_optics[index])
+			{
+				m_designVariables.erase(m_designVariables.begin() + v);
+				m_designVariableOptics.erase(m_designVariableOptics.begin() + v);
+			}
+		m_opticsIndex.erase(m_optics[index]);
 		delete m_optics[index];
 		m_optics.erase(m_optics.begin() + index);
-		delete m_beams[index];
+		m_beamPool.release(m_beams[index]);
 		m_beams.erase(m_beams.begin() + index);
+		m_beamRevision.erase(m_beamRevision.begin() + index);
+	}
+	updateOpticsIndex(index, nOptics());
+	if (nOptics() <= 1)
+	{
+		m_maxWidth = 0.;
+		m_opticsSorted = true;
 	}
 
 	emit(onOpticsBenchOpticsRemoved(index, count));
 	computeBeams(index);
 }
 
+// Comparison function for upper_bound on optics sorted by position
+static bool startsAfter(double position, const Optics* optics)
+{
+	return position < optics->position();
+}
+
+// @return true if @p optics overlaps with the interval [@p start, @p stop]
+static bool overlaps(const Optics* optics, double start, double stop)
+{
+	double start2 = optics->position();
+	double stop2  = optics->endPosition();
+	return ((start2 >= start) && (start2 <= stop)) ||
+	       ((stop2  >= start) && (stop2  <= stop)) ||
+	       ((start  >= start2) && (start  <= stop2)) ||
+	       ((stop   >= start2) && (stop   <= stop2));
+}
+
 int OpticsBench::setOpticsPosition(int index, double position)
 {
 	Optics* movedOptics = m_optics[index];
@@ -460,31 +684,102 @@ int OpticsBench::setOpticsPosition(int index, double position)
 		return index;
 
 	// Check that the optics does not overlap with another optics
-	double start1 = position;
-	double stop1  = position + movedOptics->width();
-	for (vector<Optics*>::iterator it = m_optics.begin(); it != m_optics.end(); it++)
-		if ((*it) != movedOptics)
+	if (collides(movedOptics, position, position + movedOptics->width()))
+		return index;
+
+	// Move the optics. Only the moved optics have to be updated in the propagation tree
+	const double oldPosition = movedOptics->position();
+	movedOptics->setPosition(position, true);
+	int first = index, last = index;
+	bool resorted = false;
+	if (movedOptics->position() != oldPosition)
+	{
+		if (!m_opticsSorted || movedOptics->relativeLockParent() || !movedOptics->relativeLockChildren().empty())
 		{
-			double start2 = (*it)->position();
-			double stop2  = (*it)->endPosition();
-			if (((start2 >= start1) && (start2 <= stop1)) ||
-				((stop2  >= start1) && (stop2  <= stop1)) ||
-				((start1 >= start2) && (start1 <= stop2)) ||
-				((stop1  >= start2) && (stop1  <= stop2)))
-				return index;
+			// The whole locking tree moved, or the optics were inserted out of order: the slot
+			// search below requires sorted optics
+			sortOptics();
+			resorted = true;
 		}
+		else if ((index > 0) && (index + 1 < nOptics()) && less<Optics*>()(m_optics[index + 1], movedOptics))
+		{
+			// The other optics are still sorted: rotate the moved optics to its new slot
+			vector<Optics*>::iterator slot = lower_bound(m_optics.begin() + index + 1, m_optics.end(), movedOptics, less<Optics*>());
+			rotate(m_optics.begin() + index, m_optics.begin() + index + 1, slot);
+			last = slot - m_optics.begin() - 1;
+			updateOpticsIndex(first, last + 1);
+		}
+		else if ((index > 1) && less<Optics*>()(movedOptics, m_optics[index - 1]))
+		{
+			vector<Optics*>::iterator slot = upper_bound(m_optics.begin() + 1, m_optics.begin() + index, movedOptics, less<Optics*>());
+			rotate(slot, m_optics.begin() + index, m_optics.begin() + index + 1);
+			first = slot - m_optics.begin();
+			updateOpticsIndex(first, last + 1);
+		}
+	}
 
-	// Move the optics
-	m_optics[index]->setPosition(position, true);
-	sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
-	computeBeams();
+	if (m_updateDepth > 0)
+	{
+		m_pendingSynchronize = true;
+		m_beamsRevision++;
+		m_sensitivityValid = false;
+		cavitiesChanged(resorted ? 1 : first);
+	}
+	else if (resorted || (m_propagationTree.size() != nOptics()))
+		beamsChanged(::min(m_propagationTree.synchronize(m_optics), nOptics() - 1));
+	else
+	{
+		// Only the optics between the old and new index changed index
+		for (int i = first; i <= last; i++)
+			m_propagationTree.update(i, m_optics[i]);
+		beamsChanged(first);
+	}
 
 	// Return the new index of the optics
-	for (vector<Optics*>::iterator it = m_optics.begin(); it != m_optics.end(); it++)
-		if ((*it) == movedOptics)
-			return it - m_optics.begin();
+	return opticsIndex(movedOptics);
+}
+
+bool OpticsBench::collides(const Optics* optics, double start, double stop) const
+{
+	if ((m_optics[0] != optics) && overlaps(m_optics[0], start, stop))
+		return true;
+
+	// Optics inserted out of order by addOptics are all checked
+	if (!m_opticsSorted)
+	{
+		for (int i = 1; i < nOptics(); i++)
+			if ((m_optics[i] != optics) && overlaps(m_optics[i], start, stop))
+				return true;
+		return false;
+	}
+
+	// The optics are sorted by position, and are at most m_maxWidth wide: only the optics starting
+	// within [start - m_maxWidth, stop] may overlap with [start, stop]. Optics may overlap each other,
+	// e.g. when loaded from a file or moved with their lock tree, so that all of them are checked
+	for (int i = upper_bound(m_optics.begin() + 1, m_optics.end(), stop, startsAfter) - m_optics.begin() - 1;
+	     (i > 0) && (m_optics[i]->position() + m_maxWidth >= start); i--)
+		if ((m_optics[i] != optics) && overlaps(m_optics[i], start, stop))
+			return true;
+
+	return false;
+}
 
-	return index;
+void OpticsBench::opticsWidthChanged(int index)
+{
+	m_maxWidth = ::max(m_maxWidth, m_optics[index]->width());
+}
+
+void OpticsBench::sortOptics()
+{
+	sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
+	updateOpticsIndex(1, nOptics());
+	m_opticsSorted = true;
+}
+
+void OpticsBench::updateOpticsIndex(int start, int end)
+{
+	for (int i = start; i < end; i++)
+		m_opticsIndex[m_optics[i]] = i;
 }
 
 void OpticsBench::printTree()
@@ -503,9 +798,10 @@ void OpticsBench::printTree()
 	}
 }
 
-void OpticsBench::opticsPropertyChanged(int /*index*/)
+void OpticsBench::opticsPropertyChanged(int index)
 {
-	computeBeams();
+	opticsWidthChanged(index);
+	computeBeams(index);
 }
 
 /////////////////////////////////////////////////
@@ -513,9 +809,43 @@ void OpticsBench::opticsPropertyChanged(int /*index*/)
 
 const Beam* OpticsBench::beam(int index) const
 {
+	// Beams are computed on demand
+	if (m_beamRevision[index] != m_beamsRevision)
+		updateBeam(index);
+
 	return m_beams[index];
 }
 
+void OpticsBench::updateBeam(int index) const
+{
+	int first = index;
+
+	// During an update, the propagation tree is only synchronized with the optics by endUpdate()
+	if (m_propagationTree.isValid() && (m_pendingChangedIndex < 0) && !m_pendingSynchronize)
+		*m_beams[index] = m_propagationTree.beam(index);
+	else
+	{
+		// Propagate from the last up to date beam
+		while ((first > 0) && (m_beamRevision[first-1] != m_beamsRevision))
+			first--;
+		for (int i = first; i <= index; i++)
+			*m_beams[i] = m_optics[i]->image(i == 0 ? Beam(wavelength()) : *m_beams[i-1]);
+	}
+
+	for (int i = first; i <= index; i++)
+	{
+		if (i == 0)
+			m_beams[i]->setStart(m_beams[i]->rectangleIntersection(m_boundary)[0]);
+		else
+			m_beams[i]->setStart(m_optics[i]->position() + m_optics[i]->width());
+		if (i == nOptics()-1)
+			m_beams[i]->setStop(m_beams[i]->rectangleIntersection(m_boundary)[1]);
+		else
+			m_beams[i]->setStop(m_optics[i+1]->position());
+		m_beamRevision[i] = m_beamsRevision;
+	}
+}
+
 void OpticsBench::setInputBeam(const Beam& beam)
 {
 	if (m_optics.size() == 0)
@@ -542,16 +872,23 @@ const Beam* OpticsBench::axis(int index) const
 
 double OpticsBench::sensitivity(int index) const
 {
+	// Sensitivities are only computed when needed, and kept until the next change of the beams
+	if (!m_sensitivityValid)
+	{
+		OpticsFunction function(m_optics, m_wavelength);
+		function.setOverlapBeam(*beam(nOptics()-1));
+		function.setCheckLock(false);
+		m_sensitivity = function.curvature(function.currentPosition())/2.;
+		m_sensitivityValid = true;
+	}
+
 	return m_sensitivity[index];
 }
 
 void OpticsBench::updateExtremeBeams()
 {
-	if (nOptics() > 0)
-	{
-		m_beams[0]->setStart(m_beams[0]->rectangleIntersection(m_boundary)[0]);
-		m_beams[nOptics()-1]->setStop(m_beams[nOptics()-1]->rectangleIntersection(m_boundary)[1]);
-	}
+	// The extreme beams are bounded when they are computed
+	m_beamsRevision++;
 
 	vector<double> targetBoundaries = m_targetBeam.rectangleIntersection(m_boundary);
 	m_targetBeam.setStart(targetBoundaries[0]);
@@ -565,75 +902,72 @@ void OpticsBench::computeBeams(int changedIndex, bool backwards)
 
 	if (backwards)
 	{
-		for (int i = changedIndex + 1; i < nOptics(); i++)
-			*m_beams[i] = m_optics[i]->image(*m_beams[i-1]);
-		for (int i = changedIndex - 1; i >= 0; i--)
-			*m_beams[i] = m_optics[i+1]->antecedent(*m_beams[i+1]);
+		// Find the input beam that produces the beam set at changedIndex
+		Beam beam = *m_beams[changedIndex];
+		for (int i = changedIndex; i > 0; i--)
+			beam = m_optics[i]->antecedent(beam);
 		CreateBeam* createBeam = dynamic_cast<CreateBeam*>(m_optics[0]);
-		createBeam->setBeam(*m_beams[0]);
-	}
-	else
-	{
-		if (changedIndex == 0)
-		{
-			Beam beam(wavelength());
-			*m_beams[0] = m_optics[0]->image(beam);
-		}
-
-		for (int i = ::max(changedIndex, 1); i < nOptics(); i++)
-			*m_beams[i] = m_optics[i]->image(*m_beams[i-1]);
+		createBeam->setBeam(beam);
+		changedIndex = 0;
 	}
 
-	for (int i = 0; i < nOptics(); i++)
+	if (m_updateDepth > 0)
 	{
-		if (i != 0)
-			m_beams[i]->setStart(m_optics[i]->position() + m_optics[i]->width());
-		if (i < nOptics()-1)
-			m_beams[i]->setStop(m_optics[i+1]->position());
+		// Only invalidate the beams: they are propagated by endUpdate()
+		m_pendingChangedIndex = (m_pendingChangedIndex < 0) ? changedIndex : ::min(m_pendingChangedIndex, changedIndex);
+		m_beamsRevision++;
+		m_sensitivityValid = false;
+		cavitiesChanged(changedIndex);
+		return;
 	}
-	updateExtremeBeams();
 
-	OpticsFunction function(m_optics, m_wavelength);
-	function.setOverlapBeam(*m_beams.back());
-	function.setCheckLock(false);
+	updatePropagationTree(changedIndex);
+	beamsChanged(changedIndex);
+}
 
-	m_sensitivity = function.curvature(function.currentPosition())/2.;
+void OpticsBench::updatePropagationTree(int changedIndex)
+{
+	if ((changedIndex == 0) || (m_propagationTree.size() != nOptics()))
+		m_propagationTree.build(m_optics, m_wavelength);
+	else
+		for (int i = changedIndex; i < nOptics(); i++)
+			m_propagationTree.update(i, m_optics[i]);
+}
+
+void OpticsBench::beamsChanged(int changedIndex)
+{
+	// Beams are recomputed on demand, see beam()
+	updateExtremeBeams();
+	m_sensitivityValid = false;
 
-	bool spherical = true;
-	for (int i = 0; i < nOptics(); i++)
-		if (m_optics[i]->orientation() != Spherical)
-		{
-			spherical = false;
-			break;
-		}
 	bool wasSpherical = isSpherical();
-	m_beamSpherical = spherical;
+	m_beamSpherical = m_propagationTree.isSpherical();
 
 	bool oneD = true;
-	for (int i = 0; i < nOptics(); i++)
-	{
-		double angle = fmod(fabs(m_beams[i]->angle()), M_PI);
-		if ((angle > Utils::epsilon) && (angle < M_PI - Utils::epsilon))
+	if (m_propagationTree.isValid())
+		oneD = m_propagationTree.is1D();
+	else
+		for (int i = 0; i < nOptics(); i++)
 		{
-			oneD = false;
-			break;
+			double angle = fmod(fabs(beam(i)->angle()), M_PI);
+			if ((angle > Utils::epsilon) && (angle < M_PI - Utils::epsilon))
+			{
+				oneD = false;
+				break;
+			}
 		}
-	}
 	bool was1D = is1D();
 	m_1D = oneD;
 
-	detectCavities();
+	cavitiesChanged(changedIndex);
 
 	if (wasSpherical ^ isSpherical())
-		emit(onOpticsBenchSphericityChanged());
+		notify(SphericityChangedEvent);
 
 	if (was1D ^ is1D())
-		emit(onOpticsBenchDimensionalityChanged());
+		notify(DimensionalityChangedEvent);
 
-	if (backwards)
-		emit(onOpticsBenchDataChanged(0, nOptics()-1));
-	else
-		emit(onOpticsBenchDataChanged(changedIndex, nOptics()-1));
+	notifyDataChanged(changedIndex, nOptics()-1);
 
 	setModified(true);
 }
@@ -646,6 +980,7 @@ pair<Beam*, double> OpticsBench::closestPosition(const Point& point, int prefere
 
 	for (int i = 0; i < nOptics(); i++)
 	{
+		beam(i);
 		Point coord = m_beams[i]->beamCoordinates(point);
 		double newDistance = coord.y();
 
@@ -681,10 +1016,10 @@ void OpticsBench::setTargetBeam(const Beam& beam)
 	if ((m_targetBeam.orientation() == Ellipsoidal) && (m_targetOrientation == Spherical))
 	{
 		m_targetOrientation = m_targetBeam.orientation();
-		emit(onOpticsBenchSphericityChanged());
+		notify(SphericityChangedEvent);
 	}
 
-	emit(onOpticsBenchTargetBeamChanged());
+	notify(TargetBeamChangedEvent);
 
 	setModified(true);
 }
@@ -692,7 +1027,7 @@ void OpticsBench::setTargetBeam(const Beam& beam)
 void OpticsBench::setTargetOverlap(double targetOverlap)
 {
 	m_targetOverlap = targetOverlap;
-	emit(onOpticsBenchTargetBeamChanged());
+	notify(TargetBeamChangedEvent);
 
 	setModified(true);
 }
@@ -711,67 +1046,191 @@ void OpticsBench::setTargetOrientation(Orientation orientation)
 	bool wasSpherical = isSpherical();
 	m_targetOrientation = orientation;
 	if (wasSpherical ^ isSpherical())
-		emit(onOpticsBenchSphericityChanged());
+		notify(SphericityChangedEvent);
 
-	emit(onOpticsBenchTargetBeamChanged());
+	notify(TargetBeamChangedEvent);
 
 	setModified(true);
 }
 
 bool OpticsBench::magicWaist()
 {
+	random_device device;
+	return magicWaist(device());
+}
+
+bool OpticsBench::magicWaist(unsigned int seed)
+{
+	m_magicWaistSeed = seed;
+
 	OpticsFunction function(m_optics, m_wavelength);
 	function.setOverlapBeam(m_targetBeam);
 	function.setCheckLock(true);
+	function.setBoundary(m_boundary.x1(), m_boundary.x2());
+	addDesignVariables(function);
+
+	const int n = nOptics();
+	const vector<double> startPositions = function.currentPosition();
 
+	// The variables are the positions of the roots of the lock trees that can move, followed by the design variables.
+	// Moving a root moves its whole tree
 	vector<int> opticsMovable;
-	for (int i = 0; i < nOptics(); i++)
+	vector<vector<int> > members;
+	vector<double> minPos, maxPos;
+	for (int i = 0; i < n; i++)
 		if (!optics(i)->absoluteLock() && !optics(i)->relativeLockParent())
+		{
 			opticsMovable.push_back(i);
+			members.push_back(vector<int>());
+			minPos.push_back(m_boundary.x1());
+			maxPos.push_back(m_boundary.x2());
+		}
 
-	if (opticsMovable.empty())
-		return false;
-
-	const int nTry = 500000;
-	bool found = false;
+	for (int i = 0; i < n; i++)
+	{
+		const Optics* root = optics(i);
+		while (root->relativeLockParent())
+			root = root->relativeLockParent();
+		const int v = find(opticsMovable.begin(), opticsMovable.end(), opticsIndex(root)) - opticsMovable.begin();
+		if (v == int(opticsMovable.size()))
+			continue;
+		// The whole tree stays within the boundary
+		const double offset = startPositions[i] - startPositions[opticsMovable[v]];
+		members[v].push_back(i);
+		minPos[v] = ::max(minPos[v], m_boundary.x1() - offset);
+		maxPos[v] = ::min(maxPos[v], m_boundary.x2() - offset - optics(i)->width());
+	}
 
-	/// @bug this has to change !
-	const double minPos = m_boundary.x1();
-	const double maxPos = m_boundary.x2();
+	// Design variables are searched within their bounds. Unbounded sides extend by the magnitude of the current value
+	const int nRoots = opticsMovable.size();
+	vector<int> layoutIndex = opticsMovable;
+	for (int v = 0; v < nDesignVariables(); v++)
+	{
+		const DesignVariable& variable = m_designVariables[v];
+		const double current = startPositions[n + v];
+		const double extent = (current == 0.) ? 1. : fabs(current);
+		layoutIndex.push_back(n + v);
+		minPos.push_back(::max(std::isinf(variable.lower) ? current - extent : variable.lower, variable.minimum()));
+		maxPos.push_back(std::isinf(variable.upper) ? current + extent : variable.upper);
+	}
 
-	vector<double> positions = function.currentPosition();
+	if (layoutIndex.empty())
+		return false;
 
-	for (int i = 0; i < nTry; i++)
+	// Differential evolution (DE/current-to-best/1/bin) of independent populations, run in parallel.
+	// Each population evaluates its generations as a batch, with its own random sequence derived from the seed.
+	// The retained layout is the best one of the first population reaching the target overlap, or the best
+	// of all populations: it only depends on the seed, and not on the number of threads nor on their scheduling.
+	const int nVariables = layoutIndex.size();
+	const int nPopulation = 8;
+	const int populationSize = ::max(16, ::min(64, 8*nVariables));
+	const int budget = ::max(m_magicWaistBudget/nPopulation, 2*populationSize);
+	const double scale = 0.7;
+	const double crossover = 0.9;
+	const double targetOverlap = m_targetOverlap;
+
+	atomic<int> nextPopulation(0);
+	atomic<int> foundPopulation(nPopulation); // First population that reached the target overlap
+	vector<vector<double> > populationBest(nPopulation);
+	vector<double> populationOverlap(nPopulation, 0.);
+
+	auto evolve = [&]()
 	{
-		/// @todo find a suitable RNG
-		// Randomly moves a random optics
-		int index = rand() % nOptics();
-		double position = double(rand())/double(RAND_MAX)*(maxPos - minPos) + minPos;
-		positions[index] = position;
-//		positions = function.localMaximum(positions);
-
-		/// @bug 2D magic waist
-		// Check waist
-		Beam beam = function.beam(positions);
-		if (Beam::overlap(beam, m_targetBeam) > m_targetOverlap)
+		// OpticsFunction is not reentrant: use one copy per thread
+		OpticsFunction threadFunction(function);
+
+		for (int population = nextPopulation++; population < foundPopulation; population = nextPopulation++)
 		{
-			cerr << "found waist : " << beam << " // try = " << i << endl;
-			found = true;
-			break;
-		}
-	}
+			// mt19937 and seed_seq are fully specified by the standard, so that a seed
+			// gives the same sequence on all platforms. The distributions are not: do not use them
+			seed_seq seedSequence{seed, (unsigned int)population};
+			mt19937 generator(seedSequence);
+			auto uniform = [&generator]() { return double(generator())/4294967296.; };
+			// Set variable @p v, moving the whole tree of root variables
+			auto place = [&](vector<double>& layout, int v, double position)
+			{
+				if (v >= nRoots)
+				{
+					layout[layoutIndex[v]] = position;
+					return;
+				}
+				const double shift = position - startPositions[opticsMovable[v]];
+				for (vector<int>::const_iterator it = members[v].begin(); it != members[v].end(); it++)
+					layout[*it] = startPositions[*it] + shift;
+			};
+
+			// Random initial layouts
+			vector<vector<double> > layouts(populationSize, startPositions), trials(populationSize, startPositions);
+			for (int m = 0; m < populationSize; m++)
+				for (int v = 0; v < nVariables; v++)
+					place(layouts[m], v, minPos[v] + uniform()*(maxPos[v] - minPos[v]));
+			vector<double> overlaps = threadFunction.values(layouts);
+			int evaluations = populationSize;
+			int best = max_element(overlaps.begin(), overlaps.end()) - overlaps.begin();
+
+			while ((overlaps[best] <= targetOverlap) && (evaluations + populationSize <= budget) && (population < foundPopulation))
+			{
+				for (int m = 0; m < populationSize; m++)
+				{
+					int r1, r2;
+					do r1 = generator() % populationSize; while (r1 == m);
+					do r2 = generator() % populationSize; while ((r2 == m) || (r2 == r1));
+					const int forced = generator() % nVariables;
+					for (int v = 0; v < nVariables; v++)
+					{
+						const int i = layoutIndex[v];
+						const double parent = layouts[m][i];
+						double position = parent;
+						if ((v == forced) || (uniform() < crossover))
+							position += scale*(layouts[best][i] - parent) + scale*(layouts[r1][i] - layouts[r2][i]);
+						// Positions out of range go halfway between the parent and the range limit
+						if (position < minPos[v])
+							position = 0.5*(parent + minPos[v]);
+						else if (position > maxPos[v])
+							position = 0.5*(parent + maxPos[v]);
+						place(trials[m], v, position);
+					}
+				}
 
-	positions = function.localMaximum(positions);
+				const vector<double> trialOverlaps = threadFunction.values(trials);
+				evaluations += populationSize;
+				for (int m = 0; m < populationSize; m++)
+					if (trialOverlaps[m] >= overlaps[m])
+					{
+						layouts[m].swap(trials[m]);
+						overlaps[m] = trialOverlaps[m];
+						if (overlaps[m] > overlaps[best])
+							best = m;
+					}
+			}
 
-	if (found)
-	{
-		for (unsigned int i = 0; i < positions.size(); i++)
-			m_optics[i]->setPosition(positions[i], true);
-		sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
-		computeBeams();
-    }
-	else
-		cerr << "Beam not found !!!" << endl;
+			populationBest[population] = layouts[best];
+			populationOverlap[population] = overlaps[best];
+
+			// Stop the search in later populations
+			if (overlaps[best] > targetOverlap)
+				for (int current = foundPopulation; (population < current) && !foundPopulation.compare_exchange_weak(current, population);) {}
+		}
+	};
+
+	const int nThreads = ::max(1, ::min(m_threadCount > 0 ? m_threadCount : int(thread::hardware_concurrency()), nPopulation));
+	vector<thread> workers;
+	for (int i = 1; i < nThreads; i++)
+		workers.push_back(thread(evolve));
+	evolve();
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++)
+		it->join();
+
+	int retained = foundPopulation;
+	if (retained == nPopulation)
+		retained = max_element(populationOverlap.begin(), populationOverlap.end()) - populationOverlap.begin();
+
+	// Refine the retained layout, which is applied even if it does not reach the target overlap
+	vector<double> positions = function.localMaximum(populationBest[retained]);
+	if (function.value(positions) < populationOverlap[retained])
+		positions = populationBest[retained];
+	const bool found = function.value(positions) > targetOverlap;
+	applyLayout(positions);
 
 	return found;
 }
@@ -781,15 +1240,62 @@ bool OpticsBench::localOptimum()
 	OpticsFunction function(m_optics, m_wavelength);
 	function.setOverlapBeam(m_targetBeam);
 	function.setCheckLock(true);
+	function.setBoundary(m_boundary.x1(), m_boundary.x2());
+	addDesignVariables(function);
 	vector<double> positions = function.localMaximum(function.currentPosition());
 
 	if (!function.optimizationSuccess())
 		return false;
 
-	for (unsigned int i = 0; i < positions.size(); i++)
-		m_optics[i]->setPosition(positions[i], true);
-	sort(m_optics.begin() + 1, m_optics.end(), less<Optics*>());
-	computeBeams();
+	applyLayout(positions);
+
+	return true;
+}
+
+bool OpticsBench::addDesignVariable(const DesignVariable& variable)
+{
+	if ((variable.optics < 0) || (variable.optics >= nOptics()) || !variable.appliesTo(optics(variable.optics)))
+		return false;
+
+	m_designVariables.push_back(variable);
+	m_designVariableOptics.push_back(optics(variable.optics));
 
 	return true;
 }
+
+DesignVariable OpticsBench::designVariable(int index) const
+{
+	DesignVariable variable = m_designVariables[index];
+	variable.optics = opticsIndex(m_designVariableOptics[index]);
+
+	return variable;
+}
+
+void OpticsBench::clearDesignVariables()
+{
+	m_designVariables.clear();
+	m_designVariableOptics.clear();
+}
+
+void OpticsBench::addDesignVariables(OpticsFunction& function) const
+{
+	for (int v = 0; v < nDesignVariables(); v++)
+		function.addVariable(designVariable(v));
+}
+
+void OpticsBench::applyLayout(const vector<double>& layout)
+{
+	// The optics properties are set before the positions, as widths change the space taken by the optics
+	const int n = nOptics();
+	for (int v = 0; (v < nDesignVariables()) && (n + v < int(layout.size())); v++)
+	{
+		const int index = opticsIndex(m_designVariableOptics[v]);
+		m_designVariables[v].setValue(m_optics[index], layout[n + v]);
+		opticsWidthChanged(index);
+	}
+
+	for (int i = 0; i < n; i++)
+		m_optics[i]->setPosition(layout[i], true);
+	sortOptics();
+	computeBeams();
+}
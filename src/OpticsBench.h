@@ -21,12 +21,16 @@
 
 #include "GaussianBeam.h"
 #include "Optics.h"
+#include "OpticsFunction.h"
 #include "Cavity.h"
 #include "Utils.h"
+#include "PropagationTree.h"
+#include "ObjectPool.h"
 
 #include <vector>
 #include <list>
 #include <map>
+#include <unordered_map>
 
 /*
 * OpticsTreeItem
@@ -114,6 +118,21 @@ public:
 	/// Set the modification status
 	void setModified(bool modified);
 
+	// Update transactions
+
+	/**
+	* Start a sequence of modifications of the bench. Until the matching endUpdate(), beams are
+	* only propagated when queried, and listeners only receive the events that change the structure
+	* of the bench (optics and fits added or removed). Calls can be nested.
+	* @see OpticsBenchUpdate
+	*/
+	void beginUpdate();
+	/**
+	* End a sequence of modifications started with beginUpdate(). The outermost call propagates
+	* the beams once for all the modifications, and sends each pending event once to the listeners.
+	*/
+	void endUpdate();
+
 	// Properties
 
 	/// @return the bench wavelength
@@ -145,7 +164,7 @@ public:
 	/// @return the number of optics in the bench
 	int nOptics() const { return m_optics.size(); }
 	/**
-	* @return the sorted index of optics @p optics in the optics bench
+	* @return the sorted index of optics @p optics in the optics bench, in constant time
 	* This index may change when an optics position is changed
 	*/
 	int opticsIndex(const Optics* optics) const;
@@ -183,19 +202,21 @@ public:
 	/// Beams handling
 	const Beam* beam(int index) const;
 	void setBeam(const Beam& beam, int index);
-	const Beam* inputBeam() const { return m_beams[0]; }
+	const Beam* inputBeam() const { return beam(0); }
 	void setInputBeam(const Beam& beam);
 	const Beam* axis(int index) const;
 	std::pair<Beam*, double> closestPosition(const Utils::Point& point, int preferedSide = 1) const;
 	double sensitivity(int index) const;
 
-	/// Cavity
-	Cavity& cavity() { return m_cavity; }
+	/// Cavities, detected on demand after the beams change
+	int nCavities() const;
+	const Cavity& cavity(int index) const;
 
 	/// Waist fit
 	int nFit() const;
 	Fit* addFit(unsigned int index, int nData = 0);
 	Fit* fit(unsigned int index);
+	const Fit* fit(unsigned int index) const;
 	void removeFit(unsigned int index);
 	void removeFits(unsigned int startIndex, int n);
 
@@ -206,44 +227,122 @@ public:
 	void setTargetOverlap(double targetOverlap);
 	Orientation targetOrientation() const { return m_targetOrientation; }
 	void setTargetOrientation(Orientation orientation);
+	/**
+	* Search optics positions for which the beam overlap with the target beam is larger than
+	* targetOverlap(), by differential evolution of several populations in parallel, followed
+	* by a local optimization. The optics are moved to the best positions found, even if
+	* they do not reach the target overlap.
+	* The random sequence is derived from @p seed: searching again with the same seed
+	* gives the same result, whatever the number of threads.
+	* @return true if the target overlap was reached
+	*/
+	bool magicWaist(unsigned int seed);
+	/// Same as magicWaist(unsigned int) with a random seed
 	bool magicWaist();
+	/// @return the seed of the last magic waist search, to reproduce its result
+	unsigned int magicWaistSeed() const { return m_magicWaistSeed; }
+	/// @return the maximum number of overlap evaluations of a magic waist search
+	int magicWaistBudget() const { return m_magicWaistBudget; }
+	void setMagicWaistBudget(int budget) { m_magicWaistBudget = budget; }
 	bool localOptimum();
+	/**
+	* Add a property of an optics that magicWaist() and localOptimum() optimize along with the optics positions.
+	* The variable follows its optics when the optics moves, and is removed with its optics.
+	* @return false if the optics does not exist or does not have the property
+	*/
+	bool addDesignVariable(const DesignVariable& variable);
+	int nDesignVariables() const { return m_designVariables.size(); }
+	/// @return design variable @p index, with the current index of its optics
+	DesignVariable designVariable(int index) const;
+	void clearDesignVariables();
+	/// Number of threads used by the optimizers. 0, the default, uses all the cores
+	int threadCount() const { return m_threadCount; }
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
 
 	/// Debugging
 	void printTree();
 
 private:
-	/// @todo on demand computing of beam, cavity and sensitity
+	/// Events held back during an update transaction
+	enum PendingEvent {WavelengthChangedEvent = 1, BoundariesChangedEvent = 2, TargetBeamChangedEvent = 4,
+	                   SphericityChangedEvent = 8, DimensionalityChangedEvent = 16, ModifiedEvent = 32};
+
+private:
+	/// @todo on demand computing of beam and cavity
 	void computeBeams(int changedIndex = 0, bool backwards = false);
+	void updatePropagationTree(int changedIndex);
+	void beamsChanged(int changedIndex);
+	void notify(int events);
+	void notifyDataChanged(int startOptics, int endOptics);
+	void updateBeam(int index) const;
 	void updateExtremeBeams();
-	void detectCavities();
+	void detectCavities() const;
+	/// Invalidate the cavities closed by optics @p changedIndex or after
+	void cavitiesChanged(int changedIndex);
 	void checkFitSpherical();
 	void resetDefaultValues();
 	void notifyFitChanged(Fit* fit);
+	void sortOptics();
+	/// Take the width of optics @p index into account in m_maxWidth
+	void opticsWidthChanged(int index);
+	void updateOpticsIndex(int start, int end);
+	/// @return true if an optics other than @p optics overlaps with the interval [@p start, @p stop]
+	bool collides(const Optics* optics, double start, double stop) const;
+	void updateFitIndex(int start);
+	void addDesignVariables(OpticsFunction& function) const;
+	/// Set the design variables and the positions of the optics to the argument @p layout of an OpticsFunction
+	void applyLayout(const std::vector<double>& layout);
 
 private:
 	// Properties
 	double m_wavelength;
 	std::vector<Optics*> m_optics;
+	std::unordered_map<const Optics*, int> m_opticsIndex;
+	// Upper bound of the optics widths, for collision checks
+	double m_maxWidth;
+	// False if the optics may not be sorted by position, after addOptics inserted optics out of order
+	bool m_opticsSorted;
 //	std::vector<OpticsTreeItem> m_opticsTree;
 	// Exclusion area
 	Utils::Rect m_boundary;
 	// Waist fit
 	std::vector<Fit*> m_fits;
+	std::unordered_map<const Fit*, int> m_fitIndex;
 	// Magic waist
 	Beam m_targetBeam;
 	double m_targetOverlap;
 	Orientation m_targetOrientation; // Attention : might be different from m_targetBeam.orientation()
-	// Cavity
-	Cavity m_cavity;
-
-	// Cache
+	unsigned int m_magicWaistSeed;
+	int m_magicWaistBudget;
+	std::vector<DesignVariable> m_designVariables;
+	std::vector<const Optics*> m_designVariableOptics;
+	int m_threadCount;
+	// Cavities, sorted by the index of the optics that closes them
+	mutable std::vector<Cavity> m_cavities;
+	mutable std::vector<int> m_cavityClosingIndex;
+	// Index of the first optics whose change is not reflected in the cavities, or -1
+	mutable int m_cavityChangedIndex;
+
+	// Cache. Beams are stored by value in a pool, and keep their address for the views
+	ObjectPool<Beam> m_beamPool;
 	std::vector<Beam*> m_beams;
-	std::vector<double> m_sensitivity;
+	PropagationTree m_propagationTree;
+	// A beam is up to date when its revision is m_beamsRevision
+	mutable std::vector<unsigned int> m_beamRevision;
+	unsigned int m_beamsRevision;
+	mutable std::vector<double> m_sensitivity;
+	mutable bool m_sensitivityValid;
 	bool m_beamSpherical, m_fitSpherical;
 	bool m_1D;
 	bool m_modified;
 
+	// Update transaction
+	int m_updateDepth;
+	int m_pendingChangedIndex; // First optics to propagate at the end of the update, or -1
+	bool m_pendingSynchronize; // Optics were moved during the update
+	int m_pendingEvents;
+	int m_pendingDataStart, m_pendingDataEnd;
+
 	// Callback
 	std::list<OpticsBenchEventListener*> m_listeners;
 
@@ -254,4 +353,28 @@ private:
 	friend class OpticsFunction;
 };
 
+/**
+* Group the modifications of a bench in an update transaction lasting for the lifetime of this object:
+* @code
+* {
+* 	OpticsBenchUpdate update(bench);
+* 	// modify bench
+* }
+* @endcode
+* @see OpticsBench::beginUpdate
+*/
+class OpticsBenchUpdate
+{
+public:
+	OpticsBenchUpdate(OpticsBench& bench) : m_bench(bench) { m_bench.beginUpdate(); }
+	~OpticsBenchUpdate() { m_bench.endUpdate(); }
+
+private:
+	OpticsBenchUpdate(const OpticsBenchUpdate&);
+	OpticsBenchUpdate& operator=(const OpticsBenchUpdate&);
+
+private:
+	OpticsBench& m_bench;
+};
+
 #endif
@@ -22,14 +22,156 @@
 
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 using namespace std;
 
+/////////////////////////////////////////////////
+// DesignVariable
+
+bool DesignVariable::appliesTo(const Optics* optics) const
+{
+	if (property == FocalProperty)
+		return dynamic_cast<const Lens*>(optics);
+	else if (property == CurvatureRadiusProperty)
+		return dynamic_cast<const CurvedMirror*>(optics);
+	else if (property == WidthProperty)
+		return (optics->type() == DielectricSlabType) || (optics->type() == FreeSpaceType);
+	else if (property == IndexRatioProperty)
+		return dynamic_cast<const Dielectric*>(optics);
+	else if (property == WaistProperty)
+		return optics->type() == CreateBeamType;
+
+	return false;
+}
+
+double DesignVariable::value(const Optics* optics) const
+{
+	if (property == FocalProperty)
+		return dynamic_cast<const Lens*>(optics)->focal();
+	else if (property == CurvatureRadiusProperty)
+		return dynamic_cast<const CurvedMirror*>(optics)->curvatureRadius();
+	else if (property == WidthProperty)
+		return optics->width();
+	else if (property == IndexRatioProperty)
+		return dynamic_cast<const Dielectric*>(optics)->indexRatio();
+	else if (property == WaistProperty)
+		return dynamic_cast<const CreateBeam*>(optics)->beam()->waist(Horizontal);
+
+	return 0.;
+}
+
+void DesignVariable::setValue(Optics* optics, double value) const
+{
+	if (property == FocalProperty)
+		dynamic_cast<Lens*>(optics)->setFocal(value);
+	else if (property == CurvatureRadiusProperty)
+		dynamic_cast<CurvedMirror*>(optics)->setCurvatureRadius(value);
+	else if (property == WidthProperty)
+		optics->setWidth(value);
+	else if (property == IndexRatioProperty)
+		dynamic_cast<Dielectric*>(optics)->setIndexRatio(value);
+	else if (property == WaistProperty)
+	{
+		CreateBeam* createBeam = dynamic_cast<CreateBeam*>(optics);
+		Beam beam = *createBeam->beam();
+		beam.setWaist(value, beam.isSpherical() ? Spherical : Horizontal);
+		createBeam->setBeam(beam);
+	}
+}
+
+double DesignVariable::minimum() const
+{
+	if (property == WidthProperty)
+		return 0.;
+	else if ((property == IndexRatioProperty) || (property == WaistProperty))
+		return 1e-9;
+
+	return -HUGE_VAL;
+}
+
+/////////////////////////////////////////////////
+// OpticsFunction
+
 OpticsFunction::OpticsFunction(const std::vector<Optics*>& optics, double wavelength)
 	: Function()
 	, m_optics(optics)
 	, m_wavelength(wavelength)
-{}
+	, m_checkLock(false)
+	, m_left(-HUGE_VAL)
+	, m_right(HUGE_VAL)
+{
+	m_compiledBench.compile(m_optics, m_wavelength);
+	m_compiledBench.initWorkspace(m_workspace);
+	m_batchWorkspace.resize(CompiledBench::batchSize);
+	for (int i = 0; i < CompiledBench::batchSize; i++)
+		m_compiledBench.initWorkspace(m_batchWorkspace[i]);
+	setOverlapBeam(m_overlapBeam);
+}
+
+OpticsFunction::OpticsFunction(const OpticsFunction& other)
+	: Function(other)
+	, m_optics(other.m_optics)
+	, m_wavelength(other.m_wavelength)
+	, m_checkLock(other.m_checkLock)
+	, m_left(other.m_left)
+	, m_right(other.m_right)
+	, m_overlapBeam(other.m_overlapBeam)
+	, m_overlapState(other.m_overlapState)
+	, m_compiledBench(other.m_compiledBench)
+	, m_workspace(other.m_workspace)
+	, m_batchWorkspace(other.m_batchWorkspace)
+	, m_variables(other.m_variables)
+{
+	// Each copy changes its own optics
+	for (vector<Optics*>::const_iterator it = other.m_variableOptics.begin(); it != other.m_variableOptics.end(); it++)
+		m_variableOptics.push_back(*it ? (*it)->clone() : 0);
+}
+
+OpticsFunction::~OpticsFunction()
+{
+	for (vector<Optics*>::iterator it = m_variableOptics.begin(); it != m_variableOptics.end(); it++)
+		delete *it;
+}
+
+bool OpticsFunction::addVariable(const DesignVariable& variable)
+{
+	if ((variable.optics < 0) || (variable.optics >= int(m_optics.size())) || !variable.appliesTo(m_optics[variable.optics]))
+		return false;
+
+	m_variables.push_back(variable);
+	m_variableOptics.resize(m_optics.size(), 0);
+	if (!m_variableOptics[variable.optics])
+		m_variableOptics[variable.optics] = m_optics[variable.optics]->clone();
+
+	return true;
+}
+
+// The positions are followed by the design variables
+int OpticsFunction::nPositions(const vector<double>& x) const
+{
+	return ::max(int(x.size()) - nVariables(), 0);
+}
+
+void OpticsFunction::applyVariables(const vector<double>& x) const
+{
+	const int start = nPositions(x);
+	for (int v = 0; (v < nVariables()) && (start + v < int(x.size())); v++)
+	{
+		const DesignVariable& variable = m_variables[v];
+		Optics* optics = m_variableOptics[variable.optics];
+		if (variable.value(optics) == x[start + v])
+			continue;
+		variable.setValue(optics, x[start + v]);
+		m_compiledBench.update(variable.optics, optics);
+	}
+}
+
+void OpticsFunction::setOverlapBeam(const Beam& beam)
+{
+	m_overlapBeam = beam;
+	m_overlapState = BeamState::fromBeam(beam);
+}
 
 vector<Optics*> OpticsFunction::cloneOptics() const
 {
@@ -54,10 +196,23 @@ vector<Optics*> OpticsFunction::cloneOptics() const
 
 Beam OpticsFunction::beam(const std::vector<double>& x) const
 {
-	/// @todo cache the cloned optics
+	if (!m_compiledBench.isValid())
+		return clonedBeam(x);
+
+	applyVariables(x);
+	m_compiledBench.place(x.empty() ? 0 : &x[0], nPositions(x), m_checkLock, m_workspace);
+	return m_compiledBench.propagate(m_workspace).toBeam();
+}
+
+Beam OpticsFunction::clonedBeam(const std::vector<double>& x) const
+{
 	vector<Optics*> opticsClone = cloneOptics();
 
-	for (unsigned int i = 0; i < ::min(opticsClone.size(), x.size()); i++)
+	const int start = nPositions(x);
+	for (int v = 0; (v < nVariables()) && (start + v < int(x.size())); v++)
+		m_variables[v].setValue(opticsClone[m_variables[v].optics], x[start + v]);
+
+	for (int i = 0; i < ::min(int(opticsClone.size()), start); i++)
 		if (m_checkLock)
 			opticsClone[i]->setPosition(x[i], true);
 		else
@@ -79,7 +234,135 @@ Beam OpticsFunction::beam(const std::vector<double>& x) const
 
 double OpticsFunction::value(const std::vector<double>& x) const
 {
-	return Beam::overlap(m_overlapBeam, beam(x));
+	if (!m_compiledBench.isValid())
+		return Beam::overlap(m_overlapBeam, clonedBeam(x));
+
+	applyVariables(x);
+	m_compiledBench.place(x.empty() ? 0 : &x[0], nPositions(x), m_checkLock, m_workspace);
+	return BeamState::overlap(m_overlapState, m_compiledBench.propagate(m_workspace));
+}
+
+vector<double> OpticsFunction::values(const vector<vector<double> >& x) const
+{
+	if (!m_compiledBench.isValid() || (nVariables() > 0))
+		return Function::values(x);
+
+	vector<double> result(x.size());
+	BeamState beams[CompiledBench::batchSize];
+
+	for (unsigned int start = 0; start < x.size(); start += CompiledBench::batchSize)
+	{
+		const int n = ::min(int(x.size() - start), int(CompiledBench::batchSize));
+		for (int j = 0; j < n; j++)
+		{
+			const vector<double>& point = x[start + j];
+			m_compiledBench.place(point.empty() ? 0 : &point[0], point.size(), m_checkLock, m_batchWorkspace[j]);
+		}
+		m_compiledBench.propagateBatch(&m_batchWorkspace[0], n, beams);
+		for (int j = 0; j < n; j++)
+			result[start + j] = BeamState::overlap(m_overlapState, beams[j]);
+	}
+
+	return result;
+}
+
+vector<double> OpticsFunction::gradient(const vector<double>& x) const
+{
+	if (!m_compiledBench.isValid() || x.empty())
+		return Function::gradient(x);
+
+	vector<double> result(x.size(), 0.);
+	const int n = nPositions(x);
+	if (n > 0)
+	{
+		applyVariables(x);
+		m_compiledBench.place(&x[0], n, m_checkLock, m_workspace);
+		m_compiledBench.overlapDerivatives(m_overlapState, n, m_checkLock, m_workspace, &result[0], 0);
+	}
+	variableDerivatives(x, &result[0] + n, 0);
+
+	return result;
+}
+
+vector<double> OpticsFunction::curvature(const vector<double>& x) const
+{
+	if (!m_compiledBench.isValid() || x.empty())
+		return Function::curvature(x);
+
+	vector<double> result(x.size(), 0.);
+	const int n = nPositions(x);
+	if (n > 0)
+	{
+		applyVariables(x);
+		m_compiledBench.place(&x[0], n, m_checkLock, m_workspace);
+		m_compiledBench.overlapDerivatives(m_overlapState, n, m_checkLock, m_workspace, 0, &result[0]);
+	}
+	variableDerivatives(x, 0, &result[0] + n);
+
+	return result;
+}
+
+void OpticsFunction::bounds(const vector<double>& x, vector<double>& lower, vector<double>& upper) const
+{
+	Function::bounds(x, lower, upper);
+	if (x.empty())
+		return;
+	lower[0] = upper[0] = x[0];
+	if (!m_compiledBench.isValid())
+		return;
+
+	// Design variables stay within their bounds and their physical range
+	const int nx = ::min(nPositions(x), m_compiledBench.size());
+	for (int v = 0; (v < nVariables()) && (nx + v < int(x.size())); v++)
+	{
+		lower[nx + v] = ::max(m_variables[v].lower, m_variables[v].minimum());
+		upper[nx + v] = m_variables[v].upper;
+	}
+
+	const int n = m_compiledBench.size();
+	m_compiledBench.place(&x[0], nx, m_checkLock, m_workspace);
+	const double* position = &m_workspace.position[0];
+	const int* order = &m_workspace.order[0];
+
+	// Without locks, each optics is its own group
+	const int nGroups = m_checkLock ? m_compiledBench.nLockGroups() : n;
+	vector<int> group(n);
+	for (int i = 0; i < n; i++)
+		group[i] = m_checkLock ? m_compiledBench.lockGroup(i) : i;
+
+	// Displacement range of each group: its optics stay within the boundary, and move by at most
+	// half of the free space to their neighbours from other groups
+	vector<double> low(nGroups, -HUGE_VAL), high(nGroups, HUGE_VAL);
+	for (int k = 1; k < n; k++)
+	{
+		const int i = order[k];
+		const int g = group[i];
+		const double stop = position[i] + m_compiledBench.width(i);
+		low[g] = ::max(low[g], m_left - position[i]);
+		high[g] = ::min(high[g], m_right - stop);
+		const int previous = order[k-1];
+		if (group[previous] != g)
+			low[g] = ::max(low[g], -::max(position[i] - position[previous] - m_compiledBench.width(previous), 0.)/2.);
+		if ((k + 1 < n) && (group[order[k+1]] != g))
+			high[g] = ::min(high[g], ::max(position[order[k+1]] - stop, 0.)/2.);
+	}
+
+	// As in CompiledBench::place, the last variable of a group moves the group
+	vector<int> driver(nGroups, -1);
+	for (int i = 0; i < nx; i++)
+		driver[group[i]] = i;
+
+	for (int i = 1; i < nx; i++)
+	{
+		const int g = group[i];
+		if ((driver[g] != i) || (m_checkLock && m_compiledBench.isGroupAbsolutelyLocked(g)) || (low[g] > high[g]))
+			lower[i] = upper[i] = x[i];
+		else
+		{
+			lower[i] = x[i] + low[g];
+			upper[i] = x[i] + high[g];
+		}
+	}
 }
 
 vector<double> OpticsFunction::currentPosition() const
@@ -88,6 +371,34 @@ vector<double> OpticsFunction::currentPosition() const
 
 	for (vector<Optics*>::const_iterator it = m_optics.begin(); it != m_optics.end(); it++)
 		position.push_back((*it)->position());
+	for (vector<DesignVariable>::const_iterator it = m_variables.begin(); it != m_variables.end(); it++)
+		position.push_back(it->value(m_optics[it->optics]));
 
 	return position;
 }
+
+void OpticsFunction::variableDerivatives(const vector<double>& x, double* gradient, double* curvature) const
+{
+	const int start = nPositions(x);
+	if (start + nVariables() > int(x.size()))
+		return;
+
+	// Central differences: the overlap is not differentiated through the optics properties
+	vector<double> shifted = x;
+	const double center = value(x);
+	for (int v = 0; v < nVariables(); v++)
+	{
+		const double step = (x[start + v] == 0.) ? 1e-8 : 1e-5*fabs(x[start + v]);
+		shifted[start + v] = x[start + v] + step;
+		const double plus = value(shifted);
+		shifted[start + v] = x[start + v] - step;
+		const double minus = value(shifted);
+		shifted[start + v] = x[start + v];
+		if (gradient)
+			gradient[v] = (plus - minus)/(2.*step);
+		if (curvature)
+			curvature[v] = (plus - 2.*center + minus)/(step*step);
+	}
+	// Leave the optics compiled at x
+	applyVariables(x);
+}
@@ -21,37 +21,122 @@
 
 #include "Function.h"
 #include "GaussianBeam.h"
+#include "CompiledBench.h"
+
+#include <cmath>
 
 class Optics;
 class OpticsBench;
 
+/// Property of an optics optimized by OpticsFunction along with the optics positions
+struct DesignVariable
+{
+	/**
+	* Focal length of a lens, curvature radius of a curved mirror, width of a dielectric slab or of
+	* a free space, index ratio of a dielectric, or waist of a created beam (its horizontal waist if
+	* the beam is ellipsoidal)
+	*/
+	enum Property {FocalProperty, CurvatureRadiusProperty, WidthProperty, IndexRatioProperty, WaistProperty};
+
+	DesignVariable(Property property = FocalProperty, int optics = 0, double lower = -HUGE_VAL, double upper = HUGE_VAL)
+		: property(property), optics(optics), lower(lower), upper(upper) {}
+
+	/// @return true if @p optics has this property
+	bool appliesTo(const Optics* optics) const;
+	/// @return the value of the property of @p optics
+	double value(const Optics* optics) const;
+	/// Set the property of @p optics to @p value
+	void setValue(Optics* optics, double value) const;
+	/// @return the smallest physical value of the property: widths are positive, index ratios and waists strictly positive
+	double minimum() const;
+
+	Property property;
+	int optics;     ///< Index of the optics in the optics set of the function
+	double lower;
+	double upper;
+};
+
 /**
 * Optics function is a function which value is the overlap between a Gaussian beam
 * produced by a set of optics and a given beam. Its arguments is the set of positions
-* of all the optics.
+* of all the optics, followed by the values of the design variables added by addVariable().
+* The optics are compiled once at construction into a CompiledBench, so that evaluating
+* the function does not clone optics nor allocate memory. For this reason, an OpticsFunction
+* should not be evaluated concurrently from several threads: use one copy per thread.
+* Optics that carry design variables are cloned, and compiled again when the value of a variable changes.
 */
 class OpticsFunction : public Function
 {
 public:
 	OpticsFunction(const std::vector<Optics*>& optics, double wavelength);
-	virtual ~OpticsFunction() {}
+	OpticsFunction(const OpticsFunction& other);
+	virtual ~OpticsFunction();
 
 public:
 	virtual double value(const std::vector<double>& x) const;
-	/// @todo this should be private
+	/**
+	* Evaluate the overlap for all optics positions of @p x, propagating CompiledBench::batchSize positions at once.
+	* With design variables, the points are evaluated one by one, as they do not share the same optics
+	*/
+	virtual std::vector<double> values(const std::vector<std::vector<double> >& x) const;
+	/**
+	* Exact gradient with respect to the positions, obtained by propagating the derivatives of the q parameter
+	* along with the beam. The derivatives with respect to design variables are central finite differences
+	*/
+	virtual std::vector<double> gradient(const std::vector<double>& x) const;
+	/// Second derivatives, obtained as the gradient
+	virtual std::vector<double> curvature(const std::vector<double>& x) const;
+	/**
+	* Optics stay within the boundary set by setBoundary(), and do not overlap: each optics moves by at most
+	* half of the free space to its neighbours. The first optics does not move. When checking locks,
+	* only the last variable of each relative lock tree moves the tree, and absolutely locked trees do not move.
+	* Design variables stay within their bounds, and within their physical range
+	*/
+	virtual void bounds(const std::vector<double>& x, std::vector<double>& lower, std::vector<double>& upper) const;
+	/**
+	* @return the beam after the last optics, for optics positions @p x
+	* @note the beam geometry (origin and angle) is only computed if the optics could not be compiled
+	* @todo this should be private
+	*/
 	Beam beam(const std::vector<double>& x) const;
+	/// @return the positions of the optics, followed by the values of the design variables
 	std::vector<double> currentPosition() const;
+	/// Add a design variable. @return false if the optics does not exist or does not have the property
+	bool addVariable(const DesignVariable& variable);
+	/// @return the number of design variables
+	int nVariables() const { return m_variables.size(); }
+	/// @return design variable @p index
+	const DesignVariable& variable(int index) const { return m_variables[index]; }
 	void setCheckLock(bool checkLock) { m_checkLock = checkLock; }
-	void setOverlapBeam(const Beam& beam) { m_overlapBeam = beam; }
+	/// Optimizations keep the optics between @p left and @p right. By default, optics are not bounded
+	void setBoundary(double left, double right) { m_left = left; m_right = right; }
+	void setOverlapBeam(const Beam& beam);
+
+private:
+	// Copies own their clones of the optics that carry design variables: they are not assignable
+	OpticsFunction& operator=(const OpticsFunction&);
 
 private:
 	std::vector<Optics*> cloneOptics() const;
+	Beam clonedBeam(const std::vector<double>& x) const;
+	void applyVariables(const std::vector<double>& x) const;
+	void variableDerivatives(const std::vector<double>& x, double* gradient, double* curvature) const;
+	int nPositions(const std::vector<double>& x) const;
 
 private:
 	const std::vector<Optics*>& m_optics;
 	double m_wavelength;
 	bool m_checkLock;
+	double m_left, m_right;
 	Beam m_overlapBeam;
+	BeamState m_overlapState;
+	// Compiled again when design variables change
+	mutable CompiledBench m_compiledBench;
+	mutable CompiledBench::Workspace m_workspace;
+	mutable std::vector<CompiledBench::Workspace> m_batchWorkspace;
+	std::vector<DesignVariable> m_variables;
+	// Clones of the optics that carry design variables, or null, one per optics
+	std::vector<Optics*> m_variableOptics;
 };
 
 #endif
@@ -0,0 +1,351 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "ParameterSweep.h"
+#include "OpticsBench.h"
+#include "Optics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+static const char sweepMagic[8] = {'G', 'B', 'S', 'W', 'E', 'E', 'P', '1'};
+
+/// Number of grid points computed by a thread before writing them
+static const uint64_t chunkSize = 256;
+
+/////////////////////////////////////////////////
+// CsvSweepWriter
+
+CsvSweepWriter::CsvSweepWriter(ostream& stream)
+	: m_stream(stream)
+	, m_columns(0)
+{
+}
+
+bool CsvSweepWriter::begin(const vector<string>& columns)
+{
+	m_columns = columns.size();
+	m_stream.precision(numeric_limits<double>::digits10 + 2);
+	for (vector<string>::const_iterator it = columns.begin(); it != columns.end(); it++)
+		m_stream << (it == columns.begin() ? "" : ",") << *it;
+	m_stream << "\n";
+
+	return m_stream.good();
+}
+
+bool CsvSweepWriter::write(const double* row)
+{
+	for (int i = 0; i < m_columns; i++)
+		m_stream << (i == 0 ? "" : ",") << row[i];
+	m_stream << "\n";
+
+	return m_stream.good();
+}
+
+bool CsvSweepWriter::end()
+{
+	m_stream.flush();
+	return m_stream.good();
+}
+
+/////////////////////////////////////////////////
+// BinarySweepWriter
+
+BinarySweepWriter::BinarySweepWriter(const string& fileName)
+	: m_fileName(fileName)
+	, m_columns(0)
+	, m_rows(0)
+{
+}
+
+bool BinarySweepWriter::begin(const vector<string>& columns)
+{
+	m_file.open(m_fileName.c_str(), ios::out | ios::binary | ios::trunc);
+	m_columns = columns.size();
+	m_rows = 0;
+
+	const uint64_t nColumns = columns.size();
+	m_file.write(sweepMagic, sizeof(sweepMagic));
+	m_file.write(reinterpret_cast<const char*>(&nColumns), sizeof(nColumns));
+	m_file.write(reinterpret_cast<const char*>(&m_rows), sizeof(m_rows));
+	for (vector<string>::const_iterator it = columns.begin(); it != columns.end(); it++)
+	{
+		const uint64_t size = it->size();
+		m_file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		m_file.write(it->data(), size);
+	}
+
+	return m_file.good();
+}
+
+bool BinarySweepWriter::write(const double* row)
+{
+	m_file.write(reinterpret_cast<const char*>(row), m_columns*sizeof(double));
+	m_rows++;
+
+	return m_file.good();
+}
+
+bool BinarySweepWriter::end()
+{
+	m_file.seekp(sizeof(sweepMagic) + sizeof(uint64_t));
+	m_file.write(reinterpret_cast<const char*>(&m_rows), sizeof(m_rows));
+	m_file.close();
+
+	return !m_file.fail();
+}
+
+/////////////////////////////////////////////////
+// ParameterSweep
+
+ParameterSweep::ParameterSweep(const OpticsBench& bench)
+	: m_bench(bench)
+	, m_threadCount(0)
+{
+}
+
+uint64_t ParameterSweep::size() const
+{
+	uint64_t result = 1;
+	for (vector<SweepParameter>::const_iterator it = m_parameters.begin(); it != m_parameters.end(); it++)
+		result *= ::max(it->steps, 0);
+
+	return result;
+}
+
+vector<string> ParameterSweep::columns() const
+{
+	vector<string> result;
+
+	for (vector<SweepParameter>::const_iterator it = m_parameters.begin(); it != m_parameters.end(); it++)
+	{
+		if (it->property == SweepParameter::WavelengthProperty)
+		{
+			result.push_back("wavelength");
+			continue;
+		}
+		string name = m_bench.optics(it->optics)->name();
+		if (it->property == SweepParameter::PositionProperty)
+			result.push_back(name + ".position");
+		else if (it->property == SweepParameter::FocalProperty)
+			result.push_back(name + ".focal");
+		else if (it->property == SweepParameter::CurvatureRadiusProperty)
+			result.push_back(name + ".curvatureRadius");
+		else if (it->property == SweepParameter::WidthProperty)
+			result.push_back(name + ".width");
+	}
+
+	for (vector<SweepOutput>::const_iterator it = m_outputs.begin(); it != m_outputs.end(); it++)
+	{
+		stringstream name;
+		name << (it->optics < 0 ? "output" : m_bench.optics(it->optics)->name()) << ".";
+		if (it->quantity == SweepOutput::WaistQuantity)
+			name << "waist";
+		else if (it->quantity == SweepOutput::WaistPositionQuantity)
+			name << "waistPosition";
+		else if (it->quantity == SweepOutput::RadiusQuantity)
+			name << "radius";
+		else if (it->quantity == SweepOutput::OverlapQuantity)
+			name << "overlap";
+		if (it->quantity != SweepOutput::OverlapQuantity)
+			name << (it->orientation == Vertical ? "V" : "H");
+		if (it->quantity == SweepOutput::RadiusQuantity)
+			name << "(" << it->plane << ")";
+		result.push_back(name.str());
+	}
+
+	return result;
+}
+
+bool ParameterSweep::check()
+{
+	if (m_bench.nOptics() == 0)
+	{
+		m_errorString = "the bench does not contain any optics";
+		return false;
+	}
+
+	for (vector<SweepParameter>::const_iterator it = m_parameters.begin(); it != m_parameters.end(); it++)
+	{
+		if (it->steps < 1)
+		{
+			m_errorString = "swept parameters need at least one step";
+			return false;
+		}
+		if (it->property == SweepParameter::WavelengthProperty)
+			continue;
+		if ((it->optics < 0) || (it->optics >= m_bench.nOptics()))
+		{
+			m_errorString = "swept parameter of a non existing optics";
+			return false;
+		}
+		const Optics* optics = m_bench.optics(it->optics);
+		if ((it->property == SweepParameter::PositionProperty) && (it->optics == 0))
+		{
+			m_errorString = "the input beam can not be moved";
+			return false;
+		}
+		if ((it->property == SweepParameter::FocalProperty) && !dynamic_cast<const Lens*>(optics))
+		{
+			m_errorString = optics->name() + " does not have a focal length";
+			return false;
+		}
+		if ((it->property == SweepParameter::CurvatureRadiusProperty) && !dynamic_cast<const CurvedMirror*>(optics))
+		{
+			m_errorString = optics->name() + " does not have a curvature radius";
+			return false;
+		}
+	}
+
+	for (vector<SweepOutput>::const_iterator it = m_outputs.begin(); it != m_outputs.end(); it++)
+		if (it->optics >= m_bench.nOptics())
+		{
+			m_errorString = "recorded beam of a non existing optics";
+			return false;
+		}
+
+	return true;
+}
+
+void ParameterSweep::computeRow(uint64_t point, const vector<Optics*>& optics, vector<int>& order,
+                                vector<Beam>& beams, double* row) const
+{
+	// Set the parameters of the grid point. The last parameter varies fastest
+	double wavelength = m_bench.wavelength();
+	for (int p = m_parameters.size() - 1; p >= 0; p--)
+	{
+		const SweepParameter& parameter = m_parameters[p];
+		const double value = parameter.value(point % parameter.steps);
+		point /= parameter.steps;
+		row[p] = value;
+
+		if (parameter.property == SweepParameter::PositionProperty)
+			optics[parameter.optics]->setPosition(value, false);
+		else if (parameter.property == SweepParameter::FocalProperty)
+			static_cast<Lens*>(optics[parameter.optics])->setFocal(value);
+		else if (parameter.property == SweepParameter::CurvatureRadiusProperty)
+			static_cast<CurvedMirror*>(optics[parameter.optics])->setCurvatureRadius(value);
+		else if (parameter.property == SweepParameter::WidthProperty)
+			optics[parameter.optics]->setWidth(value);
+		else if (parameter.property == SweepParameter::WavelengthProperty)
+			wavelength = value;
+	}
+
+	// Propagate the beam through the optics, sorted by position as in OpticsBench
+	sort(order.begin() + 1, order.end(), [&optics](int i, int j) { return optics[i]->position() < optics[j]->position(); });
+	Beam beam(wavelength);
+	for (vector<int>::const_iterator it = order.begin(); it != order.end(); it++)
+		beams[*it] = beam = optics[*it]->image(beam);
+
+	// Record the outputs. The target beam follows the wavelength, as in OpticsBench::setWavelength
+	Beam target = *m_bench.targetBeam();
+	target.setWavelength(wavelength);
+	double* outputRow = row + m_parameters.size();
+	for (vector<SweepOutput>::const_iterator it = m_outputs.begin(); it != m_outputs.end(); it++, outputRow++)
+	{
+		const Beam& output = beams[it->optics < 0 ? order.back() : it->optics];
+		if (it->quantity == SweepOutput::WaistQuantity)
+			*outputRow = output.waist(it->orientation);
+		else if (it->quantity == SweepOutput::WaistPositionQuantity)
+			*outputRow = output.waistPosition(it->orientation);
+		else if (it->quantity == SweepOutput::RadiusQuantity)
+			*outputRow = output.radius(it->plane, it->orientation);
+		else if (it->quantity == SweepOutput::OverlapQuantity)
+			*outputRow = Beam::overlap(output, target);
+	}
+}
+
+bool ParameterSweep::run(SweepWriter& writer)
+{
+	m_errorString.clear();
+	if (!check())
+		return false;
+
+	const int nColumns = m_parameters.size() + m_outputs.size();
+	const uint64_t nPoints = size();
+	const uint64_t nChunk = (nPoints + chunkSize - 1)/chunkSize;
+	if (!writer.begin(columns()))
+	{
+		m_errorString = "cannot write the sweep header";
+		return false;
+	}
+
+	// Each thread computes the next chunk of grid points, and waits for the previous chunks to be written
+	// before writing its own, so that at most one chunk per thread is held in memory
+	atomic<uint64_t> nextChunk(0);
+	uint64_t writtenChunk = 0;
+	bool writeError = false;
+	mutex writeMutex;
+	condition_variable chunkWritten;
+
+	auto sweep = [&]()
+	{
+		vector<Optics*> optics;
+		for (int i = 0; i < m_bench.nOptics(); i++)
+			optics.push_back(m_bench.optics(i)->clone());
+		vector<int> order(optics.size());
+		for (unsigned int i = 0; i < order.size(); i++)
+			order[i] = i;
+		vector<Beam> beams(optics.size());
+		vector<double> rows(chunkSize*nColumns);
+
+		for (uint64_t chunk = nextChunk++; chunk < nChunk; chunk = nextChunk++)
+		{
+			const uint64_t chunkStart = chunk*chunkSize;
+			const uint64_t chunkEnd = ::min(nPoints, chunkStart + chunkSize);
+			for (uint64_t point = chunkStart; point < chunkEnd; point++)
+				computeRow(point, optics, order, beams, &rows[(point - chunkStart)*nColumns]);
+
+			unique_lock<mutex> lock(writeMutex);
+			chunkWritten.wait(lock, [&]() { return (writtenChunk == chunk) || writeError; });
+			if (writeError)
+				break;
+			for (uint64_t point = chunkStart; (point < chunkEnd) && !writeError; point++)
+				writeError = !writer.write(&rows[(point - chunkStart)*nColumns]);
+			writtenChunk++;
+			chunkWritten.notify_all();
+		}
+
+		for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+			delete *it;
+	};
+
+	const uint64_t maxThreads = m_threadCount > 0 ? m_threadCount : ::max(1u, thread::hardware_concurrency());
+	const int nThreads = ::max(uint64_t(1), ::min(maxThreads, nChunk));
+	vector<thread> workers;
+	for (int i = 1; i < nThreads; i++)
+		workers.push_back(thread(sweep));
+	sweep();
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++)
+		it->join();
+
+	if (!writer.end() || writeError)
+	{
+		m_errorString = "cannot write the sweep results";
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,161 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PARAMETERSWEEP_H
+#define PARAMETERSWEEP_H
+
+#include "GaussianBeam.h"
+
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class Optics;
+class OpticsBench;
+
+/// Parameter varied by a sweep, on a regular grid from @p start to @p stop
+struct SweepParameter
+{
+	enum Property {PositionProperty, FocalProperty, CurvatureRadiusProperty, WidthProperty, WavelengthProperty};
+
+	SweepParameter(Property property = PositionProperty, int optics = 0, double start = 0., double stop = 0., int steps = 1)
+		: property(property), optics(optics), start(start), stop(stop), steps(steps) {}
+
+	/// @return the value of the parameter at grid step @p step
+	double value(int step) const { return steps > 1 ? start + (stop - start)*step/(steps - 1) : start; }
+
+	Property property;
+	int optics;         ///< Index of the optics in the bench. Ignored for the wavelength
+	double start;
+	double stop;
+	int steps;          ///< Number of values, including @p start and @p stop
+};
+
+/// Beam property recorded by a sweep, for the beam after optics @p optics
+struct SweepOutput
+{
+	enum Quantity {WaistQuantity, WaistPositionQuantity, RadiusQuantity, OverlapQuantity};
+
+	SweepOutput(Quantity quantity = WaistQuantity, int optics = -1, Orientation orientation = Horizontal, double plane = 0.)
+		: quantity(quantity), optics(optics), orientation(orientation), plane(plane) {}
+
+	Quantity quantity;
+	int optics;               ///< Index of the optics in the bench, or -1 for the last optics
+	Orientation orientation;  ///< Horizontal or Vertical. Ignored for the overlap
+	double plane;             ///< Position of the plane at which the radius is recorded
+};
+
+/// Destination of the rows of a sweep. Rows are written in the order of the grid
+class SweepWriter
+{
+public:
+	virtual ~SweepWriter() {}
+
+public:
+	/// Start the output, with columns named @p columns. @return true on success
+	virtual bool begin(const std::vector<std::string>& columns) = 0;
+	/// Write a row of values, one per column. @return true on success
+	virtual bool write(const double* row) = 0;
+	/// Complete the output. @return true on success
+	virtual bool end() = 0;
+};
+
+/// Write sweep rows as comma separated values, with a header line
+class CsvSweepWriter : public SweepWriter
+{
+public:
+	CsvSweepWriter(std::ostream& stream);
+
+public:
+	virtual bool begin(const std::vector<std::string>& columns);
+	virtual bool write(const double* row);
+	virtual bool end();
+
+private:
+	std::ostream& m_stream;
+	int m_columns;
+};
+
+/**
+* Write sweep rows in a compact binary file: the magic string "GBSWEEP1", the number of
+* columns and the number of rows as 64 bits integers, the column names as a 64 bits size
+* followed by the characters, and then the rows as doubles. All values are stored in the
+* byte order of the writer. The number of rows is written by end().
+*/
+class BinarySweepWriter : public SweepWriter
+{
+public:
+	BinarySweepWriter(const std::string& fileName);
+
+public:
+	virtual bool begin(const std::vector<std::string>& columns);
+	virtual bool write(const double* row);
+	virtual bool end();
+
+private:
+	std::string m_fileName;
+	std::ofstream m_file;
+	int m_columns;
+	uint64_t m_rows;
+};
+
+/**
+* Sweep a grid of optics parameters and record beam properties at each grid point.
+* The grid is the cartesian product of the values of all parameters, the last parameter varying fastest.
+* Grid points are computed in parallel on copies of the optics, and rows are streamed to a
+* SweepWriter in the order of the grid, so that the grid is never held in memory.
+* Optics are moved without respecting locks, and the optics order follows their positions.
+*/
+class ParameterSweep
+{
+public:
+	/// Constructor. The optics and the target beam of @p bench are copied when calling run()
+	ParameterSweep(const OpticsBench& bench);
+
+public:
+	/// Add a swept parameter
+	void addParameter(const SweepParameter& parameter) { m_parameters.push_back(parameter); }
+	/// Add a recorded beam property
+	void addOutput(const SweepOutput& output) { m_outputs.push_back(output); }
+	/// @return the number of grid points
+	uint64_t size() const;
+	/// @return the names of the columns of each row: parameters, then outputs
+	std::vector<std::string> columns() const;
+	/// Number of threads. 0, the default, uses all the cores
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+	/// Run the sweep and write the rows to @p writer. @return true on success
+	bool run(SweepWriter& writer);
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+private:
+	bool check();
+	void computeRow(uint64_t point, const std::vector<Optics*>& optics, std::vector<int>& order,
+	                std::vector<Beam>& beams, double* row) const;
+
+private:
+	const OpticsBench& m_bench;
+	std::vector<SweepParameter> m_parameters;
+	std::vector<SweepOutput> m_outputs;
+	int m_threadCount;
+	std::string m_errorString;
+};
+
+#endif
@@ -0,0 +1,249 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "PropagationTree.h"
+#include "Optics.h"
+#include "Utils.h"
+
+#include <cmath>
+
+using namespace std;
+
+PropagationTree::PropagationTree()
+	: m_size(0)
+	, m_leaves(1)
+	, m_nodes(2, identity())
+	, m_wavelength(0.)
+{
+}
+
+PropagationTree::Node PropagationTree::identity()
+{
+	Node node;
+	node.reset = -1;
+	node.empty = true;
+	node.start = node.stop = 0.;
+	for (int o = 0; o < 2; o++)
+	{
+		node.matrix[o][0] = 1.; node.matrix[o][1] = 0.;
+		node.matrix[o][2] = 0.; node.matrix[o][3] = 1.;
+	}
+	node.indexJump = 1.;
+	node.tx = node.ty = node.rotation = 0.;
+	node.valid = node.spherical = node.oneD = true;
+	return node;
+}
+
+// Transformation of the optics, applied after the transformations of @p first
+PropagationTree::Node PropagationTree::compose(const Node& first, const Node& second)
+{
+	if (first.empty)
+		return second;
+	if (second.empty)
+		return first;
+
+	Node node = second;
+	node.valid = first.valid && second.valid;
+	node.spherical = first.spherical && second.spherical;
+	node.oneD = first.oneD && second.oneD;
+
+	// A CreateBeam discards all what happened before
+	if (second.reset >= 0)
+		return node;
+
+	node.reset = first.reset;
+	node.start = first.start;
+	// Free propagation from the output plane of the first node to the input plane of the second node
+	const double gap = second.start - first.stop;
+	for (int o = 0; o < 2; o++)
+	{
+		const double* m1 = first.matrix[o];
+		const double* m2 = second.matrix[o];
+		const double m10 = m1[0] + gap*m1[2];
+		const double m11 = m1[1] + gap*m1[3];
+		double* m = node.matrix[o];
+		m[0] = m2[0]*m10 + m2[1]*m1[2];
+		m[1] = m2[0]*m11 + m2[1]*m1[3];
+		m[2] = m2[2]*m10 + m2[3]*m1[2];
+		m[3] = m2[2]*m11 + m2[3]*m1[3];
+		// Möbius transformations are defined up to a factor: keep the determinant to 1
+		const double norm = sqrt(fabs(m[0]*m[3] - m[1]*m[2]));
+		if (norm > 0.)
+			for (int k = 0; k < 4; k++)
+				m[k] /= norm;
+	}
+	node.indexJump = first.indexJump*second.indexJump;
+	node.tx = first.tx + cos(first.rotation)*second.tx - sin(first.rotation)*second.ty;
+	node.ty = first.ty + sin(first.rotation)*second.tx + cos(first.rotation)*second.ty;
+	node.rotation = first.rotation + second.rotation;
+
+	return node;
+}
+
+// @return true if a beam at angle @p angle propagates along the bench axis
+static bool isAxial(double angle)
+{
+	angle = fmod(fabs(angle), M_PI);
+	return (angle <= Utils::epsilon) || (angle >= M_PI - Utils::epsilon);
+}
+
+PropagationTree::Node PropagationTree::leaf(int index, const Optics* optics)
+{
+	m_optics[index] = optics;
+	m_position[index] = optics->position();
+
+	// Without ABCD matrix, the optics is a free propagation over its width
+	const double position = optics->position();
+	const double stop = position + optics->width();
+	Node node = identity();
+	node.empty = false;
+	node.start = position;
+	node.stop = stop;
+	node.matrix[0][1] = node.matrix[1][1] = optics->width();
+	node.spherical = (optics->orientation() == Spherical);
+
+	if (optics->type() == CreateBeamType)
+	{
+		// The created beam is given in absolute coordinates
+		m_createdBeam[index] = optics->image(Beam(m_wavelength));
+		node.start = stop;
+		node.matrix[0][1] = node.matrix[1][1] = 0.;
+		node.reset = index;
+		node.oneD = isAxial(m_createdBeam[index].angle());
+		return node;
+	}
+	else if (!optics->isABCD())
+	{
+		node.valid = false;
+		return node;
+	}
+
+	// As in FlatMirror::image, in the bench the optical axis is the input beam
+	const bool mirror = dynamic_cast<const FlatMirror*>(optics) != 0;
+	if (mirror && (optics->angle() > M_PI/2.) && (optics->angle() < 3.*M_PI/2.))
+		return node;
+
+	const ABCD* abcd = dynamic_cast<const ABCD*>(optics);
+	for (int o = 0; o < 2; o++)
+	{
+		const Orientation orientation = o == 0 ? Horizontal : Vertical;
+		const ABCD::Matrix& m = abcd->matrix(orientation);
+		if (m.A*m.D - m.B*m.C <= 0.)
+			node.valid = false;
+		node.matrix[o][0] = m.A;
+		node.matrix[o][1] = m.B;
+		node.matrix[o][2] = m.C;
+		node.matrix[o][3] = m.D;
+	}
+	node.indexJump = optics->indexJump();
+
+	// Mirrors rotate the beam around the optics position, as Beam::rotate
+	if (mirror)
+	{
+		node.rotation = fmod(2.*optics->angle() + M_PI, 2.*M_PI);
+		node.tx = position*(1. - cos(node.rotation));
+		node.ty = -position*sin(node.rotation);
+		node.oneD = isAxial(node.rotation);
+	}
+
+	return node;
+}
+
+void PropagationTree::build(const vector<Optics*>& optics, double wavelength)
+{
+	m_wavelength = wavelength;
+	m_size = optics.size();
+	for (m_leaves = 1; m_leaves < m_size; m_leaves *= 2) {}
+
+	m_nodes.assign(2*m_leaves, identity());
+	m_optics.assign(m_size, 0);
+	m_position.assign(m_size, 0.);
+	m_createdBeam.assign(m_size, Beam(wavelength));
+
+	for (int i = 0; i < m_size; i++)
+		m_nodes[m_leaves + i] = leaf(i, optics[i]);
+	for (int node = m_leaves - 1; node > 0; node--)
+		m_nodes[node] = compose(m_nodes[2*node], m_nodes[2*node + 1]);
+}
+
+void PropagationTree::update(int index, const Optics* optics)
+{
+	m_nodes[m_leaves + index] = leaf(index, optics);
+	updateParents(m_leaves + index);
+}
+
+void PropagationTree::updateParents(int node)
+{
+	for (node /= 2; node > 0; node /= 2)
+		m_nodes[node] = compose(m_nodes[2*node], m_nodes[2*node + 1]);
+}
+
+int PropagationTree::synchronize(const vector<Optics*>& optics)
+{
+	if (int(optics.size()) != m_size)
+	{
+		build(optics, m_wavelength);
+		return 0;
+	}
+
+	int first = m_size;
+	for (int i = 0; i < m_size; i++)
+		if ((m_optics[i] != optics[i]) || (m_position[i] != optics[i]->position()))
+		{
+			update(i, optics[i]);
+			first = ::min(first, i);
+		}
+
+	return first;
+}
+
+Beam PropagationTree::beam(int index) const
+{
+	// Compose the leaves 0 to index, from the bottom of the tree
+	Node left = identity(), right = identity();
+	for (int l = m_leaves, r = m_leaves + index + 1; l < r; l /= 2, r /= 2)
+	{
+		if (l & 1)
+			left = compose(left, m_nodes[l++]);
+		if (r & 1)
+			right = compose(m_nodes[--r], right);
+	}
+	const Node node = compose(left, right);
+
+	const Beam input = node.reset >= 0 ? m_createdBeam[node.reset] : Beam(m_wavelength);
+	Beam result = input;
+	if (node.empty)
+		return result;
+	result.setIndex(input.index()*node.indexJump);
+	for (int o = 0; o < 2; o++)
+	{
+		const Orientation orientation = o == 0 ? Horizontal : Vertical;
+		const double* m = node.matrix[o];
+		const complex<double> q(node.start - input.waistPosition(orientation), input.rayleigh(orientation));
+		const complex<double> image = (m[0]*q + m[1])/(m[2]*q + m[3]);
+		result.setWaistPosition(node.stop - image.real(), orientation);
+		result.setRayleigh(image.imag(), orientation);
+	}
+
+	const double angle = input.angle();
+	result.setOrigin(input.origin() + Utils::Point(cos(angle)*node.tx - sin(angle)*node.ty,
+	                                               sin(angle)*node.tx + cos(angle)*node.ty));
+	result.setAngle(angle + node.rotation);
+
+	return result;
+}
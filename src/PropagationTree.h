@@ -0,0 +1,107 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef PROPAGATIONTREE_H
+#define PROPAGATIONTREE_H
+
+#include "GaussianBeam.h"
+
+#include <vector>
+
+class Optics;
+
+/**
+* Segment tree of the transformations applied by a sequence of optics to a beam.
+* Each optics maps the q parameter q = z - waistPosition + i*rayleigh, from its input plane
+* to its output plane, through the Möbius transformation of its ABCD matrix, and moves the
+* beam frame by a rigid transformation (mirrors). These transformations are composed in
+* the tree nodes, with the free propagation between the output plane of a node and the input
+* plane of the next one, so that changing one optics updates O(log N) nodes, and the beam
+* after any optics is obtained in O(log N).
+* Nodes work on q parameters relative to their planes, rather than on absolute waist
+* positions: their coefficients stay of the order of the optics matrices and of the gaps,
+* and do not lose precision on long benches.
+* Optics that are not ABCD optics nor CreateBeam, or whose ABCD matrix is not invertible with
+* a positive determinant, make the tree invalid: beams then have to be propagated with Optics::image.
+*/
+class PropagationTree
+{
+public:
+	/// Constructor
+	PropagationTree();
+
+public:
+	/// Build the tree for the ordered optics @p optics, propagating a beam of wavelength @p wavelength
+	void build(const std::vector<Optics*>& optics, double wavelength);
+	/// Update the transformation of the optics at index @p index, which is now @p optics
+	void update(int index, const Optics* optics);
+	/**
+	* Update the optics that changed position or index in @p optics, which must have the same
+	* size as the tree. Other properties of the optics are assumed unchanged.
+	* @return the smallest updated index, or optics.size() if nothing changed
+	*/
+	int synchronize(const std::vector<Optics*>& optics);
+	/// @return the number of optics in the tree
+	int size() const { return m_size; }
+	/// @return true if the tree can compute beams, i.e. all optics could be converted
+	bool isValid() const { return (m_size > 0) && m_nodes[1].valid; }
+	/// @return true if all optics are spherical
+	bool isSpherical() const { return (m_size == 0) || m_nodes[1].spherical; }
+	/// @return true if all beams propagate along the same axis
+	bool is1D() const { return (m_size == 0) || m_nodes[1].oneD; }
+	/// @return the beam after optics @p index
+	Beam beam(int index) const;
+
+private:
+	struct Node
+	{
+		/// Leaf index of the last CreateBeam in the node, or -1. The beam before such a node is discarded
+		int reset;
+		/// True for the identity node, that has no planes
+		bool empty;
+		/// Input and output planes
+		double start, stop;
+		/// Möbius transformation (a, b, c, d) of the q parameter from the input to the output plane, per orientation
+		double matrix[2][4];
+		/// Product of the index jumps
+		double indexJump;
+		/// Rigid transformation of the beam frame: translation and rotation, in the frame before the node
+		double tx, ty, rotation;
+		bool valid, spherical, oneD;
+	};
+
+	static Node identity();
+	static Node compose(const Node& first, const Node& second);
+	Node leaf(int index, const Optics* optics);
+	void updateParents(int node);
+
+private:
+	int m_size;
+	/// Number of leaves: the smallest power of two larger than m_size
+	int m_leaves;
+	/// Node 1 is the root, node i has children 2i and 2i + 1, leaves start at m_leaves
+	std::vector<Node> m_nodes;
+	/// Optics and position of each leaf, to detect changes
+	std::vector<const Optics*> m_optics;
+	std::vector<double> m_position;
+	/// Beam produced by each CreateBeam leaf
+	std::vector<Beam> m_createdBeam;
+	double m_wavelength;
+};
+
+#endif
@@ -0,0 +1,293 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+#include "StabilityMap.h"
+#include "ParameterSweep.h"
+#include "Cavity.h"
+#include "Optics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+using namespace std;
+
+/// 2x2 ray transfer matrix
+struct RayMatrix
+{
+	RayMatrix(double A = 1., double B = 0., double C = 0., double D = 1.) : A(A), B(B), C(C), D(D) {}
+	double A, B, C, D;
+};
+
+static RayMatrix operator*(const RayMatrix& m1, const RayMatrix& m2)
+{
+	return RayMatrix(m1.A*m2.A + m1.B*m2.C, m1.A*m2.B + m1.B*m2.D,
+	                 m1.C*m2.A + m1.D*m2.C, m1.C*m2.B + m1.D*m2.D);
+}
+
+// Multiply the @p n matrices of coefficients @p A, @p B, @p C, @p D by @p m, on the right
+static void multiply(double* A, double* B, double* C, double* D, const RayMatrix& m, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		const double a = A[i]*m.A + B[i]*m.C, b = A[i]*m.B + B[i]*m.D;
+		const double c = C[i]*m.A + D[i]*m.C, d = C[i]*m.B + D[i]*m.D;
+		A[i] = a; B[i] = b; C[i] = c; D[i] = d;
+	}
+}
+
+StabilityMap::StabilityMap(const Cavity& cavity, double wavelength)
+	: m_cavity(cavity)
+	, m_wavelength(wavelength)
+	, m_orientation(Horizontal)
+	, m_threadCount(0)
+	, m_width(0)
+	, m_height(0)
+{
+}
+
+string StabilityMap::parameterName(const StabilityParameter& parameter) const
+{
+	const string name = m_cavity.optics(parameter.element)->name();
+	if (parameter.property == StabilityParameter::FocalProperty)
+		return name + ".focal";
+	else if (parameter.property == StabilityParameter::CurvatureRadiusProperty)
+		return name + ".curvatureRadius";
+
+	return name + ".freeSpace";
+}
+
+bool StabilityMap::check()
+{
+	const int n = m_cavity.nOptics();
+	if (n == 0)
+	{
+		m_errorString = "the cavity does not contain any optics";
+		return false;
+	}
+
+	for (int p = 0; p < 2; p++)
+	{
+		const StabilityParameter& parameter = m_parameters[p];
+		if (parameter.steps < 1)
+		{
+			m_errorString = "map parameters need at least one step";
+			return false;
+		}
+		if ((parameter.element < 0) || (parameter.element >= n) || (parameter.linkedElement >= n) ||
+		    ((parameter.linkedElement >= 0) && (parameter.property != StabilityParameter::LengthProperty)))
+		{
+			m_errorString = "map parameter of a non existing cavity element";
+			return false;
+		}
+		const ABCD* optics = m_cavity.optics(parameter.element);
+		if ((parameter.property == StabilityParameter::FocalProperty) && !dynamic_cast<const Lens*>(optics))
+		{
+			m_errorString = optics->name() + " does not have a focal length";
+			return false;
+		}
+		if ((parameter.property == StabilityParameter::CurvatureRadiusProperty) && !dynamic_cast<const CurvedMirror*>(optics))
+		{
+			m_errorString = optics->name() + " does not have a curvature radius";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool StabilityMap::run()
+{
+	m_errorString.clear();
+	m_width = m_height = 0;
+	m_stability.clear();
+	m_gouyPhase.clear();
+	m_waist.clear();
+	if (!check())
+		return false;
+
+	// Factors of the round trip matrix, starting after the first optics: the first optics on the
+	// left, then the closing free space, the last optics, the free space before the last optics...
+	// down to the free space after the first optics on the right
+	const int n = m_cavity.nOptics();
+	const Orientation orientation = (m_orientation == Spherical) ? Horizontal : m_orientation;
+	vector<RayMatrix> factors(2*n);
+	vector<double> nominal(2*n, 0.);
+	for (int k = 0; k < n; k++)
+	{
+		const ABCD* optics = m_cavity.optics(k);
+		const int opticsFactor = (k == 0) ? 0 : 2*(n - k);
+		const ABCD::Matrix& matrix = optics->matrix(orientation);
+		factors[opticsFactor] = RayMatrix(matrix.A, matrix.B, matrix.C, matrix.D);
+		if (const Lens* lens = dynamic_cast<const Lens*>(optics))
+			nominal[opticsFactor] = lens->focal();
+		else if (const CurvedMirror* mirror = dynamic_cast<const CurvedMirror*>(optics))
+			nominal[opticsFactor] = mirror->curvatureRadius();
+		const double length = (k == n - 1) ? m_cavity.closingFreeSpace() : m_cavity.optics(k + 1)->position() - optics->endPosition();
+		factors[2*(n - k) - 1] = RayMatrix(1., length, 0., 1.);
+	}
+
+	// Parameter that drives each factor, or -1
+	vector<int> driver(2*n, -1);
+	for (int p = 0; p < 2; p++)
+	{
+		const StabilityParameter& parameter = m_parameters[p];
+		vector<int> driven;
+		if (parameter.property == StabilityParameter::LengthProperty)
+		{
+			driven.push_back(2*(n - parameter.element) - 1);
+			if (parameter.linkedElement >= 0)
+				driven.push_back(2*(n - parameter.linkedElement) - 1);
+		}
+		else
+			driven.push_back(parameter.element == 0 ? 0 : 2*(n - parameter.element));
+		for (vector<int>::const_iterator it = driven.begin(); it != driven.end(); it++)
+		{
+			if ((driver[*it] >= 0) && (driver[*it] != p))
+			{
+				m_errorString = "the two map parameters change the same cavity element";
+				return false;
+			}
+			driver[*it] = p;
+		}
+	}
+
+	// Factor @p f for the value @p value of its parameter
+	auto factor = [&](int f, double value)
+	{
+		RayMatrix result = factors[f];
+		if (f % 2 == 1)
+			result.B = value;
+		else
+			result.C *= nominal[f]/value;
+		return result;
+	};
+
+	m_width = m_parameters[0].steps;
+	m_height = m_parameters[1].steps;
+	m_stability.resize(m_width*m_height);
+	m_gouyPhase.resize(m_width*m_height);
+	m_waist.resize(m_width*m_height);
+	vector<double> xValues(m_width);
+	for (int x = 0; x < m_width; x++)
+		xValues[x] = m_parameters[0].value(x);
+	const double nan = numeric_limits<double>::quiet_NaN();
+	atomic<int> nextRow(0);
+
+	auto compute = [&]()
+	{
+		vector<double> A(m_width), B(m_width), C(m_width), D(m_width);
+
+		for (int y = nextRow++; y < m_height; y = nextRow++)
+		{
+			// Products of the factors that do not depend on x, between the factors that depend on x
+			const double yValue = m_parameters[1].value(y);
+			RayMatrix constant;
+			fill(A.begin(), A.end(), 1.);
+			fill(B.begin(), B.end(), 0.);
+			fill(C.begin(), C.end(), 0.);
+			fill(D.begin(), D.end(), 1.);
+			for (int f = 0; f < 2*n; f++)
+			{
+				if (driver[f] != 0)
+				{
+					constant = constant*(driver[f] == 1 ? factor(f, yValue) : factors[f]);
+					continue;
+				}
+				multiply(&A[0], &B[0], &C[0], &D[0], constant, m_width);
+				constant = RayMatrix();
+				if (f % 2 == 1)
+					// Free space of length x
+					for (int x = 0; x < m_width; x++)
+					{
+						B[x] += A[x]*xValues[x];
+						D[x] += C[x]*xValues[x];
+					}
+				else
+				{
+					// Thin optics of focal length or curvature radius x
+					const RayMatrix& m = factors[f];
+					for (int x = 0; x < m_width; x++)
+					{
+						const double mC = m.C*nominal[f]/xValues[x];
+						const double a = A[x]*m.A + B[x]*mC, b = A[x]*m.B + B[x]*m.D;
+						const double c = C[x]*m.A + D[x]*mC, d = C[x]*m.B + D[x]*m.D;
+						A[x] = a; B[x] = b; C[x] = c; D[x] = d;
+					}
+				}
+			}
+			multiply(&A[0], &B[0], &C[0], &D[0], constant, m_width);
+
+			// Stability criterion and eigen mode, as in Cavity::isStable() and Cavity::eigenBeam()
+			for (int x = 0; x < m_width; x++)
+			{
+				const int point = y*m_width + x;
+				const double delta = sqr(D[x] - A[x]) + 4.*B[x]*C[x];
+				m_stability[point] = 0.5*(A[x] + D[x]);
+				m_gouyPhase[point] = nan;
+				m_waist[point] = nan;
+				if (delta < 0.)
+				{
+					const double gouyPhase = acos(::max(-1., ::min(1., m_stability[point])));
+					m_gouyPhase[point] = B[x] < 0. ? -gouyPhase : gouyPhase;
+					m_waist[point] = sqrt(0.5*sqrt(-delta)/fabs(C[x])*m_wavelength/M_PI);
+				}
+			}
+		}
+	};
+
+	const int nThreads = ::max(1, ::min(m_threadCount > 0 ? m_threadCount : int(thread::hardware_concurrency()), m_height));
+	vector<thread> workers;
+	for (int i = 1; i < nThreads; i++)
+		workers.push_back(thread(compute));
+	compute();
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++)
+		it->join();
+
+	return true;
+}
+
+bool StabilityMap::write(SweepWriter& writer) const
+{
+	vector<string> columns;
+	columns.push_back(parameterName(m_parameters[0]));
+	columns.push_back(parameterName(m_parameters[1]));
+	columns.push_back("stability");
+	columns.push_back("gouyPhase");
+	columns.push_back("waist");
+	if (!writer.begin(columns))
+		return false;
+
+	double row[5];
+	for (int y = 0; y < m_height; y++)
+		for (int x = 0; x < m_width; x++)
+		{
+			row[0] = m_parameters[0].value(x);
+			row[1] = m_parameters[1].value(y);
+			row[2] = stability(x, y);
+			row[3] = gouyPhase(x, y);
+			row[4] = waist(x, y);
+			if (!writer.write(row))
+				return false;
+		}
+
+	return writer.end();
+}
@@ -0,0 +1,119 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef STABILITYMAP_H
+#define STABILITYMAP_H
+
+#include "GaussianBeam.h"
+
+#include <string>
+#include <vector>
+
+class Cavity;
+class SweepWriter;
+
+/// Cavity parameter varied along an axis of a stability map, on a regular grid from @p start to @p stop
+struct StabilityParameter
+{
+	enum Property {LengthProperty, FocalProperty, CurvatureRadiusProperty};
+
+	StabilityParameter(Property property = LengthProperty, int element = 0, double start = 0., double stop = 0., int steps = 1,
+	                   int linkedElement = -1)
+		: property(property), element(element), linkedElement(linkedElement), start(start), stop(stop), steps(steps) {}
+
+	/// @return the value of the parameter at grid step @p step
+	double value(int step) const { return steps > 1 ? start + (stop - start)*step/(steps - 1) : start; }
+
+	Property property;
+	/**
+	* Index of the optics in the cavity. For lengths, the free space that follows this optics:
+	* the free space after the last optics is the closing free space of the cavity
+	*/
+	int element;
+	/// For lengths, an other free space that has the same length, e.g. the return path of a linear cavity. -1 for none
+	int linkedElement;
+	double start;
+	double stop;
+	int steps;          ///< Number of values, including @p start and @p stop
+};
+
+/**
+* Stability map of a cavity over a grid of two parameters. At each grid point, the map holds the
+* stability parameter (A + D)/2 of the round trip matrix, which is between -1 and 1 for stable
+* cavities (see Cavity::isStable()), the Gouy phase per round trip and the waist of the eigen mode
+* after the first optics of the cavity (see Cavity::eigenBeam()). The Gouy phase and the waist
+* are NaN for unstable grid points.
+*
+* The round trip matrix is split into the factors that depend on each parameter and constant
+* products of the other factors, computed once. Each row of the grid is then evaluated by
+* a few 2x2 matrix products on arrays of coefficients, and rows are computed in parallel.
+*/
+class StabilityMap
+{
+public:
+	/// Constructor. The optics of @p cavity are read when calling run()
+	StabilityMap(const Cavity& cavity, double wavelength);
+
+public:
+	/// Parameter along the x axis of the map
+	void setXParameter(const StabilityParameter& parameter) { m_parameters[0] = parameter; }
+	/// Parameter along the y axis of the map
+	void setYParameter(const StabilityParameter& parameter) { m_parameters[1] = parameter; }
+	/// Orientation of the round trip matrix, for astigmatic cavities. Defaults to Horizontal
+	void setOrientation(Orientation orientation) { m_orientation = orientation; }
+	/// Number of threads. 0, the default, uses all the cores
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+	/// Compute the map. @return true on success
+	bool run();
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+	/// @return the number of grid points along the x axis
+	int width() const { return m_width; }
+	/// @return the number of grid points along the y axis
+	int height() const { return m_height; }
+	/// @return the stability parameter at grid point (@p x, @p y)
+	double stability(int x, int y) const { return m_stability[y*m_width + x]; }
+	/// @return the Gouy phase per round trip at grid point (@p x, @p y)
+	double gouyPhase(int x, int y) const { return m_gouyPhase[y*m_width + x]; }
+	/// @return the eigen mode waist at grid point (@p x, @p y)
+	double waist(int x, int y) const { return m_waist[y*m_width + x]; }
+	/**
+	* Write the map to @p writer, one row per grid point, x varying fastest. The columns are
+	* the two parameters, the stability parameter, the Gouy phase and the waist. @return true on success
+	*/
+	bool write(SweepWriter& writer) const;
+
+private:
+	bool check();
+	std::string parameterName(const StabilityParameter& parameter) const;
+
+private:
+	const Cavity& m_cavity;
+	double m_wavelength;
+	StabilityParameter m_parameters[2];
+	Orientation m_orientation;
+	int m_threadCount;
+	std::string m_errorString;
+	int m_width, m_height;
+	std::vector<double> m_stability;
+	std::vector<double> m_gouyPhase;
+	std::vector<double> m_waist;
+};
+
+#endif
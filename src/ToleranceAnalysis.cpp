@@ -0,0 +1,247 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "ToleranceAnalysis.h"
+#include "CompiledBench.h"
+#include "OpticsBench.h"
+#include "Optics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+/// Number of samples drawn from the same random generator
+static const int chunkSize = 4096;
+
+// @return a uniform deviate in ]0, 1[. mt19937 is fully specified by the standard, but the
+// distributions of <random> are not: they are not used, so that a seed gives the same errors on all platforms
+static inline double uniformDeviate(mt19937& generator)
+{
+	return (double(generator()) + 0.5)/4294967296.;
+}
+
+static double randomError(const Tolerance& tolerance, mt19937& generator)
+{
+	if (tolerance.distribution == Tolerance::UniformDistribution)
+		return tolerance.width*(2.*uniformDeviate(generator) - 1.);
+
+	// Box-Muller transform
+	const double radius = sqrt(-2.*log(uniformDeviate(generator)));
+	return tolerance.width*radius*cos(2.*M_PI*uniformDeviate(generator));
+}
+
+/////////////////////////////////////////////////
+// OverlapDistribution
+
+OverlapDistribution::OverlapDistribution()
+	: m_mean(0.)
+	, m_standardDeviation(0.)
+{
+}
+
+void OverlapDistribution::setSamples(vector<double>& samples)
+{
+	m_samples.swap(samples);
+	sort(m_samples.begin(), m_samples.end());
+
+	double sum = 0., squareSum = 0.;
+	for (vector<double>::const_iterator it = m_samples.begin(); it != m_samples.end(); it++)
+	{
+		sum += *it;
+		squareSum += (*it)*(*it);
+	}
+	const double n = ::max(size(), 1);
+	m_mean = sum/n;
+	m_standardDeviation = sqrt(::max(squareSum/n - m_mean*m_mean, 0.));
+}
+
+double OverlapDistribution::percentile(double fraction) const
+{
+	if (m_samples.empty())
+		return 0.;
+
+	// Linear interpolation between the closest ranks
+	const double rank = ::min(::max(fraction, 0.), 1.)*(size() - 1);
+	const int lower = int(rank);
+	const int upper = ::min(lower + 1, size() - 1);
+	return m_samples[lower] + (rank - lower)*(m_samples[upper] - m_samples[lower]);
+}
+
+vector<int> OverlapDistribution::histogram(int bins) const
+{
+	vector<int> result(bins, 0);
+	for (vector<double>::const_iterator it = m_samples.begin(); it != m_samples.end(); it++)
+		result[::min(::max(int(*it*bins), 0), bins - 1)]++;
+
+	return result;
+}
+
+/////////////////////////////////////////////////
+// ToleranceAnalysis
+
+ToleranceAnalysis::ToleranceAnalysis(const OpticsBench& bench)
+	: m_bench(bench)
+	, m_threadCount(0)
+	, m_nominalOverlap(0.)
+{
+}
+
+bool ToleranceAnalysis::check()
+{
+	if (m_bench.nOptics() == 0)
+	{
+		m_errorString = "the bench does not contain any optics";
+		return false;
+	}
+
+	for (vector<Tolerance>::const_iterator it = m_tolerances.begin(); it != m_tolerances.end(); it++)
+	{
+		if ((it->parameter != Tolerance::PositionParameter) && (it->parameter != Tolerance::FocalParameter))
+			continue;
+		if ((it->optics <= 0) || (it->optics >= m_bench.nOptics()))
+		{
+			m_errorString = "tolerance of a non existing optics";
+			return false;
+		}
+		const OpticsType type = m_bench.optics(it->optics)->type();
+		if ((it->parameter == Tolerance::FocalParameter) && (type != LensType) && (type != CurvedMirrorType))
+		{
+			m_errorString = m_bench.optics(it->optics)->name() + " is not a thin lens nor a curved mirror";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ToleranceAnalysis::run(int samples, unsigned int seed)
+{
+	m_errorString.clear();
+	if (!check())
+		return false;
+
+	// Compile a copy of the optics, so that the bench may change while the analysis runs
+	vector<Optics*> optics;
+	for (int i = 0; i < m_bench.nOptics(); i++)
+		optics.push_back(m_bench.optics(i)->clone());
+	CompiledBench compiledBench;
+	compiledBench.compile(optics, m_bench.wavelength());
+	for (vector<Optics*>::iterator it = optics.begin(); it != optics.end(); it++)
+		delete *it;
+	if (!compiledBench.isValid())
+	{
+		m_errorString = "the bench contains optics that do not have an ABCD matrix";
+		return false;
+	}
+
+	const int n = compiledBench.size();
+	const int nTolerance = m_tolerances.size();
+	const BeamState target = BeamState::fromBeam(*m_bench.targetBeam());
+
+	// Overlap for the errors @p error. Only tolerance @p only is applied if it is not negative
+	auto overlap = [&](const double* error, int only, CompiledBench::Workspace& workspace, double* position, double* powerScale)
+	{
+		CompiledBench::Perturbation perturbation;
+		perturbation.powerScale = powerScale;
+		for (int i = 0; i < n; i++)
+		{
+			position[i] = compiledBench.position(i);
+			powerScale[i] = 1.;
+		}
+		for (int t = 0; t < nTolerance; t++)
+			if ((only < 0) || (only == t))
+			{
+				const Tolerance& tolerance = m_tolerances[t];
+				if (tolerance.parameter == Tolerance::PositionParameter)
+					position[tolerance.optics] += error[t];
+				else if (tolerance.parameter == Tolerance::FocalParameter)
+					powerScale[tolerance.optics] /= 1. + error[t];
+				else if (tolerance.parameter == Tolerance::InputWaistParameter)
+					perturbation.waistScale *= 1. + error[t];
+				else if (tolerance.parameter == Tolerance::WavelengthParameter)
+					perturbation.wavelengthScale *= 1. + error[t];
+			}
+
+		compiledBench.place(position, n, false, workspace);
+		// The target beam keeps its waist at the perturbed wavelength
+		BeamState perturbedTarget = target;
+		perturbedTarget.wavelength *= perturbation.wavelengthScale;
+		perturbedTarget.rayleigh[0] /= perturbation.wavelengthScale;
+		perturbedTarget.rayleigh[1] /= perturbation.wavelengthScale;
+		return BeamState::overlap(perturbedTarget, compiledBench.propagate(workspace, perturbation));
+	};
+
+	{
+		CompiledBench::Workspace workspace;
+		compiledBench.initWorkspace(workspace);
+		vector<double> position(n), powerScale(n), error(nTolerance + 1, 0.);
+		m_nominalOverlap = overlap(&error[0], -1, workspace, &position[0], &powerScale[0]);
+	}
+
+	// Samples are drawn by chunks, each chunk having its own random generator
+	samples = ::max(samples, 0);
+	const int nChunk = (samples + chunkSize - 1)/chunkSize;
+	vector<double> overlaps(samples);
+	vector<double> chunkLoss(nChunk*nTolerance, 0.);
+	atomic<int> nextChunk(0);
+
+	auto analyse = [&]()
+	{
+		CompiledBench::Workspace workspace;
+		compiledBench.initWorkspace(workspace);
+		vector<double> position(n), powerScale(n), error(nTolerance + 1);
+
+		for (int chunk = nextChunk++; chunk < nChunk; chunk = nextChunk++)
+		{
+			seed_seq seedSequence{seed, (unsigned int)chunk};
+			mt19937 generator(seedSequence);
+			const int chunkEnd = ::min(samples, (chunk + 1)*chunkSize);
+			for (int s = chunk*chunkSize; s < chunkEnd; s++)
+			{
+				for (int t = 0; t < nTolerance; t++)
+					error[t] = randomError(m_tolerances[t], generator);
+				overlaps[s] = overlap(&error[0], -1, workspace, &position[0], &powerScale[0]);
+				for (int t = 0; t < nTolerance; t++)
+					chunkLoss[chunk*nTolerance + t] += m_nominalOverlap - overlap(&error[0], t, workspace, &position[0], &powerScale[0]);
+			}
+		}
+	};
+
+	const int nThreads = ::max(1, ::min(m_threadCount > 0 ? m_threadCount : int(thread::hardware_concurrency()), nChunk));
+	vector<thread> workers;
+	for (int i = 1; i < nThreads; i++)
+		workers.push_back(thread(analyse));
+	analyse();
+	for (vector<thread>::iterator it = workers.begin(); it != workers.end(); it++)
+		it->join();
+
+	// Sum the chunks in order, so that the result does not depend on the number of threads
+	m_contribution.assign(nTolerance, 0.);
+	for (int chunk = 0; chunk < nChunk; chunk++)
+		for (int t = 0; t < nTolerance; t++)
+			m_contribution[t] += chunkLoss[chunk*nTolerance + t];
+	for (int t = 0; t < nTolerance; t++)
+		m_contribution[t] /= ::max(samples, 1);
+	m_overlap.setSamples(overlaps);
+
+	return true;
+}
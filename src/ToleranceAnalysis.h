@@ -0,0 +1,121 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef TOLERANCEANALYSIS_H
+#define TOLERANCEANALYSIS_H
+
+#include <string>
+#include <vector>
+
+class OpticsBench;
+
+/// Random error of a parameter of the bench
+struct Tolerance
+{
+	enum Parameter {PositionParameter, FocalParameter, InputWaistParameter, WavelengthParameter};
+	enum Distribution {GaussianDistribution, UniformDistribution};
+
+	Tolerance(Parameter parameter = PositionParameter, int optics = 0, double width = 0.,
+	          Distribution distribution = GaussianDistribution)
+		: parameter(parameter), optics(optics), width(width), distribution(distribution) {}
+
+	Parameter parameter;
+	/// Index of the optics in the bench, for positions and focal lengths
+	int optics;
+	/**
+	* Standard deviation of a Gaussian distribution, or half width of a uniform distribution.
+	* Position errors are absolute. Focal length, input waist and wavelength errors are relative:
+	* for instance, a focal length tolerance of 0.01 is a 1% error.
+	*/
+	double width;
+	Distribution distribution;
+};
+
+/// Distribution of the overlap with the target beam
+class OverlapDistribution
+{
+public:
+	OverlapDistribution();
+
+public:
+	/// Set the samples of the distribution
+	void setSamples(std::vector<double>& samples);
+	/// @return the number of samples
+	int size() const { return m_samples.size(); }
+	double mean() const { return m_mean; }
+	double standardDeviation() const { return m_standardDeviation; }
+	/// @return the overlap that a fraction @p fraction of the samples do not exceed
+	double percentile(double fraction) const;
+	/// @return the number of samples in each of @p bins bins regularly spaced between 0 and 1
+	std::vector<int> histogram(int bins) const;
+
+private:
+	std::vector<double> m_samples;
+	double m_mean;
+	double m_standardDeviation;
+};
+
+/**
+* Monte-Carlo tolerance analysis: draw random errors of the optics positions, focal lengths,
+* input waist and wavelength, and compute the distribution of the overlap between the output beam
+* and the target beam. The optics are compiled once into a CompiledBench, so that samples are
+* evaluated without cloning optics nor allocating memory.
+* The contribution of each tolerance is the mean overlap loss with respect to the nominal overlap,
+* when only this tolerance is applied, for the same random errors.
+* The random sequence is derived from a seed: running again with the same seed
+* gives the same result, whatever the number of threads.
+*/
+class ToleranceAnalysis
+{
+public:
+	/// Constructor. The optics and the target beam of @p bench are copied when calling run()
+	ToleranceAnalysis(const OpticsBench& bench);
+
+public:
+	/// Add a tolerance
+	void addTolerance(const Tolerance& tolerance) { m_tolerances.push_back(tolerance); }
+	/// @return the number of tolerances
+	int nTolerances() const { return m_tolerances.size(); }
+	/// Number of threads. 0, the default, uses all the cores
+	void setThreadCount(int threadCount) { m_threadCount = threadCount; }
+	/// Draw @p samples samples from the random sequence @p seed. @return true on success
+	bool run(int samples, unsigned int seed);
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+
+	/// @return the overlap without errors
+	double nominalOverlap() const { return m_nominalOverlap; }
+	/// @return the distribution of the overlap with all the errors
+	const OverlapDistribution& overlap() const { return m_overlap; }
+	/// @return the mean overlap loss due to tolerance @p index alone
+	double contribution(int index) const { return m_contribution[index]; }
+
+private:
+	bool check();
+
+private:
+	const OpticsBench& m_bench;
+	std::vector<Tolerance> m_tolerances;
+	int m_threadCount;
+	std::string m_errorString;
+	double m_nominalOverlap;
+	OverlapDistribution m_overlap;
+	std::vector<double> m_contribution;
+};
+
+#endif
@@ -0,0 +1,468 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "XmlReader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+static const int endOfFile = char_traits<char>::eof();
+
+static bool isSpace(int c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+static bool isNameChar(int c)
+{
+	return (c != endOfFile) && !isSpace(c) && (c != '>') && (c != '/') && (c != '=') && (c != '<') && (c != '?');
+}
+
+XmlReader::XmlReader(istream& stream)
+	: m_buffer(stream.rdbuf())
+	, m_tokenType(NoToken)
+	, m_emptyElement(false)
+	, m_line(1)
+{
+}
+
+/////////////////////////////////////////////////
+// Public interface
+
+XmlReader::TokenType XmlReader::readNext()
+{
+	if (atEnd())
+		return m_tokenType;
+
+	// <element/> is reported as a start element followed by an end element
+	if (m_emptyElement)
+	{
+		m_emptyElement = false;
+		m_attributes.clear();
+		m_elementStack.pop_back();
+		return m_tokenType = EndElement;
+	}
+
+	while (true)
+	{
+		int c = peek();
+
+		if (c == endOfFile)
+		{
+			if (!m_elementStack.empty())
+				return raiseError("Premature end of document");
+			return m_tokenType = EndDocument;
+		}
+		else if (c == '<')
+		{
+			get();
+			c = peek();
+			if (c == '?')
+			{
+				if (!skipUntil("?>"))
+					return raiseError("Unterminated processing instruction");
+			}
+			else if (c == '!')
+			{
+				get();
+				if (!readDeclaration())
+					return m_tokenType;
+				if (m_tokenType == Characters)
+					return m_tokenType;
+			}
+			else if (c == '/')
+			{
+				get();
+				if (!readEndElement())
+					return m_tokenType;
+				return m_tokenType = EndElement;
+			}
+			else
+			{
+				if (!readStartElement())
+					return m_tokenType;
+				return m_tokenType = StartElement;
+			}
+		}
+		else
+		{
+			readCharacters();
+			if (m_tokenType == Invalid)
+				return m_tokenType;
+			if (m_elementStack.empty())
+			{
+				if (!m_text.empty())
+					return raiseError("Text outside the root element");
+				continue;
+			}
+			if (!m_text.empty())
+				return m_tokenType = Characters;
+		}
+	}
+}
+
+bool XmlReader::readNextStartElement()
+{
+	while (!atEnd())
+	{
+		TokenType type = readNext();
+		if (type == StartElement)
+			return true;
+		else if (type == EndElement)
+			return false;
+	}
+
+	return false;
+}
+
+void XmlReader::skipCurrentElement()
+{
+	int depth = 1;
+	while ((depth > 0) && !atEnd())
+	{
+		TokenType type = readNext();
+		if (type == StartElement)
+			depth++;
+		else if (type == EndElement)
+			depth--;
+	}
+}
+
+string XmlReader::readElementText()
+{
+	string result;
+
+	while (!atEnd())
+	{
+		TokenType type = readNext();
+		if (type == Characters)
+			result += m_text;
+		else if (type == StartElement)
+			skipCurrentElement();
+		else if (type == EndElement)
+			break;
+	}
+
+	return result;
+}
+
+bool XmlReader::hasAttribute(const string& name) const
+{
+	for (vector<pair<string, string> >::const_iterator it = m_attributes.begin(); it != m_attributes.end(); it++)
+		if (it->first == name)
+			return true;
+
+	return false;
+}
+
+string XmlReader::attribute(const string& name) const
+{
+	for (vector<pair<string, string> >::const_iterator it = m_attributes.begin(); it != m_attributes.end(); it++)
+		if (it->first == name)
+			return it->second;
+
+	return string();
+}
+
+/////////////////////////////////////////////////
+// Tokenizer
+
+int XmlReader::get()
+{
+	int c = m_buffer->sbumpc();
+	if (c == '\n')
+		m_line++;
+	return c;
+}
+
+int XmlReader::peek()
+{
+	return m_buffer->sgetc();
+}
+
+bool XmlReader::skipUntil(const char* delimiter)
+{
+	const size_t length = strlen(delimiter);
+	size_t matched = 0;
+
+	for (int c = get(); c != endOfFile; c = get())
+	{
+		if (c == delimiter[matched])
+			matched++;
+		else
+			matched = (c == delimiter[0]) ? 1 : 0;
+		if (matched == length)
+			return true;
+	}
+
+	return false;
+}
+
+void XmlReader::skipSpaces()
+{
+	while (isSpace(peek()))
+		get();
+}
+
+bool XmlReader::readName(string& name)
+{
+	name.clear();
+	while (isNameChar(peek()))
+		name += char(get());
+
+	return !name.empty();
+}
+
+bool XmlReader::readStartElement()
+{
+	m_attributes.clear();
+	if (!readName(m_name))
+	{
+		raiseError("Invalid element name");
+		return false;
+	}
+
+	while (true)
+	{
+		skipSpaces();
+		int c = peek();
+		if (c == '>')
+		{
+			get();
+			break;
+		}
+		else if (c == '/')
+		{
+			get();
+			if (get() != '>')
+			{
+				raiseError("Expected '>' after '/'");
+				return false;
+			}
+			m_emptyElement = true;
+			break;
+		}
+
+		// Attribute
+		string attributeName;
+		if (!readName(attributeName))
+		{
+			raiseError("Invalid attribute in element " + m_name);
+			return false;
+		}
+		skipSpaces();
+		if (get() != '=')
+		{
+			raiseError("Expected '=' after attribute " + attributeName);
+			return false;
+		}
+		skipSpaces();
+		int quote = get();
+		if ((quote != '"') && (quote != '\''))
+		{
+			raiseError("Expected quoted value for attribute " + attributeName);
+			return false;
+		}
+		string value;
+		for (c = get(); (c != quote) && (c != endOfFile); c = get())
+			value += char(c);
+		if ((c == endOfFile) || !decodeEntities(value))
+		{
+			raiseError("Invalid value for attribute " + attributeName);
+			return false;
+		}
+		m_attributes.push_back(make_pair(attributeName, value));
+	}
+
+	m_elementStack.push_back(m_name);
+	return true;
+}
+
+bool XmlReader::readEndElement()
+{
+	m_attributes.clear();
+	readName(m_name);
+	skipSpaces();
+	if (get() != '>')
+	{
+		raiseError("Expected '>' to close element " + m_name);
+		return false;
+	}
+	if (m_elementStack.empty() || (m_elementStack.back() != m_name))
+	{
+		raiseError("Unexpected end element " + m_name);
+		return false;
+	}
+
+	m_elementStack.pop_back();
+	return true;
+}
+
+bool XmlReader::readDeclaration()
+{
+	// Comment
+	if (peek() == '-')
+	{
+		get();
+		if ((get() != '-') || !skipUntil("-->"))
+		{
+			raiseError("Invalid comment");
+			return false;
+		}
+		m_tokenType = NoToken;
+		return true;
+	}
+
+	// CDATA section
+	if (peek() == '[')
+	{
+		const char* cdata = "[CDATA[";
+		for (const char* p = cdata; *p; p++)
+			if (get() != *p)
+			{
+				raiseError("Invalid CDATA section");
+				return false;
+			}
+		m_text.clear();
+		for (int c = get(); c != endOfFile; c = get())
+		{
+			m_text += char(c);
+			if ((m_text.size() >= 3) && (m_text.compare(m_text.size() - 3, 3, "]]>") == 0))
+			{
+				m_text.resize(m_text.size() - 3);
+				m_tokenType = Characters;
+				return true;
+			}
+		}
+		raiseError("Unterminated CDATA section");
+		return false;
+	}
+
+	// Document type declaration, possibly with an internal subset
+	int bracketDepth = 0;
+	for (int c = get(); c != endOfFile; c = get())
+	{
+		if (c == '[')
+			bracketDepth++;
+		else if (c == ']')
+			bracketDepth--;
+		else if ((c == '>') && (bracketDepth <= 0))
+		{
+			m_tokenType = NoToken;
+			return true;
+		}
+	}
+
+	raiseError("Unterminated declaration");
+	return false;
+}
+
+void XmlReader::readCharacters()
+{
+	m_text.clear();
+	bool blank = true;
+
+	for (int c = peek(); (c != '<') && (c != endOfFile); c = peek())
+	{
+		if (!isSpace(c))
+			blank = false;
+		m_text += char(get());
+	}
+
+	if (blank)
+		m_text.clear();
+	else if (!decodeEntities(m_text))
+		raiseError("Invalid entity reference");
+}
+
+bool XmlReader::decodeEntities(string& text)
+{
+	size_t pos = text.find('&');
+	if (pos == string::npos)
+		return true;
+
+	string result = text.substr(0, pos);
+
+	while (pos < text.size())
+	{
+		if (text[pos] != '&')
+		{
+			result += text[pos++];
+			continue;
+		}
+
+		size_t end = text.find(';', pos);
+		if (end == string::npos)
+			return false;
+		string entity = text.substr(pos + 1, end - pos - 1);
+
+		if (entity == "amp")
+			result += '&';
+		else if (entity == "lt")
+			result += '<';
+		else if (entity == "gt")
+			result += '>';
+		else if (entity == "quot")
+			result += '"';
+		else if (entity == "apos")
+			result += '\'';
+		else if ((entity.size() > 1) && (entity[0] == '#'))
+		{
+			// Character reference, encoded back to UTF-8
+			unsigned long code = (entity[1] == 'x') ? strtoul(entity.c_str() + 2, 0, 16) : strtoul(entity.c_str() + 1, 0, 10);
+			if (code < 0x80)
+				result += char(code);
+			else if (code < 0x800)
+			{
+				result += char(0xC0 | (code >> 6));
+				result += char(0x80 | (code & 0x3F));
+			}
+			else if (code < 0x10000)
+			{
+				result += char(0xE0 | (code >> 12));
+				result += char(0x80 | ((code >> 6) & 0x3F));
+				result += char(0x80 | (code & 0x3F));
+			}
+			else
+			{
+				result += char(0xF0 | (code >> 18));
+				result += char(0x80 | ((code >> 12) & 0x3F));
+				result += char(0x80 | ((code >> 6) & 0x3F));
+				result += char(0x80 | (code & 0x3F));
+			}
+		}
+		else
+			return false;
+
+		pos = end + 1;
+	}
+
+	text = result;
+	return true;
+}
+
+XmlReader::TokenType XmlReader::raiseError(const string& error)
+{
+	stringstream stream;
+	stream << error << " at line " << m_line;
+	m_errorString = stream.str();
+	return m_tokenType = Invalid;
+}
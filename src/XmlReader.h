@@ -0,0 +1,103 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef XMLREADER_H
+#define XMLREADER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+* Minimal streaming XML reader, in the spirit of QXmlStreamReader, that lets the
+* core read GaussianBeam files without depending on Qt.
+* It reads the input in a single pass and never builds a document tree.
+* Processing instructions, comments and the document type declaration are skipped,
+* and text made only of white spaces is not reported.
+* @todo namespaces are not supported
+*/
+class XmlReader
+{
+public:
+	enum TokenType {NoToken = 0, StartElement, EndElement, Characters, EndDocument, Invalid};
+
+public:
+	/// Constructor. @p stream has to outlive the reader
+	XmlReader(std::istream& stream);
+
+public:
+	/// Read the next token and @return its type
+	TokenType readNext();
+	/// @return the type of the current token
+	TokenType tokenType() const { return m_tokenType; }
+	/**
+	* Read until the next start element within the current element
+	* @return true if a start element was found, false if the end of the current element was reached
+	*/
+	bool readNextStartElement();
+	/// Read until the end of the current element, skipping all its children
+	void skipCurrentElement();
+	/// Read the text of the current element until its end. Text of child elements is discarded
+	std::string readElementText();
+	/// @return true if the end of the document was reached or an error occured
+	bool atEnd() const { return (m_tokenType == EndDocument) || (m_tokenType == Invalid); }
+
+	/// @return the name of the current start or end element
+	const std::string& name() const { return m_name; }
+	/// @return the text of the current characters token
+	const std::string& text() const { return m_text; }
+	/// @return true if the current start element has an attribute named @p name
+	bool hasAttribute(const std::string& name) const;
+	/// @return the value of attribute @p name of the current start element, or an empty string
+	std::string attribute(const std::string& name) const;
+
+	/// @return true if the document is not well formed
+	bool hasError() const { return m_tokenType == Invalid; }
+	/// @return a description of the last error
+	const std::string& errorString() const { return m_errorString; }
+	/// @return the line of the current position in the document
+	int lineNumber() const { return m_line; }
+	/// Stop reading with the error @p error, e.g. for a well formed document with invalid content
+	TokenType raiseError(const std::string& error);
+
+private:
+	int get();
+	int peek();
+	bool skipUntil(const char* delimiter);
+	void skipSpaces();
+	bool readName(std::string& name);
+	bool readStartElement();
+	bool readEndElement();
+	bool readDeclaration();
+	void readCharacters();
+	bool decodeEntities(std::string& text);
+
+private:
+	std::streambuf* m_buffer;
+	TokenType m_tokenType;
+	std::string m_name;
+	std::string m_text;
+	std::vector<std::pair<std::string, std::string> > m_attributes;
+	std::vector<std::string> m_elementStack;
+	bool m_emptyElement;
+	std::string m_errorString;
+	int m_line;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/**
+* Timings of the compiled bench evaluations: single and batched propagations, on spherical
+* and astigmatic benches. The "general" bench is the spherical bench, run through the astigmatic
+* kernels, to measure the gain of the spherical kernels. Build in Release mode and run gaussianbeam_corebench.
+* Each timing is the best of nTrials runs, to filter out the noise of other processes.
+*/
+
+#include "src/OpticsBench.h"
+#include "src/OpticsFunction.h"
+#include "src/CompiledBench.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+static const int nLayouts = 4096;
+static const int nTrials = 50;
+
+// Accumulated results, so that the compiler does not optimize the evaluations away
+static double sink = 0.;
+
+enum BenchKind {SphericalBench, GeneralBench, AstigmaticBench};
+
+/**
+* Input beam and six lenses. Except for SphericalBench, the last lens is replaced by an ellipsoidal
+* ABCD optics, which is only astigmatic for AstigmaticBench
+*/
+static void populateBench(OpticsBench& bench, BenchKind kind)
+{
+	bench.populateDefault();
+	for (int i = 0; i < 6; i++)
+	{
+		const OpticsType type = ((kind != SphericalBench) && (i == 5)) ? GenericABCDType : LensType;
+		bench.addOptics(type, bench.nOptics());
+		bench.setOpticsPosition(bench.nOptics() - 1, 0.05 + 0.1*i);
+	}
+	if (kind != SphericalBench)
+	{
+		GenericABCD* abcd = dynamic_cast<GenericABCD*>(bench.opticsForPropertyChange(bench.nOptics() - 1));
+		abcd->setOrientation(Ellipsoidal);
+		abcd->setC(-5., Horizontal);
+		abcd->setC(kind == AstigmaticBench ? -2. : -5., Vertical);
+		bench.opticsPropertyChanged(bench.nOptics() - 1);
+	}
+}
+
+/// @return the shortest time per layout, in ns, of nTrials calls to @p run, which evaluates @p count layouts
+template<typename Run> static double bestTime(Run run, int count)
+{
+	double best = HUGE_VAL;
+	for (int trial = 0; trial < nTrials; trial++)
+	{
+		const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		run();
+		best = ::min(best, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count()/double(count));
+	}
+	return best;
+}
+
+/**
+* With @p reorder, the optics are placed anywhere on the bench, so that the layouts of a batch propagate through
+* the optics in different orders. Otherwise each optics stays in its slot, as during local optimizations
+*/
+static void benchmark(BenchKind kind, bool reorder)
+{
+	OpticsBench bench;
+	populateBench(bench, kind);
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*bench.targetBeam());
+	function.setCheckLock(false);
+
+	srand(1);
+	vector<vector<double> > points(nLayouts, function.currentPosition());
+	for (int p = 0; p < nLayouts; p++)
+		for (unsigned int i = 1; i < points[p].size(); i++)
+			points[p][i] = reorder ? 0.6*double(rand())/double(RAND_MAX) : 0.1*(i - 1) + 0.09*double(rand())/double(RAND_MAX);
+
+	// Propagation kernels alone, on placed optics
+	CompiledBench compiled;
+	compiled.compile(optics, bench.wavelength());
+	vector<CompiledBench::Workspace> workspaces(CompiledBench::batchSize);
+	for (int j = 0; j < CompiledBench::batchSize; j++)
+	{
+		compiled.initWorkspace(workspaces[j]);
+		compiled.place(&points[j][0], points[j].size(), false, workspaces[j]);
+	}
+	BeamState beams[CompiledBench::batchSize];
+
+	const int nBatches = nLayouts/CompiledBench::batchSize;
+	const double single = bestTime([&]()
+	{
+		for (int r = 0; r < nBatches; r++)
+			for (int j = 0; j < CompiledBench::batchSize; j++)
+				sink += compiled.propagate(workspaces[j]).rayleigh[0];
+	}, nLayouts);
+	const double batch = bestTime([&]()
+	{
+		for (int r = 0; r < nBatches; r++)
+		{
+			compiled.propagateBatch(&workspaces[0], CompiledBench::batchSize, beams);
+			sink += beams[0].rayleigh[0];
+		}
+	}, nLayouts);
+
+	// Optics function, including the placement of the optics and the overlap
+	const double value = bestTime([&]()
+	{
+		for (int p = 0; p < nLayouts; p++)
+			sink += function.value(points[p]);
+	}, nLayouts);
+	const double values = bestTime([&]() { sink += function.values(points)[0]; }, nLayouts);
+
+	static const char* const names[] = {"spherical ", "general   ", "astigmatic"};
+	cout << names[kind] << (reorder ? " reordered" : " in slots ") << fixed << setprecision(1)
+	     << "  propagate " << setw(6) << single << " ns  propagateBatch " << setw(6) << batch << " ns  ("
+	     << setprecision(2) << single/batch << "x)" << setprecision(1)
+	     << "  value " << setw(6) << value << " ns  values " << setw(6) << values << " ns  ("
+	     << setprecision(2) << value/values << "x)" << endl;
+}
+
+int main()
+{
+	cout << "Time per layout, " << CompiledBench::batchSize << " layouts per batch" << endl;
+	for (int reorder = 0; reorder < 2; reorder++)
+	{
+		benchmark(SphericalBench, reorder);
+		benchmark(GeneralBench, reorder);
+		benchmark(AstigmaticBench, reorder);
+	}
+
+	return sink == 0. ? 1 : 0;
+}
@@ -0,0 +1,1275 @@
+/* This file is part of the GaussianBeam project
+   Copyright (C) 2008-2010 Jérôme Lodewyck <jerome dot lodewyck at normalesup.org>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/*
+* Unit tests of the physics core. Unlike test.cpp, these tests do not depend
+* on Qt and run headless: a non zero return value reports failures.
+*/
+
+#include "src/OpticsBench.h"
+#include "src/OpticsFunction.h"
+#include "src/GaussianFit.h"
+#include "src/BenchFile.h"
+#include "src/BinaryFile.h"
+#include "src/ParameterSweep.h"
+#include "src/ToleranceAnalysis.h"
+#include "src/LensSelection.h"
+#include "src/StabilityMap.h"
+#include "src/CompiledBench.h"
+#include "src/Interval.h"
+#include "src/ObjectPool.h"
+
+#include <iostream>
+#include <cmath>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+
+using namespace std;
+
+static int failures = 0;
+
+#define VERIFY(condition) verify((condition), #condition, __FILE__, __LINE__)
+#define COMPARE_FUZZY(actual, expected, tolerance) verify(fabs((actual) - (expected)) <= (tolerance)*fabs(expected), \
+                                                          #actual " == " #expected, __FILE__, __LINE__)
+
+static void verify(bool condition, const char* statement, const char* file, int line)
+{
+	if (condition)
+		return;
+
+	cerr << "FAIL: " << statement << " (" << file << ":" << line << ")" << endl;
+	failures++;
+}
+
+/// @return the path of the temporary file @p name, in the build directory
+static string testFilePath(const string& name)
+{
+	return string(TEST_OUTPUT_DIR) + "/" + name;
+}
+
+/// Input beam, two lenses and the default target beam
+static void populateBench(OpticsBench& bench)
+{
+	bench.populateDefault();
+	bench.addOptics(LensType, bench.nOptics());
+	bench.addOptics(LensType, bench.nOptics());
+	bench.setOpticsPosition(1, 0.1);
+	bench.setOpticsPosition(2, 0.3);
+}
+
+void checkPropagation()
+{
+	OpticsBench bench;
+	populateBench(bench);
+
+	// Thin lens imaging of the q parameter
+	const Lens* lens = dynamic_cast<const Lens*>(bench.optics(1));
+	complex<double> q = bench.beam(0)->q(lens->position());
+	complex<double> image = q/(-q/lens->focal() + 1.);
+	VERIFY(abs(bench.beam(1)->q(lens->position()) - image) < 1e-12);
+
+	// The optics function reproduces the bench propagation
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*bench.targetBeam());
+	function.setCheckLock(false);
+	double overlap = Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam());
+	COMPARE_FUZZY(function.value(function.currentPosition()), overlap, 1e-12);
+
+	// Sensitivities are computed on demand, and follow optics moves
+	for (int move = 0; move < 2; move++)
+	{
+		OpticsFunction selfFunction(optics, bench.wavelength());
+		selfFunction.setOverlapBeam(*bench.beam(bench.nOptics()-1));
+		vector<double> curvature = selfFunction.Function::curvature(selfFunction.currentPosition());
+		for (int i = 1; i < bench.nOptics(); i++)
+			COMPARE_FUZZY(bench.sensitivity(i), curvature[i]/2., 1e-3);
+		bench.setOpticsPosition(2, 0.35);
+	}
+}
+
+// Propagation by cloning the optics, as OpticsFunction used to do
+static Beam referenceBeam(const vector<Optics*>& optics, const vector<double>& x, bool checkLock, double wavelength)
+{
+	vector<Optics*> clone;
+	for (unsigned int i = 0; i < optics.size(); i++)
+		clone.push_back(optics[i]->clone());
+	for (unsigned int i = 0; i < optics.size(); i++)
+		for (unsigned int j = 0; j < optics.size(); j++)
+			if (optics[i]->relativeLockParent() == optics[j])
+				clone[i]->relativeLockTo(clone[j]);
+	for (unsigned int i = 0; i < x.size(); i++)
+		clone[i]->setPosition(x[i], checkLock);
+	sort(clone.begin() + 1, clone.end(), less<Optics*>());
+
+	Beam beam(wavelength);
+	for (unsigned int i = 0; i < clone.size(); i++)
+		beam = clone[i]->image(beam);
+	for (unsigned int i = 0; i < clone.size(); i++)
+		delete clone[i];
+
+	return beam;
+}
+
+// The cached matrix of @p optics matches its coefficients
+static bool matrixIsCached(const ABCD& optics)
+{
+	for (int o = Horizontal; o <= Vertical; o++)
+	{
+		const Orientation orientation = Orientation(o);
+		const ABCD::Matrix& matrix = optics.matrix(orientation);
+		if ((matrix.A != optics.A(orientation)) || (matrix.B != optics.B(orientation)) ||
+		    (matrix.C != optics.C(orientation)) || (matrix.D != optics.D(orientation)))
+			return false;
+	}
+
+	return true;
+}
+
+void checkOpticsMatrix()
+{
+	Lens lens(0.1, 0.);
+	VERIFY(matrixIsCached(lens));
+	lens.setFocal(0.2);
+	lens.setOrientation(Horizontal);
+	VERIFY(matrixIsCached(lens));
+	VERIFY(lens.matrix(Horizontal).C == -5.);
+	VERIFY(lens.matrix(Vertical).C == 0.);
+
+	CurvedMirror mirror(0.1, 0.);
+	mirror.setCurvatureRadius(0.4);
+	VERIFY(matrixIsCached(mirror));
+	VERIFY(mirror.matrix(Spherical).C == -5.);
+
+	CurvedInterface curvedInterface(0.1, 1.5, 0.);
+	curvedInterface.setIndexRatio(2.);
+	curvedInterface.setSurfaceRadius(0.2);
+	VERIFY(matrixIsCached(curvedInterface));
+
+	DielectricSlab slab(1.5, 0.01, 0.);
+	slab.setWidth(0.03);
+	slab.setIndexRatio(3.);
+	VERIFY(matrixIsCached(slab));
+
+	GenericABCD generic(1., 0.2, -0.5, 0.9, 0., 0.);
+	generic.setC(-1., Vertical);
+	VERIFY(matrixIsCached(generic));
+
+	// Copies keep the cached matrix
+	ABCD* copy = slab.clone();
+	VERIFY(matrixIsCached(*copy));
+	VERIFY(copy->matrix(Horizontal).B == slab.matrix(Horizontal).B);
+	delete copy;
+}
+
+void checkCompiledBench()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	bench.addOptics(CurvedMirrorType, bench.nOptics());
+	bench.addOptics(CurvedInterfaceType, bench.nOptics());
+	bench.addOptics(DielectricSlabType, bench.nOptics());
+	bench.addOptics(LensType, bench.nOptics());
+	bench.opticsForPropertyChange(3)->setAngle(0.2);
+	bench.opticsForPropertyChange(6)->setOrientation(Horizontal);
+	bench.opticsForPropertyChange(2)->relativeLockTo(bench.opticsForPropertyChange(1));
+	bench.opticsForPropertyChange(4)->setAbsoluteLock(true);
+	bench.opticsPropertyChanged(0);
+
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*bench.targetBeam());
+
+	srand(1);
+	for (int checkLock = 0; checkLock < 2; checkLock++)
+	{
+		function.setCheckLock(checkLock);
+		vector<vector<double> > points;
+		for (int trial = 0; trial < 50; trial++)
+		{
+			vector<double> x = function.currentPosition();
+			for (unsigned int i = 1; i < x.size(); i++)
+				x[i] = 0.6*double(rand())/double(RAND_MAX);
+			points.push_back(x);
+
+			Beam reference = referenceBeam(optics, x, checkLock, bench.wavelength());
+			Beam beam = function.beam(x);
+			COMPARE_FUZZY(beam.waist(Horizontal), reference.waist(Horizontal), 1e-9);
+			COMPARE_FUZZY(beam.waist(Vertical), reference.waist(Vertical), 1e-9);
+			COMPARE_FUZZY(beam.waistPosition(Horizontal), reference.waistPosition(Horizontal), 1e-9);
+			COMPARE_FUZZY(beam.waistPosition(Vertical), reference.waistPosition(Vertical), 1e-9);
+			COMPARE_FUZZY(function.value(x), Beam::overlap(*bench.targetBeam(), reference), 1e-9);
+		}
+
+		// Exact derivatives match central finite differences
+		for (unsigned int p = 0; p < 5; p++)
+		{
+			const vector<double>& x = points[p];
+			vector<double> gradient = function.gradient(x);
+			vector<double> curvature = function.curvature(x);
+			const double epsilon = 1e-5;
+			for (unsigned int i = 0; i < x.size(); i++)
+			{
+				vector<double> xPlus = x, xMinus = x;
+				xPlus[i] += epsilon;
+				xMinus[i] -= epsilon;
+				const double fPlus = function.value(xPlus), fMinus = function.value(xMinus), f = function.value(x);
+				VERIFY(fabs(gradient[i] - (fPlus - fMinus)/(2.*epsilon)) <= 1e-5*(1. + fabs(gradient[i])));
+				VERIFY(fabs(curvature[i] - (fPlus + fMinus - 2.*f)/(epsilon*epsilon)) <= 1e-2*(1. + fabs(curvature[i])));
+			}
+		}
+
+		// Batched evaluation gives the same results as single evaluations
+		vector<double> values = function.values(points);
+		VERIFY(values.size() == points.size());
+		for (unsigned int i = 0; i < points.size(); i++)
+			VERIFY(values[i] == function.value(points[i]));
+
+		// Also when the layouts of a batch meet the optics in the same order, and share their coefficients
+		vector<vector<double> > slotPoints(11, function.currentPosition());
+		for (unsigned int p = 0; p < slotPoints.size(); p++)
+			for (unsigned int i = 1; i < slotPoints[p].size(); i++)
+				slotPoints[p][i] += 1e-3*p;
+		values = function.values(slotPoints);
+		for (unsigned int p = 0; p < slotPoints.size(); p++)
+			VERIFY(values[p] == function.value(slotPoints[p]));
+	}
+}
+
+void checkSphericalKernel()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+	CompiledBench compiledBench;
+	compiledBench.compile(optics, bench.wavelength());
+	VERIFY(compiledBench.isSpherical());
+
+	// The spherical kernels give the beams of the bench, identical in both orientations
+	const int n = compiledBench.size();
+	CompiledBench::Workspace workspaces[CompiledBench::batchSize];
+	BeamState beams[CompiledBench::batchSize];
+	for (int j = 0; j < CompiledBench::batchSize; j++)
+	{
+		vector<double> x(n);
+		for (int i = 0; i < n; i++)
+			x[i] = compiledBench.position(i) + 0.01*j*(i > 0);
+		compiledBench.initWorkspace(workspaces[j]);
+		compiledBench.place(&x[0], n, false, workspaces[j]);
+	}
+	compiledBench.propagateBatch(workspaces, CompiledBench::batchSize, beams);
+	for (int j = 0; j < CompiledBench::batchSize; j++)
+	{
+		const BeamState beam = compiledBench.propagate(workspaces[j]);
+		VERIFY(beam.spherical && beams[j].spherical);
+		for (int o = 0; o < 2; o++)
+		{
+			VERIFY(beams[j].waistPosition[o] == beam.waistPosition[o]);
+			VERIFY(beams[j].rayleigh[o] == beam.rayleigh[o]);
+		}
+	}
+	const Beam* output = bench.beam(bench.nOptics() - 1);
+	COMPARE_FUZZY(beams[0].waistPosition[1], output->waistPosition(Vertical), 1e-12);
+	COMPARE_FUZZY(beams[0].rayleigh[1], output->rayleigh(Vertical), 1e-12);
+
+	// A single astigmatic optics switches to the general kernels
+	bench.opticsForPropertyChange(2)->setOrientation(Horizontal);
+	bench.opticsPropertyChanged(2);
+	compiledBench.compile(optics, bench.wavelength());
+	VERIFY(!compiledBench.isSpherical());
+	compiledBench.place(&workspaces[0].position[0], n, false, workspaces[0]);
+	const BeamState beam = compiledBench.propagate(workspaces[0]);
+	COMPARE_FUZZY(beam.rayleigh[0], bench.beam(bench.nOptics() - 1)->rayleigh(Horizontal), 1e-12);
+	COMPARE_FUZZY(beam.rayleigh[1], bench.beam(bench.nOptics() - 1)->rayleigh(Vertical), 1e-12);
+}
+
+void checkScalarTypes()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	bench.addOptics(LensType, bench.nOptics());
+	bench.setOpticsPosition(3, 0.5);
+	bench.opticsForPropertyChange(3)->setOrientation(Horizontal);
+	bench.opticsPropertyChanged(3);
+
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+	CompiledBench compiledBench;
+	compiledBench.compile(optics, bench.wavelength());
+	CompiledBench::Workspace workspace;
+	compiledBench.initWorkspace(workspace);
+	const int n = compiledBench.size();
+	vector<double> x(n);
+	for (int i = 0; i < n; i++)
+		x[i] = compiledBench.position(i);
+	compiledBench.place(&x[0], n, false, workspace);
+	const BeamState target = BeamState::fromBeam(*bench.targetBeam());
+	const BeamState beam = compiledBench.propagate(workspace);
+	const double overlap = BeamState::overlap(target, beam);
+	VERIFY(!beam.spherical);
+
+	// Single precision
+	vector<float> floatPosition(x.begin(), x.end());
+	const BasicBeamState<float> floatBeam = compiledBench.propagate(workspace, &floatPosition[0]);
+	COMPARE_FUZZY(BasicBeamState<float>::overlap(target, floatBeam), overlap, 1e-4);
+	for (int o = 0; o < 2; o++)
+	{
+		COMPARE_FUZZY(floatBeam.waistPosition[o], beam.waistPosition[o], 1e-4);
+		COMPARE_FUZZY(floatBeam.rayleigh[o], beam.rayleigh[o], 1e-4);
+	}
+
+	// Dual numbers carry the derivative along a move of the first lens
+	vector<Jet> jetPosition(x.begin(), x.end());
+	jetPosition[1].d = 1.;
+	const Jet jetOverlap = BasicBeamState<Jet>::overlap(target, compiledBench.propagate(workspace, &jetPosition[0]));
+	COMPARE_FUZZY(jetOverlap.v, overlap, 1e-12);
+	const double epsilon = 1e-6;
+	vector<double> xPlus = x, xMinus = x;
+	xPlus[1] += epsilon;
+	xMinus[1] -= epsilon;
+	compiledBench.place(&xPlus[0], n, false, workspace);
+	const double overlapPlus = BeamState::overlap(target, compiledBench.propagate(workspace));
+	compiledBench.place(&xMinus[0], n, false, workspace);
+	const double overlapMinus = BeamState::overlap(target, compiledBench.propagate(workspace));
+	COMPARE_FUZZY(jetOverlap.d, (overlapPlus - overlapMinus)/(2.*epsilon), 1e-5);
+
+	// Intervals bound the beam for all the positions within the tolerance
+	const double tolerance = 1e-5;
+	vector<Interval> intervalPosition(n);
+	for (int i = 0; i < n; i++)
+		intervalPosition[i] = i == 0 ? Interval(x[i]) : Interval(x[i] - tolerance, x[i] + tolerance);
+	compiledBench.place(&x[0], n, false, workspace);
+	const BasicBeamState<Interval> intervalBeam = compiledBench.propagate(workspace, &intervalPosition[0]);
+	const Interval intervalOverlap = BasicBeamState<Interval>::overlap(target, intervalBeam);
+	VERIFY(intervalOverlap.contains(overlap));
+	VERIFY(intervalOverlap.width() < 0.2);
+	mt19937 generator(1);
+	for (int sample = 0; sample < 100; sample++)
+	{
+		vector<double> xSample = x;
+		for (int i = 1; i < n; i++)
+			xSample[i] += tolerance*(2.*double(generator())/4294967295. - 1.);
+		compiledBench.place(&xSample[0], n, false, workspace);
+		const BeamState sampleBeam = compiledBench.propagate(workspace);
+		VERIFY(intervalOverlap.contains(BeamState::overlap(target, sampleBeam)));
+		for (int o = 0; o < 2; o++)
+		{
+			VERIFY(intervalBeam.waistPosition[o].contains(sampleBeam.waistPosition[o]));
+			VERIFY(intervalBeam.rayleigh[o].contains(sampleBeam.rayleigh[o]));
+		}
+	}
+}
+
+// Compare the beams of the bench with a sequential propagation through Optics::image
+static void compareSequentialBeams(OpticsBench& bench)
+{
+	Beam beam(bench.wavelength());
+	for (int i = 0; i < bench.nOptics(); i++)
+	{
+		beam = bench.optics(i)->image(beam);
+		const Beam* treeBeam = bench.beam(i);
+		VERIFY(treeBeam->isSpherical() == beam.isSpherical());
+		COMPARE_FUZZY(treeBeam->index(), beam.index(), 1e-12);
+		COMPARE_FUZZY(treeBeam->angle() + 1., beam.angle() + 1., 1e-12);
+		VERIFY(fabs(treeBeam->origin().x() - beam.origin().x()) < 1e-12);
+		VERIFY(fabs(treeBeam->origin().y() - beam.origin().y()) < 1e-12);
+		for (int o = Horizontal; o <= Vertical; o++)
+		{
+			COMPARE_FUZZY(treeBeam->waist(Orientation(o)), beam.waist(Orientation(o)), 1e-9);
+			VERIFY(fabs(treeBeam->waistPosition(Orientation(o)) - beam.waistPosition(Orientation(o))) < 1e-12);
+		}
+	}
+}
+
+void checkPropagationTree()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	bench.addOptics(FlatMirrorType, bench.nOptics());
+	bench.addOptics(CurvedMirrorType, bench.nOptics());
+	bench.addOptics(DielectricSlabType, bench.nOptics());
+	bench.addOptics(CurvedInterfaceType, bench.nOptics());
+	bench.addOptics(LensType, bench.nOptics());
+	bench.opticsForPropertyChange(3)->setAngle(0.3);
+	bench.opticsForPropertyChange(4)->setAngle(-0.1);
+	bench.opticsForPropertyChange(7)->setOrientation(Vertical);
+	bench.opticsPropertyChanged(3);
+	VERIFY(!bench.is1D());
+	VERIFY(!bench.isSpherical());
+	compareSequentialBeams(bench);
+
+	// Moves, with reordering
+	bench.setOpticsPosition(2, 0.05);
+	compareSequentialBeams(bench);
+	bench.setOpticsPosition(bench.nOptics() - 1, 0.12);
+	compareSequentialBeams(bench);
+	bench.removeOptics(3, 1);
+	compareSequentialBeams(bench);
+
+	// The optics index follows reorderings and removals
+	const Optics* movedOptics = bench.optics(1);
+	const int movedIndex = bench.setOpticsPosition(1, 0.45);
+	VERIFY(bench.optics(movedIndex) == movedOptics);
+	for (int i = 0; i < bench.nOptics(); i++)
+		VERIFY(bench.opticsIndex(bench.optics(i)) == i);
+
+	// Long benches do not lose precision
+	OpticsBench longBench;
+	longBench.populateDefault();
+	longBench.setRightBoundary(1000.);
+	{
+		OpticsBenchUpdate update(longBench);
+		for (int i = 0; i < 500; i++)
+		{
+			longBench.addOptics(LensType, longBench.nOptics());
+			dynamic_cast<Lens*>(longBench.opticsForPropertyChange(longBench.nOptics() - 1))->setFocal(0.5);
+			longBench.opticsPropertyChanged(longBench.nOptics() - 1);
+			longBench.setOpticsPosition(longBench.nOptics() - 1, 0.1 + 1.9*i);
+		}
+	}
+	longBench.setOpticsPosition(1, 0.05);
+	Beam beam(longBench.wavelength());
+	for (int i = 0; i < longBench.nOptics(); i++)
+	{
+		beam = longBench.optics(i)->image(beam);
+		COMPARE_FUZZY(longBench.beam(i)->waist(), beam.waist(), 1e-9);
+		VERIFY(fabs(longBench.beam(i)->waistPosition() - beam.waistPosition()) < 1e-8);
+	}
+}
+
+void checkOpticsMoves()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	for (int i = 0; i < 20; i++)
+	{
+		bench.addOptics(i % 4 == 0 ? DielectricSlabType : LensType, bench.nOptics());
+		bench.opticsForPropertyChange(bench.nOptics() - 1)->setWidth(i % 4 == 0 ? 0.01 : 0.);
+		bench.opticsPropertyChanged(bench.nOptics() - 1);
+		bench.setOpticsPosition(bench.nOptics() - 1, 0.32 + 0.015*i);
+	}
+	compareSequentialBeams(bench);
+
+	// Drag optics around, and compare with a linear search for collisions
+	mt19937 random(42);
+	uniform_real_distribution<double> position(-0.05, 0.65);
+	for (int move = 0; move < 500; move++)
+	{
+		const int index = 1 + random() % (bench.nOptics() - 1);
+		const Optics* movedOptics = bench.optics(index);
+		const double newPosition = position(random);
+		bool collision = false;
+		for (int i = 0; i < bench.nOptics(); i++)
+			if ((i != index) && (bench.optics(i)->position() <= newPosition + movedOptics->width()) &&
+			                    (bench.optics(i)->endPosition() >= newPosition))
+				collision = true;
+
+		const int newIndex = bench.setOpticsPosition(index, newPosition);
+		VERIFY(bench.optics(newIndex) == movedOptics);
+		VERIFY((fabs(movedOptics->position() - newPosition) < 1e-12) == !collision);
+		for (int i = 1; i < bench.nOptics() - 1; i++)
+			VERIFY(bench.optics(i)->endPosition() < bench.optics(i + 1)->position());
+		for (int i = 0; i < bench.nOptics(); i++)
+			VERIFY(bench.opticsIndex(bench.optics(i)) == i);
+		if (move % 50 == 0)
+			compareSequentialBeams(bench);
+	}
+	compareSequentialBeams(bench);
+
+	// Overlapping optics, as loaded from a file, still block moves
+	OpticsBench overlappingBench;
+	overlappingBench.populateDefault();
+	overlappingBench.addOptics(new DielectricSlab(1.5, 0.1, 0.2, "D1"), 1);
+	overlappingBench.addOptics(new Lens(0.1, 0.25, "L1"), 2);
+	overlappingBench.addOptics(new Lens(0.1, 0.5, "L2"), 3);
+	VERIFY(overlappingBench.setOpticsPosition(3, 0.28) == 3);
+	COMPARE_FUZZY(overlappingBench.optics(3)->position(), 0.5, 1e-12);
+
+	// So do optics inserted out of order
+	overlappingBench.addOptics(new Lens(0.1, 0.1, "L3"), 4);
+	VERIFY(overlappingBench.setOpticsPosition(3, 0.1) == 3);
+	COMPARE_FUZZY(overlappingBench.optics(3)->position(), 0.5, 1e-12);
+
+	// Moving an optics on a bench with optics inserted out of order sorts the optics
+	OpticsBench unsortedBench;
+	unsortedBench.populateDefault();
+	unsortedBench.addOptics(new Lens(0.1, 0.5, "L1"), unsortedBench.nOptics());
+	unsortedBench.addOptics(new Lens(0.1, 0.3, "L2"), unsortedBench.nOptics());
+	unsortedBench.addOptics(new Lens(0.1, 0.4, "L3"), unsortedBench.nOptics());
+	const Optics* movedOptics = unsortedBench.optics(unsortedBench.nOptics() - 1);
+	const int newIndex = unsortedBench.setOpticsPosition(unsortedBench.nOptics() - 1, 0.45);
+	VERIFY(unsortedBench.optics(newIndex) == movedOptics);
+	COMPARE_FUZZY(movedOptics->position(), 0.45, 1e-12);
+	for (int i = 1; i < unsortedBench.nOptics() - 1; i++)
+		VERIFY(unsortedBench.optics(i)->position() < unsortedBench.optics(i + 1)->position());
+	for (int i = 0; i < unsortedBench.nOptics(); i++)
+		VERIFY(unsortedBench.opticsIndex(unsortedBench.optics(i)) == i);
+	compareSequentialBeams(unsortedBench);
+}
+
+// Count the events received from a bench
+class EventCounter : public OpticsBenchEventListener
+{
+public:
+	EventCounter() : opticsAdded(0), dataChanged(0), sphericityChanged(0), modified(0), lastDataStart(-1) {}
+	virtual void onOpticsBenchOpticsAdded(int /*index*/) { opticsAdded++; }
+	virtual void onOpticsBenchDataChanged(int startOptics, int /*endOptics*/) { dataChanged++; lastDataStart = startOptics; }
+	virtual void onOpticsBenchSphericityChanged() { sphericityChanged++; }
+	virtual void onOpticsBenchModified() { modified++; }
+
+public:
+	int opticsAdded, dataChanged, sphericityChanged, modified, lastDataStart;
+};
+
+// Add a mirror at @p position, deviating the beam by twice @p angle
+static void addMirror(OpticsBench& bench, OpticsType type, double position, double angle, double curvatureRadius = 0.)
+{
+	bench.addOptics(type, bench.nOptics());
+	Optics* mirror = bench.opticsForPropertyChange(bench.nOptics() - 1);
+	mirror->setAngle(angle);
+	if (type == CurvedMirrorType)
+		dynamic_cast<CurvedMirror*>(mirror)->setCurvatureRadius(curvatureRadius);
+	bench.opticsPropertyChanged(bench.nOptics() - 1);
+	bench.setOpticsPosition(bench.nOptics() - 1, position);
+}
+
+void checkObjectPool()
+{
+	ObjectPool<Beam, 4> pool;
+	vector<Beam*> beams;
+	for (int i = 0; i < 10; i++)
+		beams.push_back(pool.create(Beam(1e-6*(i + 1))));
+	VERIFY(pool.size() == 10);
+	VERIFY(beams[1] == beams[0] + 1);
+	for (int i = 0; i < 10; i++)
+		VERIFY(beams[i]->wavelength() == 1e-6*(i + 1));
+
+	// Released slots are reused
+	pool.release(beams[5]);
+	VERIFY(pool.size() == 9);
+	VERIFY(pool.create(Beam(1e-9)) == beams[5]);
+	VERIFY(beams[6]->wavelength() == 7e-6);
+
+	// Bench beams keep their address when optics are added and removed
+	OpticsBench bench;
+	populateBench(bench);
+	const Beam* beam = bench.beam(1);
+	bench.addOptics(LensType, 1);
+	bench.removeOptics(1, 1);
+	bench.addOptics(LensType, bench.nOptics());
+	VERIFY(bench.beam(1) == beam);
+}
+
+void checkCavities()
+{
+	// Linear cavity: a flat mirror reflects the beam back to a curved mirror, that closes the cavity
+	// on the input beam. The eigen mode has its waist on the flat mirror
+	OpticsBench linearBench;
+	linearBench.populateDefault();
+	addMirror(linearBench, FlatMirrorType, 0.2, 0.);
+	addMirror(linearBench, CurvedMirrorType, 0.3, 0., 0.2);
+	VERIFY(linearBench.nCavities() == 1);
+	const Cavity& linearCavity = linearBench.cavity(0);
+	VERIFY(linearCavity.nOptics() == 2);
+	COMPARE_FUZZY(linearCavity.closingFreeSpace(), 0.1, 1e-9);
+	VERIFY(linearCavity.isStable());
+	const Beam* linearEigenBeam = linearCavity.eigenBeam(linearBench.wavelength(), 0);
+	VERIFY(fabs(linearEigenBeam->waistPosition() - 0.2) < 1e-12);
+	COMPARE_FUZZY(linearEigenBeam->rayleigh(), 0.1, 1e-9);
+
+	// Removing a cavity optics during an update also invalidates the cavities
+	{
+		OpticsBench removedBench;
+		removedBench.populateDefault();
+		addMirror(removedBench, FlatMirrorType, 0.2, 0.);
+		addMirror(removedBench, CurvedMirrorType, 0.3, 0., 0.2);
+		VERIFY(removedBench.nCavities() == 1);
+		OpticsBenchUpdate update(removedBench);
+		removedBench.removeOptics(1);
+		VERIFY(removedBench.nCavities() == 0);
+	}
+
+	// Ring cavity: four mirrors at 45 degrees, closing on the input beam
+	OpticsBench bench;
+	bench.populateDefault();
+	addMirror(bench, FlatMirrorType, 0.2, -M_PI/4.);
+	addMirror(bench, CurvedMirrorType, 0.3, -M_PI/4., 0.3);
+	addMirror(bench, FlatMirrorType, 0.4, -M_PI/4.);
+	addMirror(bench, CurvedMirrorType, 0.5, -M_PI/4., 0.3);
+	VERIFY(bench.nCavities() == 1);
+	const Cavity& cavity = bench.cavity(0);
+	VERIFY(cavity.nOptics() == 4);
+	COMPARE_FUZZY(cavity.closingFreeSpace(), 0.1, 1e-9);
+	VERIFY(cavity.isStable());
+
+	// The eigen mode is reproduced after a round trip
+	const double wavelength = bench.wavelength();
+	const Beam* eigenBeam = cavity.eigenBeam(wavelength, 0);
+	const Beam* lastEigenBeam = cavity.eigenBeam(wavelength, 3);
+	const double roundTripPosition = cavity.optics(3)->endPosition() + cavity.closingFreeSpace();
+	COMPARE_FUZZY(lastEigenBeam->rayleigh(), eigenBeam->rayleigh(), 1e-9);
+	VERIFY(fabs((roundTripPosition - lastEigenBeam->waistPosition()) - (cavity.optics(0)->endPosition() - eigenBeam->waistPosition())) < 1e-12);
+
+	// Changes after the cavity keep its cached eigen mode
+	bench.addOptics(LensType, bench.nOptics());
+	bench.setOpticsPosition(bench.nOptics() - 1, 0.65);
+	VERIFY(bench.nCavities() == 1);
+	VERIFY(bench.cavity(0).eigenBeam(wavelength, 0) == eigenBeam);
+
+	// Changes of the cavity optics update the eigen mode
+	const double rayleigh = eigenBeam->rayleigh();
+	dynamic_cast<CurvedMirror*>(bench.opticsForPropertyChange(2))->setCurvatureRadius(0.5);
+	bench.opticsPropertyChanged(2);
+	VERIFY(bench.nCavities() == 1);
+	VERIFY(bench.cavity(0).isStable());
+	VERIFY(fabs(bench.cavity(0).eigenBeam(wavelength, 0)->rayleigh() - rayleigh) > 1e-3*rayleigh);
+
+	// Opening the ring
+	bench.opticsForPropertyChange(4)->setAngle(-M_PI/4. + 0.1);
+	bench.opticsPropertyChanged(4);
+	VERIFY(bench.nCavities() == 0);
+}
+
+void checkStabilityMap()
+{
+	// Linear cavity of length L between a flat mirror and a mirror of curvature radius R,
+	// stable for L < R, with an eigen mode of Rayleigh range sqrt(L(R - L)) on the flat mirror
+	OpticsBench bench;
+	bench.populateDefault();
+	addMirror(bench, FlatMirrorType, 0.2, 0.);
+	addMirror(bench, CurvedMirrorType, 0.3, 0., 0.2);
+	VERIFY(bench.nCavities() == 1);
+	const Cavity& cavity = bench.cavity(0);
+
+	StabilityMap map(cavity, bench.wavelength());
+	map.setXParameter(StabilityParameter(StabilityParameter::LengthProperty, 0, 0.02, 0.38, 19, 1));
+	map.setYParameter(StabilityParameter(StabilityParameter::CurvatureRadiusProperty, 1, 0.1, 0.4, 7));
+	map.setThreadCount(1);
+	VERIFY(map.run());
+	VERIFY((map.width() == 19) && (map.height() == 7));
+	for (int y = 0; y < map.height(); y++)
+		for (int x = 0; x < map.width(); x++)
+		{
+			const double L = 0.02 + 0.02*x, R = 0.1 + 0.05*y;
+			COMPARE_FUZZY(map.stability(x, y), 1. - 2.*L/R, 1e-9);
+			if (fabs(L - R) < 1e-9)
+				continue;
+			VERIFY((L < R) == !std::isnan(map.waist(x, y)));
+			if (L < R)
+			{
+				COMPARE_FUZZY(map.waist(x, y), sqrt(sqrt(L*(R - L))*bench.wavelength()/M_PI), 1e-9);
+				COMPARE_FUZZY(fabs(map.gouyPhase(x, y)), acos(1. - 2.*L/R), 1e-9);
+			}
+		}
+
+	// The nominal grid point matches the cavity
+	COMPARE_FUZZY(map.waist(4, 2), cavity.eigenBeam(bench.wavelength(), 0)->waist(), 1e-9);
+
+	// The result does not depend on the number of threads
+	StabilityMap parallelMap(cavity, bench.wavelength());
+	parallelMap.setXParameter(StabilityParameter(StabilityParameter::LengthProperty, 0, 0.02, 0.38, 19, 1));
+	parallelMap.setYParameter(StabilityParameter(StabilityParameter::CurvatureRadiusProperty, 1, 0.1, 0.4, 7));
+	parallelMap.setThreadCount(3);
+	VERIFY(parallelMap.run());
+	stringstream serialStream, parallelStream;
+	CsvSweepWriter serialWriter(serialStream), parallelWriter(parallelStream);
+	VERIFY(map.write(serialWriter));
+	VERIFY(parallelMap.write(parallelWriter));
+	VERIFY(serialStream.str() == parallelStream.str());
+
+	// The flat mirror has no curvature radius
+	map.setYParameter(StabilityParameter(StabilityParameter::CurvatureRadiusProperty, 0, 0.1, 0.4, 7));
+	VERIFY(!map.run());
+}
+
+void checkUpdate()
+{
+	OpticsBench bench;
+	bench.setModified(false);
+	EventCounter counter;
+	bench.registerEventListener(&counter);
+
+	{
+		OpticsBenchUpdate update(bench);
+		populateBench(bench);
+		bench.addOptics(FlatMirrorType, bench.nOptics());
+		bench.addOptics(LensType, bench.nOptics());
+		bench.opticsForPropertyChange(4)->setOrientation(Vertical);
+		bench.opticsPropertyChanged(4);
+		// Beams queried during the update are up to date
+		compareSequentialBeams(bench);
+		bench.setOpticsPosition(3, 0.2);
+		bench.setWavelength(532e-9);
+		VERIFY(counter.dataChanged == 0);
+		VERIFY(counter.modified == 0);
+	}
+
+	VERIFY(counter.opticsAdded == 5);
+	VERIFY(counter.dataChanged == 1);
+	VERIFY(counter.lastDataStart == 0);
+	VERIFY(counter.sphericityChanged == 1);
+	VERIFY(counter.modified == 1);
+	VERIFY(!bench.isSpherical());
+	compareSequentialBeams(bench);
+
+	// Moves only propagate from the first moved optics
+	bench.beginUpdate();
+	bench.beginUpdate();
+	bench.setOpticsPosition(4, 0.4);
+	bench.endUpdate();
+	bench.setOpticsPosition(3, 0.35);
+	VERIFY(counter.dataChanged == 1);
+	bench.endUpdate();
+	VERIFY(counter.dataChanged == 2);
+	VERIFY(counter.lastDataStart == 3);
+	compareSequentialBeams(bench);
+}
+
+void checkMagicWaist()
+{
+	// The result of a search only depends on its seed, not on the number of threads
+	vector<double> positions[2];
+	for (int run = 0; run < 2; run++)
+	{
+		OpticsBench bench;
+		populateBench(bench);
+		bench.setThreadCount(run == 0 ? 1 : 3);
+		VERIFY(bench.magicWaist(12345));
+		VERIFY(bench.magicWaistSeed() == 12345);
+		VERIFY(Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam()) > bench.targetOverlap());
+		for (int i = 0; i < bench.nOptics(); i++)
+			positions[run].push_back(bench.optics(i)->position());
+	}
+	VERIFY(positions[0] == positions[1]);
+
+	// An unreachable target overlap still gives the best layout found within the budget
+	for (int run = 0; run < 2; run++)
+	{
+		OpticsBench bench;
+		populateBench(bench);
+		bench.setTargetOverlap(1.5);
+		bench.setMagicWaistBudget(4000);
+		bench.setThreadCount(run == 0 ? 1 : 3);
+		VERIFY(!bench.magicWaist(12345));
+		VERIFY(Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam()) > 0.999);
+		for (int i = 1; i < bench.nOptics(); i++)
+		{
+			VERIFY(bench.optics(i)->position() >= bench.leftBoundary());
+			VERIFY(bench.optics(i)->position() <= bench.rightBoundary());
+			positions[run][i] = bench.optics(i)->position();
+		}
+	}
+	VERIFY(positions[0] == positions[1]);
+}
+
+/// Quadratic function, minimal at (2, -1), whose first variable is bounded by 1
+class BoundedQuadratic : public Function
+{
+public:
+	virtual double value(const vector<double>& x) const
+	{
+		return (x[0] - 2.)*(x[0] - 2.) + 10.*(x[1] + 1.)*(x[1] + 1.) + (x[0] - 2.)*(x[1] + 1.);
+	}
+	virtual void bounds(const vector<double>& x, vector<double>& lower, vector<double>& upper) const
+	{
+		Function::bounds(x, lower, upper);
+		upper[0] = 1.;
+	}
+};
+
+void checkLocalOptimum()
+{
+	// The optimum lies on the bound
+	BoundedQuadratic quadratic;
+	vector<double> x = quadratic.localMinimum(vector<double>(2, 0.));
+	VERIFY(quadratic.optimizationSuccess());
+	COMPARE_FUZZY(x[0], 1., 1e-9);
+	COMPARE_FUZZY(x[1], -0.95, 1e-5);
+
+	// Optics stay within the bench boundary, and do not cross each other
+	OpticsBench bench;
+	populateBench(bench);
+	bench.setRightBoundary(0.25);
+	const double overlap = Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam());
+	VERIFY(bench.localOptimum());
+	VERIFY(bench.optics(1)->position() >= bench.leftBoundary());
+	VERIFY(bench.optics(2)->position() <= 0.25);
+	VERIFY(bench.optics(1)->position() <= bench.optics(2)->position());
+	VERIFY(Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam()) > overlap);
+}
+
+void checkDesignVariables()
+{
+	// Invalid optics and properties are rejected
+	OpticsBench bench;
+	populateBench(bench);
+	VERIFY(!bench.addDesignVariable(DesignVariable(DesignVariable::CurvatureRadiusProperty, 1)));
+	VERIFY(!bench.addDesignVariable(DesignVariable(DesignVariable::FocalProperty, bench.nOptics())));
+	VERIFY(!bench.addDesignVariable(DesignVariable(DesignVariable::WidthProperty, 1)));
+	VERIFY(bench.addDesignVariable(DesignVariable(DesignVariable::WaistProperty, 0)));
+	VERIFY(bench.nDesignVariables() == 1);
+	bench.clearDesignVariables();
+
+	// Recover the focal length of a lens that does not move
+	const double focal = dynamic_cast<const Lens*>(bench.optics(1))->focal();
+	bench.setTargetBeam(*bench.beam(bench.nOptics()-1));
+	for (int i = 1; i < bench.nOptics(); i++)
+		bench.opticsForPropertyChange(i)->setAbsoluteLock(true);
+	dynamic_cast<Lens*>(bench.opticsForPropertyChange(1))->setFocal(1.2*focal);
+	bench.opticsPropertyChanged(1);
+	VERIFY(bench.addDesignVariable(DesignVariable(DesignVariable::FocalProperty, 1, 0.01, 1.)));
+	VERIFY(bench.localOptimum());
+	COMPARE_FUZZY(dynamic_cast<const Lens*>(bench.optics(1))->focal(), focal, 1e-4);
+	VERIFY(Beam::overlap(*bench.beam(bench.nOptics()-1), *bench.targetBeam()) > 1. - 1e-8);
+
+	// The gradient with respect to the focal length matches finite differences
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+	OpticsFunction function(optics, bench.wavelength());
+	function.setOverlapBeam(*bench.targetBeam());
+	VERIFY(function.addVariable(DesignVariable(DesignVariable::FocalProperty, 1)));
+	vector<double> x = function.currentPosition();
+	VERIFY(int(x.size()) == bench.nOptics() + 1);
+	x.back() *= 1.1;
+	const double step = 1e-6;
+	vector<double> shifted = x;
+	shifted.back() += step;
+	const double plus = function.value(shifted);
+	shifted.back() -= 2.*step;
+	const double minus = function.value(shifted);
+	COMPARE_FUZZY(function.gradient(x).back(), (plus - minus)/(2.*step), 1e-4);
+	// The optics of the bench are not changed by the function
+	COMPARE_FUZZY(dynamic_cast<const Lens*>(bench.optics(1))->focal(), focal, 1e-4);
+
+	// The magic waist searches the focal length of a lens that does not move within its bounds
+	OpticsBench searchBench;
+	populateBench(searchBench);
+	searchBench.opticsForPropertyChange(2)->setAbsoluteLock(true);
+	dynamic_cast<Lens*>(searchBench.opticsForPropertyChange(2))->setFocal(0.5);
+	searchBench.opticsPropertyChanged(2);
+	VERIFY(searchBench.addDesignVariable(DesignVariable(DesignVariable::FocalProperty, 2, 0.05, 0.2)));
+	searchBench.setThreadCount(2);
+	VERIFY(searchBench.magicWaist(12345));
+	VERIFY(Beam::overlap(*searchBench.beam(searchBench.nOptics()-1), *searchBench.targetBeam()) > searchBench.targetOverlap());
+	const double searchedFocal = dynamic_cast<const Lens*>(searchBench.optics(2))->focal();
+	VERIFY((searchedFocal >= 0.05) && (searchedFocal <= 0.2));
+
+	// Variables are removed with their optics
+	searchBench.removeOptics(2);
+	VERIFY(searchBench.nDesignVariables() == 0);
+}
+
+void checkFit()
+{
+	Fit fit(0);
+	fit.addData(0.0, 100e-6, Spherical);
+	fit.addData(0.1, 150e-6, Spherical);
+	fit.addData(0.2, 250e-6, Spherical);
+
+	Beam beam(461e-9);
+	fit.applyFit(beam);
+	VERIFY(beam.waist() > 0.);
+	VERIFY(Fit(fit) == fit);
+}
+
+// Converts files of version 1.1 by changing their version number
+class ConvertingReader : public BenchFileReader
+{
+public:
+	ConvertingReader(OpticsBench* bench) : BenchFileReader(bench), conversions(0) {}
+
+protected:
+	virtual bool convert(string& data, const string& version)
+	{
+		conversions++;
+		string::size_type pos = data.find("\"" + version + "\"");
+		if ((version != "1.1") || (pos == string::npos))
+			return false;
+		data.replace(pos + 1, version.size(), currentVersion);
+		return true;
+	}
+
+public:
+	int conversions;
+};
+
+void checkBenchFile()
+{
+	stringstream file;
+	file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE gaussianBeam>\n"
+	     << "<gaussianBeam version=\"1.2\"><bench id=\"0\">"
+	     << "<wavelength>6.4e-07</wavelength><rightBoundary>1.5</rightBoundary>"
+	     << "<targetBeam id=\"0\"><waist orientation=\"spherical\">0.0002</waist><targetOverlap>0.9</targetOverlap></targetBeam>"
+	     << "<beamFit id=\"0\"><name>F</name><orientation>ellipsoidal</orientation><data id=\"0\"><position>0.1</position>"
+	     << "<value orientation=\"horizontal\">1e-4</value><value orientation=\"vertical\">3e-4</value></data></beamFit>"
+	     << "<opticsList>"
+	     << "<createBeam id=\"0\"><name>w0</name><absoluteLock>1</absoluteLock>"
+	     << "<beam><waist orientation=\"horizontal\">1e-4</waist><waist orientation=\"vertical\">2e-4</waist></beam></createBeam>"
+	     << "<lens id=\"1\"><position>0.2</position><name>L &amp; 1</name><focal>0.05</focal></lens>"
+	     << "<!-- comment --><lens id=\"2\"><position>0.4</position><name>L2</name><relativeLockParent>1</relativeLockParent></lens>"
+	     << "</opticsList></bench><view id=\"0\" bench=\"0\"><origin>0</origin></view></gaussianBeam>\n";
+
+	OpticsBench bench;
+	BenchFileReader reader(&bench);
+	VERIFY(reader.read(file));
+	VERIFY(bench.nOptics() == 3);
+	COMPARE_FUZZY(bench.wavelength(), 6.4e-7, 1e-12);
+	COMPARE_FUZZY(bench.rightBoundary(), 1.5, 1e-12);
+	COMPARE_FUZZY(bench.targetBeam()->waist(), 2e-4, 1e-12);
+	COMPARE_FUZZY(bench.targetOverlap(), 0.9, 1e-12);
+	VERIFY(bench.optics(0)->absoluteLock());
+	COMPARE_FUZZY(bench.beam(0)->waist(Vertical), 2e-4, 1e-12);
+	VERIFY(bench.optics(1)->name() == "L & 1");
+	COMPARE_FUZZY(dynamic_cast<const Lens*>(bench.optics(1))->focal(), 0.05, 1e-12);
+	VERIFY(bench.optics(2)->relativeLockParent() == bench.optics(1));
+	VERIFY(bench.nFit() == 1);
+	COMPARE_FUZZY(bench.fit(0)->value(0, Vertical), 3e-4, 1e-12);
+
+	// An invalid file leaves the bench unchanged
+	const string document = file.str();
+	stringstream truncatedFile(document.substr(0, document.find("<lens id=\"2\">")));
+	VERIFY(!reader.read(truncatedFile));
+	OpticsBench reference;
+	BenchFileReader referenceReader(&reference);
+	stringstream referenceFile(document);
+	VERIFY(referenceReader.read(referenceFile));
+	VERIFY(bench.nOptics() == reference.nOptics());
+	for (int i = 0; i < bench.nOptics(); i++)
+		VERIFY(*bench.optics(i) == *reference.optics(i));
+	VERIFY(bench.optics(2)->relativeLockParent() == bench.optics(1));
+	VERIFY(bench.wavelength() == reference.wavelength());
+	VERIFY((bench.nFit() == 1) && (*bench.fit(0) == *reference.fit(0)));
+
+	// Properties that do not belong to the optics are reported as errors
+	stringstream mismatchFile;
+	mismatchFile << "<gaussianBeam version=\"1.2\"><bench><opticsList>"
+	             << "<lens id=\"0\"><curvatureRadius>0.1</curvatureRadius></lens>"
+	             << "</opticsList></bench></gaussianBeam>";
+	VERIFY(!reader.read(mismatchFile));
+	VERIFY(reader.errorString().find("curvatureRadius") != string::npos);
+	VERIFY(bench.nOptics() == 3);
+
+	// Old file versions are rejected, unless they can be converted
+	const string oldDocument = "<gaussianBeam version=\"1.1\"><bench><wavelength>5e-07</wavelength></bench></gaussianBeam>";
+	stringstream oldFile(oldDocument);
+	OpticsBench oldBench;
+	BenchFileReader oldReader(&oldBench);
+	VERIFY(!oldReader.read(oldFile));
+
+	ConvertingReader convertingReader(&oldBench);
+	stringstream convertedFile(oldDocument);
+	VERIFY(convertingReader.read(convertedFile));
+	VERIFY(convertingReader.conversions == 1);
+	COMPARE_FUZZY(oldBench.wavelength(), 5e-7, 1e-12);
+
+	// Current files are not converted
+	file.clear();
+	file.seekg(0);
+	VERIFY(convertingReader.read(file));
+	VERIFY(convertingReader.conversions == 1);
+}
+
+void checkBinaryFile()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	bench.addOptics(CurvedInterfaceType, bench.nOptics());
+	bench.addOptics(GenericABCDType, bench.nOptics());
+	bench.opticsForPropertyChange(4)->setOrientation(Ellipsoidal);
+	dynamic_cast<GenericABCD*>(bench.opticsForPropertyChange(4))->setC(-5., Vertical);
+	bench.opticsForPropertyChange(2)->relativeLockTo(bench.opticsForPropertyChange(1));
+	bench.opticsPropertyChanged(4);
+	Fit* fit = bench.fit(0);
+	fit->setName("Fit data");
+	fit->setOrientation(Ellipsoidal);
+	fit->setData(0, 0.1, 2e-4, Horizontal);
+	fit->setData(0, 0.1, 3e-4, Vertical);
+
+	const string fileName = testFilePath("testCore.gbb");
+	BinaryFileWriter writer;
+	VERIFY(writer.open(fileName, bench));
+	vector<vector<double> > positions;
+	for (int i = 0; i < 3; i++)
+	{
+		bench.setOpticsPosition(3, 0.4 + 0.05*i);
+		VERIFY(writer.addLayout(bench, i));
+		positions.push_back(vector<double>());
+		for (int j = 0; j < bench.nOptics(); j++)
+			positions.back().push_back(bench.optics(j)->position());
+	}
+	VERIFY(writer.close());
+
+	BinaryFileReader reader;
+	VERIFY(reader.open(fileName));
+	VERIFY(reader.optics().size() == (size_t)bench.nOptics());
+	VERIFY(reader.nLayouts() == 3);
+	for (size_t i = 0; i < reader.nLayouts(); i++)
+	{
+		VERIFY(reader.layoutValue(i) == double(i));
+		for (int j = 0; j < bench.nOptics(); j++)
+			VERIFY(reader.layoutPositions(i)[j] == positions[i][j]);
+	}
+	for (int j = 0; j < bench.nOptics(); j++)
+	{
+		const Beam beam = reader.layoutBeams(2)[j].toBeam();
+		VERIFY(beam.isSpherical() == bench.beam(j)->isSpherical());
+		VERIFY(beam.waist(Vertical) == bench.beam(j)->waist(Vertical));
+		VERIFY(beam.waistPosition(Vertical) == bench.beam(j)->waistPosition(Vertical));
+		VERIFY(beam.angle() == bench.beam(j)->angle());
+	}
+
+	OpticsBench readBench;
+	reader.readBench(readBench);
+	VERIFY(readBench.nOptics() == bench.nOptics());
+	for (int j = 0; j < bench.nOptics(); j++)
+	{
+		VERIFY(readBench.optics(j)->type() == bench.optics(j)->type());
+		VERIFY(readBench.optics(j)->name() == bench.optics(j)->name());
+		VERIFY(readBench.optics(j)->position() == bench.optics(j)->position());
+		VERIFY(readBench.beam(j)->waist(Vertical) == bench.beam(j)->waist(Vertical));
+	}
+	VERIFY(readBench.optics(2)->relativeLockParent() == readBench.optics(1));
+	VERIFY(readBench.nFit() == 1);
+	VERIFY(readBench.fit(0)->name() == "Fit data");
+	VERIFY(readBench.fit(0)->value(0, Vertical) == 3e-4);
+	reader.close();
+
+	// Other files are rejected
+	ofstream(fileName.c_str()) << "<gaussianBeam version=\"1.2\"></gaussianBeam>" << endl;
+	VERIFY(!reader.open(fileName));
+	remove(fileName.c_str());
+}
+
+void checkParameterSweep()
+{
+	OpticsBench bench;
+	populateBench(bench);
+
+	ParameterSweep sweep(bench);
+	sweep.addParameter(SweepParameter(SweepParameter::WavelengthProperty, 0, 5e-7, 1e-6, 2));
+	sweep.addParameter(SweepParameter(SweepParameter::FocalProperty, 1, 0.05, 0.2, 4));
+	sweep.addParameter(SweepParameter(SweepParameter::PositionProperty, 2, 0.2, 0.5, 100));
+	sweep.addOutput(SweepOutput(SweepOutput::WaistQuantity));
+	sweep.addOutput(SweepOutput(SweepOutput::RadiusQuantity, 1, Horizontal, 0.15));
+	sweep.addOutput(SweepOutput(SweepOutput::OverlapQuantity));
+	VERIFY(sweep.size() == 800);
+	VERIFY(sweep.columns()[1] == "L1.focal");
+	VERIFY(sweep.columns()[3] == "output.waistH");
+
+	// The output does not depend on the number of threads
+	stringstream sequential, parallel;
+	CsvSweepWriter sequentialWriter(sequential), parallelWriter(parallel);
+	sweep.setThreadCount(1);
+	VERIFY(sweep.run(sequentialWriter));
+	sweep.setThreadCount(3);
+	VERIFY(sweep.run(parallelWriter));
+	VERIFY(sequential.str() == parallel.str());
+
+	// Compare the last grid point with the bench
+	string line, lastLine;
+	int nLines = 0;
+	for (; getline(sequential, line); nLines++)
+		lastLine = line;
+	VERIFY(nLines == 801);
+	replace(lastLine.begin(), lastLine.end(), ',', ' ');
+	stringstream row(lastLine);
+	double wavelength, focal, position, waist, radius, overlap;
+	row >> wavelength >> focal >> position >> waist >> radius >> overlap;
+	VERIFY((wavelength == 1e-6) && (focal == 0.2) && (position == 0.5));
+	bench.setWavelength(wavelength);
+	dynamic_cast<Lens*>(bench.opticsForPropertyChange(1))->setFocal(focal);
+	bench.opticsPropertyChanged(1);
+	bench.setOpticsPosition(2, position);
+	COMPARE_FUZZY(waist, bench.beam(2)->waist(), 1e-9);
+	COMPARE_FUZZY(radius, bench.beam(1)->radius(0.15), 1e-9);
+	COMPARE_FUZZY(overlap, Beam::overlap(*bench.beam(2), *bench.targetBeam()), 1e-9);
+
+	// Binary output
+	const string fileName = testFilePath("testCore.gbs");
+	BinarySweepWriter binaryWriter(fileName);
+	VERIFY(sweep.run(binaryWriter));
+	ifstream file(fileName.c_str(), ios::binary);
+	file.seekg(0, ios::end);
+	size_t headerSize = 24;
+	for (unsigned int i = 0; i < sweep.columns().size(); i++)
+		headerSize += 8 + sweep.columns()[i].size();
+	VERIFY(size_t(file.tellg()) == headerSize + 800*6*sizeof(double));
+	file.close();
+	remove(fileName.c_str());
+
+	// Invalid parameters are rejected
+	sweep.addParameter(SweepParameter(SweepParameter::CurvatureRadiusProperty, 1, 0.1, 0.2, 2));
+	VERIFY(!sweep.run(sequentialWriter));
+}
+
+void checkToleranceAnalysis()
+{
+	OpticsBench bench;
+	populateBench(bench);
+	bench.setTargetBeam(*bench.beam(bench.nOptics() - 1));
+
+	// Perturbations of the compiled bench match the corresponding changes of the bench
+	vector<Optics*> optics;
+	for (int i = 0; i < bench.nOptics(); i++)
+		optics.push_back(bench.opticsForPropertyChange(i));
+	CompiledBench compiledBench;
+	compiledBench.compile(optics, bench.wavelength());
+	CompiledBench::Workspace workspace;
+	compiledBench.initWorkspace(workspace);
+	vector<double> x(bench.nOptics()), powerScale(bench.nOptics(), 1.);
+	for (int i = 0; i < bench.nOptics(); i++)
+		x[i] = bench.optics(i)->position();
+	compiledBench.place(&x[0], x.size(), false, workspace);
+	CompiledBench::Perturbation perturbation;
+	powerScale[1] = 1./1.02;
+	perturbation.powerScale = &powerScale[0];
+	perturbation.waistScale = 0.9;
+	perturbation.wavelengthScale = 1.1;
+	const BeamState perturbed = compiledBench.propagate(workspace, perturbation);
+	Lens* lens = dynamic_cast<Lens*>(bench.opticsForPropertyChange(1));
+	lens->setFocal(lens->focal()*1.02);
+	Beam inputBeam = *bench.inputBeam();
+	inputBeam.setWaist(inputBeam.waist()*0.9);
+	bench.setInputBeam(inputBeam);
+	bench.setWavelength(bench.wavelength()*1.1);
+	COMPARE_FUZZY(perturbed.rayleigh[0], bench.beam(bench.nOptics() - 1)->rayleigh(Horizontal), 1e-9);
+	COMPARE_FUZZY(perturbed.waistPosition[0], bench.beam(bench.nOptics() - 1)->waistPosition(Horizontal), 1e-9);
+
+	OpticsBench nominalBench;
+	populateBench(nominalBench);
+	nominalBench.setTargetBeam(*nominalBench.beam(nominalBench.nOptics() - 1));
+	ToleranceAnalysis analysis(nominalBench);
+	analysis.addTolerance(Tolerance(Tolerance::PositionParameter, 1, 1e-3));
+	analysis.addTolerance(Tolerance(Tolerance::FocalParameter, 2, 0.01, Tolerance::UniformDistribution));
+	analysis.addTolerance(Tolerance(Tolerance::InputWaistParameter, 0, 0.));
+	analysis.addTolerance(Tolerance(Tolerance::WavelengthParameter, 0, 1e-3));
+	analysis.setThreadCount(1);
+	VERIFY(analysis.run(10000, 7));
+	COMPARE_FUZZY(analysis.nominalOverlap(), 1., 1e-12);
+	const OverlapDistribution sequential = analysis.overlap();
+	VERIFY(sequential.size() == 10000);
+	VERIFY((sequential.mean() < 1.) && (sequential.mean() > 0.9));
+	VERIFY(sequential.percentile(0.) <= sequential.percentile(0.05));
+	VERIFY(sequential.percentile(0.05) <= sequential.percentile(0.5));
+	VERIFY(sequential.percentile(1.) <= 1. + 1e-12);
+	VERIFY(sequential.histogram(10).back() > 0);
+	VERIFY(analysis.contribution(0) > 0.);
+	VERIFY(analysis.contribution(1) > 0.);
+	VERIFY(analysis.contribution(2) == 0.);
+
+	// The result only depends on the seed
+	const double contribution = analysis.contribution(0);
+	analysis.setThreadCount(3);
+	VERIFY(analysis.run(10000, 7));
+	VERIFY(analysis.overlap().mean() == sequential.mean());
+	VERIFY(analysis.overlap().percentile(0.01) == sequential.percentile(0.01));
+	VERIFY(analysis.contribution(0) == contribution);
+	VERIFY(analysis.run(10000, 8));
+	VERIFY(analysis.overlap().mean() != sequential.mean());
+
+	// Focal tolerances only apply to thin lenses and curved mirrors
+	analysis.addTolerance(Tolerance(Tolerance::FocalParameter, 0, 0.01));
+	VERIFY(!analysis.run(10, 0));
+}
+
+void checkLensSelection()
+{
+	// Target produced by two lenses of the catalog
+	OpticsBench referenceBench;
+	populateBench(referenceBench);
+	dynamic_cast<Lens*>(referenceBench.opticsForPropertyChange(2))->setFocal(0.05);
+	referenceBench.opticsPropertyChanged(2);
+
+	OpticsBench bench;
+	bench.populateDefault();
+	bench.setTargetBeam(*referenceBench.beam(referenceBench.nOptics() - 1));
+	bench.setTargetOverlap(0.99);
+
+	LensSelection selection(bench);
+	selection.addCatalogLens(CatalogLens(0.2, 2));
+	selection.addCatalogLens(CatalogLens(0.1, 1));
+	selection.addCatalogLens(CatalogLens(0.05, 1));
+	selection.setRange(0.01, 0.6);
+	selection.setThreadCount(1);
+	VERIFY(selection.run(3));
+	VERIFY(selection.overlap() >= 0.99);
+	VERIFY(selection.focals().size() == selection.positions().size());
+	VERIFY(selection.nCombinations() <= 3 + 6);
+
+	// The result only depends on the seed
+	LensSelection parallelSelection(bench);
+	parallelSelection.addCatalogLens(CatalogLens(0.2, 2));
+	parallelSelection.addCatalogLens(CatalogLens(0.1, 1));
+	parallelSelection.addCatalogLens(CatalogLens(0.05, 1));
+	parallelSelection.setRange(0.01, 0.6);
+	parallelSelection.setThreadCount(3);
+	VERIFY(parallelSelection.run(3));
+	VERIFY(parallelSelection.overlap() == selection.overlap());
+	VERIFY(parallelSelection.positions() == selection.positions());
+
+	selection.apply(bench);
+	VERIFY(bench.nOptics() == int(selection.focals().size()) + 1);
+	COMPARE_FUZZY(Beam::overlap(*bench.beam(bench.nOptics() - 1), *bench.targetBeam()), selection.overlap(), 1e-9);
+
+	// Out of stock lenses can not be selected
+	LensSelection emptySelection(bench);
+	emptySelection.addCatalogLens(CatalogLens(0.1, 0));
+	VERIFY(!emptySelection.run(0));
+	VERIFY(emptySelection.focals().empty());
+}
+
+int main()
+{
+	checkPropagation();
+	checkOpticsMatrix();
+	checkCompiledBench();
+	checkScalarTypes();
+	checkSphericalKernel();
+	checkPropagationTree();
+	checkOpticsMoves();
+	checkObjectPool();
+	checkCavities();
+	checkStabilityMap();
+	checkUpdate();
+	checkMagicWaist();
+	checkLocalOptimum();
+	checkDesignVariables();
+	checkFit();
+	checkBenchFile();
+	checkBinaryFile();
+	checkParameterSweep();
+	checkToleranceAnalysis();
+	checkLensSelection();
+
+	if (failures)
+		cerr << failures << " test(s) failed" << endl;
+
+	return failures ? 1 : 0;
+}